@@ -433,7 +433,9 @@ void Airport::WriteBaseOutput( const std::string& root, const SGBucket& b )
         pvmt_ld.SetPreserve3D( false );
         ld_chopper.Add( pvmt_ld, "Asphalt" );
 
-        ld_chopper.Save(false);
+        if ( !ld_chopper.Save(false) ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "Failed to save low detail polys for " << icao );
+        }
         
         //
         // Then create seperate smoothed .btg for high detail airport
@@ -539,6 +541,8 @@ void Airport::WriteBaseOutput( const std::string& root, const SGBucket& b )
         outer_base.SetTexMethod( TG_TEX_BY_GEODE );
         chopper.Add( outer_base, "Airport" );
 
-        chopper.Save(false);
+        if ( !chopper.Save(false) ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "Failed to save base polys for " << icao );
+        }
     }
 }
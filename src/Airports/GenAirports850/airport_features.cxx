@@ -20,6 +20,7 @@
 #include <terragear/tg_unique_vec3f.hxx>
 #include <terragear/tg_unique_vec2f.hxx>
 #include <terragear/tg_shapefile.hxx>
+#include <terragear/tg_triangle_locator.hxx>
 
 #include "airport.hxx"
 #include "beznode.hxx"
@@ -383,12 +384,14 @@ void Airport::IntersectFeaturesWithBase(void)
                     tri.SetNode( n, base_nodes[tri.GetIndex(n)].GetPosition() );
                 }
 
-                // todo - this should add the triangle to an arrangement
-                // so we can do faster lookups
                 base_mesh.push_back( tri );
             }
         }
     }
+
+    // index the base mesh once, so each feature edge is only
+    // checked against the triangles around it
+    tgTriangleLocator base_locator( base_mesh );
     
 #if 1
     for ( unsigned int area=AIRPORT_AREA_RWY_FEATURES; area<=AIRPORT_AREA_TAXI_FEATURES; area++ ) {
@@ -397,7 +400,7 @@ void Airport::IntersectFeaturesWithBase(void)
 
             before  = current.TotalNodes();
             // TODO : elevation mesh should have drape function that takes triangles
-            current = tgPolygon::AddIntersectingNodes( current, base_mesh );
+            current = tgPolygon::AddIntersectingNodes( current, base_mesh, base_locator );
             after   = current.TotalNodes();
         
             if (before != after) {
@@ -28,7 +28,7 @@
 #include <simgear/math/SGMath.hxx>
 #include <simgear/debug/logstream.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_array_cache.hxx>
 
 #include "global.hxx"
 #include "debug.hxx"
@@ -41,7 +41,7 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
 {
     bool done = false;
     unsigned int i;
-    tgArray array;
+    string_list dirs;
 
     // make a copy so our routine is non-destructive.
     std::vector<SGGeod> points = points_source;
@@ -56,6 +56,10 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
         points[i].setElevationM( -9999.0 );
     }
 
+    for ( i = 0; i < elev_src.size(); ++i ) {
+        dirs.push_back( root + "/" + elev_src[i] );
+    }
+
     while ( !done ) {
         // find first node with -9999 elevation
         SGGeod first = SGGeod();
@@ -71,45 +75,31 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
 
         if ( found_one ) {
             SGBucket b( first );
-            std::string base = b.gen_base_path();
-
-            // try the various elevation sources
-            i = 0;
-            bool found_file = false;
-            while ( !found_file && i < elev_src.size() ) {
-                std::string array_path = root + "/" + elev_src[i] + "/" + base + "/" + b.gen_index_str();
 
-                if ( array.open(array_path) ) {
-                    found_file = true;
-                    TG_LOG( SG_GENERAL, SG_DEBUG, "Using array_path = " << array_path );
-                }
-                i++;
-            }
-
-            // this will fill in a zero structure if no array data
-            // found/opened
-            array.parse( b );
-
-            // this will do a hasty job of removing voids by inserting
-            // data from the nearest neighbor (sort of)
-            array.remove_voids();
+            // try the various elevation sources - the array is shared
+            // with every other airport in this bucket
+            tgArrayRef array = tgArrayCache::instance().Get( dirs, b );
 
             // update all the non-updated elevations that are inside
             // this array file
-            double elev;
+            std::vector<unsigned int> pending;
+            std::vector<SGGeod> pending_pts;
+            std::vector<double> elevs;
             done = true;
             for ( i = 0; i < points.size(); ++i ) {
                 if ( points[i].getElevationM() < -9000.0 ) {
                     done = false;
-                    elev = array.altitude_from_grid( points[i].getLongitudeDeg() * 3600.0,
-                                                     points[i].getLatitudeDeg() * 3600.0 );
-                    if ( elev > -9000 ) {
-                        points[i].setElevationM( elev );
-                    }
+                    pending.push_back( i );
+                    pending_pts.push_back( points[i] );
                 }
             }
 
-            array.close();
+            array->altitude_from_grid( pending_pts, elevs );
+            for ( i = 0; i < pending.size(); ++i ) {
+                if ( elevs[i] > -9000 ) {
+                    points[ pending[i] ].setElevationM( elevs[i] );
+                }
+            }
         } else {
             done = true;
         }
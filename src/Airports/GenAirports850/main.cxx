@@ -24,6 +24,7 @@
 #include <simgear/misc/strutils.hxx>
 
 #include <Include/version.h>
+#include <terragear/tg_array_cache.hxx>
 
 #include "scheduler.hxx"
 #include "beznode.hxx"
@@ -334,6 +335,7 @@ int main(int argc, char **argv)
         }
     }
 
+    tgArrayCache::instance().PrintStats();
     TG_LOG(SG_GENERAL, SG_INFO, "Genapts finished successfully");
 
     return 0;
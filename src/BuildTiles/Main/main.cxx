@@ -22,20 +22,17 @@
 #  include <config.h>
 #endif
 
-#ifdef _MSC_VER
-#  include <windows.h>
-#  define tgSleep(x) Sleep(x*1000)
-#else
-#  define tgSleep(x) sleep(x)
-#endif
+#include <algorithm>
 
 #include <boost/thread.hpp>
 
 #include <simgear/debug/logstream.hxx>
 #include <Include/version.h>
+#include <terragear/tg_array_cache.hxx>
 
 #include "tgconstruct.hxx"
 #include "priorities.hxx"
+#include "scheduler.hxx"
 #include "usgs.hxx"
 
 using std::string;
@@ -59,6 +56,12 @@ static void usage( const string name ) {
     SG_LOG(SG_GENERAL, SG_ALERT, "  --ignore-landmass");
     SG_LOG(SG_GENERAL, SG_ALERT, "  --threads");
     SG_LOG(SG_GENERAL, SG_ALERT, "  --threads=<numthreads>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --tile-threads=<numthreads per tile>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --stage-cache=<megabytes>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --elevation-cache=<megabytes>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --bin-intermediate");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --bin-intermediate=<compression level 0-9>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --telemetry=<file base name>");
     SG_LOG(SG_GENERAL, SG_ALERT, " ] <load directory...>");
     exit(-1);
 }
@@ -73,6 +76,11 @@ int main(int argc, char **argv) {
     SGGeod min, max;
     long tile_id = -1;
     int num_threads = 1;
+    int tile_threads = 1;
+    long stage_cache_mb = 0;
+    long elev_cache_mb = TG_ARRAY_CACHE_DEFAULT_MB;
+    int bin_compression = -1;
+    string telemetry_base = "";
 
     vector<string> load_dirs;
     bool ignoreLandmass = false;
@@ -121,6 +129,18 @@ int main(int argc, char **argv) {
             num_threads = atoi( arg.substr(10).c_str() );
         } else if (arg.find("--threads") == 0) {
             num_threads = boost::thread::hardware_concurrency();
+        } else if (arg.find("--tile-threads=") == 0) {
+            tile_threads = atoi( arg.substr(15).c_str() );
+        } else if (arg.find("--stage-cache=") == 0) {
+            stage_cache_mb = atol( arg.substr(14).c_str() );
+        } else if (arg.find("--elevation-cache=") == 0) {
+            elev_cache_mb = atol( arg.substr(18).c_str() );
+        } else if (arg.find("--bin-intermediate=") == 0) {
+            bin_compression = atoi( arg.substr(19).c_str() );
+        } else if (arg.find("--bin-intermediate") == 0) {
+            bin_compression = 0;
+        } else if (arg.find("--telemetry=") == 0) {
+            telemetry_base = arg.substr(12);
         } else if (arg.find("--debug-dir=") == 0) {
             debug_dir = arg.substr(12);
         } else if (arg.find("--debug-areas=") == 0) {
@@ -156,6 +176,18 @@ int main(int argc, char **argv) {
         }
     }
     SG_LOG(SG_GENERAL, SG_ALERT, "Nudge is " << nudge);
+    if ( tile_threads > 1 ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Using up to " << tile_threads << " threads per tile");
+    }
+    if ( stage_cache_mb > 0 ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Stage cache is " << stage_cache_mb << " MB");
+    }
+    SG_LOG(SG_GENERAL, SG_ALERT, "Elevation cache is " << elev_cache_mb << " MB");
+    tgArrayCache::instance().SetMaxBytes( (size_t)elev_cache_mb * 1024 * 1024 );
+    if ( bin_compression >= 0 ) {
+        bin_compression = std::min( bin_compression, 9 );
+        SG_LOG(SG_GENERAL, SG_ALERT, "Binary intermediate files, compression level " << bin_compression);
+    }
     for (int i = arg_pos; i < argc; i++) {
         load_dirs.push_back(argv[i]);
         SG_LOG(SG_GENERAL, SG_ALERT, "Load directory: " << argv[i]);
@@ -166,9 +198,8 @@ int main(int argc, char **argv) {
         exit( -1 );
     }    
 
-    // tile work queue
+    // tile work list
     std::vector<SGBucket> bucketList;
-    SGLockedQueue<SGBucket> wq;
 
     // First generate the workqueue of buckets to construct
     if (tile_id == -1) {
@@ -190,54 +221,37 @@ int main(int argc, char **argv) {
         bucketList.push_back( SGBucket( tile_id ) );
     }
 
-    std::vector<TGConstruct *> constructs;
-    SGMutex filelock;
-
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
-
-    // now create the worker threads for stage 1
-    for (int i=0; i<num_threads; i++) {
-        TGConstruct* construct = new TGConstruct( areas, 1, wq, &filelock );
-        //construct->set_cover( cover );
-        construct->set_paths( work_dir, share_dir, output_dir, load_dirs );
-        construct->set_options( ignoreLandmass, nudge );
-        construct->set_debug( debug_dir, debug_area_defs, debug_shape_defs );
-        constructs.push_back( construct );
-    }
+    // Every tile runs all 3 stages.  A tile's stage is scheduled once the
+    // previous stage has completed for the tile and all of its neighbors
+    TGTileScheduler scheduler( bucketList, 3 );
 
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
+    // Optionally keep the intermediate data between stages in memory.
+    // Whatever doesn't fit is written to the work dir as usual
+    TGStageStore* stage_store = NULL;
+    if ( stage_cache_mb > 0 ) {
+        stage_store = new TGStageStore( (size_t)stage_cache_mb * 1024 * 1024 );
     }
 
-    // delete the stage 1 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
+    // Optionally time every step of every tile
+    TGTelemetry* telemetry = NULL;
+    if ( !telemetry_base.empty() ) {
+        telemetry = new TGTelemetry();
     }
-    constructs.clear();
 
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
+    std::vector<TGConstruct *> constructs;
+    SGMutex dirlock;
 
+    // now create the worker threads
     for (int i=0; i<num_threads; i++) {
-        TGConstruct* construct = new TGConstruct( areas, 2, wq, &filelock );
+        TGConstruct* construct = new TGConstruct( areas, scheduler, &dirlock );
         //construct->set_cover( cover );
         construct->set_paths( work_dir, share_dir, output_dir, load_dirs );
         construct->set_options( ignoreLandmass, nudge );
         construct->set_debug( debug_dir, debug_area_defs, debug_shape_defs );
+        construct->set_stage_store( stage_store );
+        construct->set_bin_intermediate( bin_compression );
+        construct->set_tile_threads( tile_threads > 1 ? tile_threads : 1 );
+        construct->set_telemetry( telemetry, i );
         constructs.push_back( construct );
     }
 
@@ -245,51 +259,33 @@ int main(int argc, char **argv) {
     for (unsigned int i=0; i<constructs.size(); i++) {
         constructs[i]->start();
     }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
+    // wait for all threads to complete - they exit once the scheduler runs out of work
     for (unsigned int i=0; i<constructs.size(); i++) {
         constructs[i]->join();
     }
-    // delete the stage 2 construct objects
+
+    // delete the construct objects
     for (unsigned int i=0; i<constructs.size(); i++) {
         delete constructs[i];
     }
     constructs.clear();
 
-	/* fill the workqueue */
-	for (unsigned int i=0; i<bucketList.size(); i++) {
-	    wq.push( bucketList[i] );
-	}
+    tgArrayCache::instance().PrintStats();
 
-    for (int i=0; i<num_threads; i++) {
-        TGConstruct* construct = new TGConstruct( areas, 3, wq, &filelock );
-        //construct->set_cover( cover );
-        construct->set_paths( work_dir, share_dir, output_dir, load_dirs );
-        construct->set_options( ignoreLandmass, nudge );
-        construct->set_debug( debug_dir, debug_area_defs, debug_shape_defs );
-        constructs.push_back( construct );
+    if ( stage_store ) {
+        stage_store->PrintStats();
+        delete stage_store;
     }
 
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
-    }
-    // delete the stage 3 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
+    if ( telemetry ) {
+        string trace_file = telemetry_base + "_trace.json";
+        string tiles_file = telemetry_base + "_tiles.csv";
+
+        if ( telemetry->WriteTrace( trace_file ) && telemetry->WriteTileSummary( tiles_file ) ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "Telemetry written to " << trace_file << " and " << tiles_file);
+        }
+        delete telemetry;
     }
-    constructs.clear();
 
     SG_LOG(SG_GENERAL, SG_ALERT, "[Finished successfully]");
     return 0;
@@ -152,7 +152,7 @@ public:
         }
 
         SG_LOG(SG_GENERAL, SG_ALERT, "No area named " << name);
-        exit(0);
+        exit(1);
         return 0;
     }
 
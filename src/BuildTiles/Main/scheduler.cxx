@@ -0,0 +1,174 @@
+// scheduler.cxx -- dependency aware tile / stage scheduler for tg-construct
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <algorithm>
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGGuard.hxx>
+
+#include "scheduler.hxx"
+
+TGTileScheduler::TGTileScheduler( const std::vector<SGBucket>& buckets, unsigned int s ) :
+        num_stages(s),
+        completed(0)
+{
+    // create the tile states
+    for (unsigned int i=0; i<buckets.size(); i++) {
+        if ( tile_index.find( buckets[i].gen_index() ) != tile_index.end() ) {
+            continue;
+        }
+
+        TileState ts;
+        ts.bucket     = buckets[i];
+        ts.stage_done = 0;
+        ts.pending    = false;
+
+        tile_index[ buckets[i].gen_index() ] = tiles.size();
+        tiles.push_back( ts );
+    }
+
+    // link up the neighbors - tiles outside of the build area
+    // don't get built, so they never block anything
+    for (unsigned int i=0; i<tiles.size(); i++) {
+        for (int dx=-1; dx<=1; dx++) {
+            for (int dy=-1; dy<=1; dy++) {
+                if ( dx == 0 && dy == 0 ) {
+                    continue;
+                }
+
+                SGBucket nb = tiles[i].bucket.sibling( dx, dy );
+                std::map<long, int>::const_iterator it = tile_index.find( nb.gen_index() );
+                if ( it != tile_index.end() && it->second != (int)i ) {
+                    std::vector<int>& n = tiles[i].neighbors;
+                    if ( std::find( n.begin(), n.end(), it->second ) == n.end() ) {
+                        n.push_back( it->second );
+                        tiles[it->second].dependents.push_back( i );
+                    }
+                }
+            }
+        }
+    }
+
+    // stage 1 has no dependencies
+    for (unsigned int i=0; i<tiles.size(); i++) {
+        QueueIfReady( i );
+    }
+}
+
+// must be called with the mutex held
+bool TGTileScheduler::IsReady( int t ) const
+{
+    TileState const& ts = tiles[t];
+
+    if ( ts.pending || ts.stage_done >= num_stages ) {
+        return false;
+    }
+
+    for (unsigned int i=0; i<ts.neighbors.size(); i++) {
+        if ( tiles[ ts.neighbors[i] ].stage_done < ts.stage_done ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// must be called with the mutex held
+void TGTileScheduler::QueueIfReady( int t )
+{
+    if ( IsReady( t ) ) {
+        tiles[t].pending = true;
+        ready.push_back( t );
+    }
+}
+
+bool TGTileScheduler::GetJob( SGBucket& b, unsigned int& stage )
+{
+    SGGuard<SGMutex> g( mutex );
+
+    while ( ready.empty() ) {
+        if ( completed == GetNumJobs() ) {
+            return false;
+        }
+        cond.wait( mutex );
+    }
+
+    int t = ready.front();
+    ready.pop_front();
+
+    b     = tiles[t].bucket;
+    stage = tiles[t].stage_done + 1;
+
+    return true;
+}
+
+void TGTileScheduler::CompleteJob( const SGBucket& b, unsigned int stage )
+{
+    SGGuard<SGMutex> g( mutex );
+
+    std::map<long, int>::const_iterator it = tile_index.find( b.gen_index() );
+    if ( it == tile_index.end() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGTileScheduler: completed unknown tile " << b.gen_index_str() );
+        return;
+    }
+
+    int t = it->second;
+    tiles[t].stage_done = stage;
+    tiles[t].pending    = false;
+    completed++;
+
+    // this tile, and any tile waiting on it, may now be able to advance
+    QueueIfReady( t );
+    for (unsigned int i=0; i<tiles[t].dependents.size(); i++) {
+        QueueIfReady( tiles[t].dependents[i] );
+    }
+
+    // wake everyone - new work may be ready, or we may be all done
+    cond.broadcast();
+}
+
+bool TGTileScheduler::IsStageConsumed( const SGBucket& b, unsigned int stage )
+{
+    SGGuard<SGMutex> g( mutex );
+
+    std::map<long, int>::const_iterator it = tile_index.find( b.gen_index() );
+    if ( it == tile_index.end() ) {
+        return false;
+    }
+
+    TileState const& ts = tiles[it->second];
+    if ( ts.stage_done < stage ) {
+        return false;
+    }
+
+    for (unsigned int i=0; i<ts.dependents.size(); i++) {
+        if ( tiles[ ts.dependents[i] ].stage_done <= stage ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned int TGTileScheduler::GetCompletedJobs( void )
+{
+    SGGuard<SGMutex> g( mutex );
+    return completed;
+}
@@ -0,0 +1,80 @@
+// scheduler.hxx -- dependency aware tile / stage scheduler for tg-construct
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+#ifndef _TG_SCHEDULER_HXX
+#define _TG_SCHEDULER_HXX
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/threads/SGThread.hxx>
+
+// A tile may run stage N+1 as soon as stage N has finished for the tile
+// itself and for all of its (up to 8) neighbors that are part of the build.
+// The neighbors' shared edge files are the only cross tile input of a stage,
+// so there is no need for a global barrier between the stages.
+class TGTileScheduler
+{
+public:
+    TGTileScheduler( const std::vector<SGBucket>& buckets, unsigned int num_stages );
+
+    // Blocks until a job is ready to run.  Returns false once every
+    // stage of every tile has been completed.
+    bool GetJob( SGBucket& b, unsigned int& stage );
+
+    // Mark a job as complete, and queue up anything it was blocking
+    void CompleteJob( const SGBucket& b, unsigned int stage );
+
+    // True once every tile that reads this tile's shared data from the
+    // given stage has completed the following stage
+    bool IsStageConsumed( const SGBucket& b, unsigned int stage );
+
+    unsigned int GetNumTiles( void ) const {
+        return tiles.size();
+    }
+    unsigned int GetNumJobs( void ) const {
+        return tiles.size() * num_stages;
+    }
+    unsigned int GetCompletedJobs( void );
+
+private:
+    struct TileState {
+        SGBucket            bucket;
+        unsigned int        stage_done;     // last completed stage (0 = none)
+        bool                pending;        // queued or running
+        std::vector<int>    neighbors;      // tiles in the build we depend on
+        std::vector<int>    dependents;     // tiles in the build that depend on us
+    };
+
+    bool IsReady( int t ) const;
+    void QueueIfReady( int t );
+
+    std::vector<TileState>  tiles;
+    std::map<long, int>     tile_index;     // bucket index -> tiles[]
+    std::deque<int>         ready;
+
+    unsigned int            num_stages;
+    unsigned int            completed;
+
+    SGMutex                 mutex;
+    SGWaitCondition         cond;
+};
+
+#endif // _TG_SCHEDULER_HXX
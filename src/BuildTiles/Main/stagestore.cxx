@@ -0,0 +1,210 @@
+// stagestore.cxx -- in memory hand off of tile data between construct stages
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGGuard.hxx>
+
+#include "stagestore.hxx"
+
+TGStageStore::TGStageStore( size_t max ) :
+        max_bytes(max),
+        cur_bytes(0),
+        peak_bytes(0),
+        num_stored(0),
+        num_spilled(0)
+{
+}
+
+TGStageStore::~TGStageStore()
+{
+    std::map<StageKey, TileData*>::iterator tit;
+    for ( tit = tiles.begin(); tit != tiles.end(); tit++ ) {
+        delete tit->second;
+    }
+    tiles.clear();
+
+    std::map<StageKey, EdgeData*>::iterator eit;
+    for ( eit = edges.begin(); eit != edges.end(); eit++ ) {
+        delete eit->second;
+    }
+    edges.clear();
+}
+
+// rough per object sizes - we just need to stay in the neighborhood of the ceiling
+size_t TGStageStore::EstimateSize( const tgAreas& polys, const TGNodes& nodes )
+{
+    const size_t tri_size = sizeof(tgTriangle) + 3 * ( sizeof(SGGeod) + 2*sizeof(SGVec2f) + sizeof(SGVec3d) + sizeof(int) );
+    size_t bytes = nodes.size() * sizeof(TGNode);
+
+    for (unsigned int area = 0; area < polys.size(); area++) {
+        for (unsigned int p = 0; p < polys.area_size(area); p++) {
+            tgPolygon const& poly = polys.get_poly(area, p);
+
+            bytes += sizeof(tgPolygon);
+            bytes += poly.Contours()  * sizeof(tgContour);
+            bytes += poly.TotalNodes() * sizeof(SGGeod);
+            bytes += poly.Triangles() * tri_size;
+            bytes += poly.GetMaterial().size() + poly.GetFlag().size();
+        }
+    }
+
+    return bytes;
+}
+
+size_t TGStageStore::EstimateSize( const TGTileEdges& e )
+{
+    const tgedgenode_list* sides[4] = { &e.north, &e.south, &e.east, &e.west };
+    size_t bytes = sizeof(TGTileEdges);
+
+    for (unsigned int s = 0; s < 4; s++) {
+        for (unsigned int i = 0; i < sides[s]->size(); i++) {
+            TGEdgeNode const& en = (*sides[s])[i];
+
+            bytes += sizeof(TGEdgeNode);
+            bytes += en.face_areas.size()   * sizeof(double);
+            bytes += en.face_normals.size() * sizeof(SGVec3f);
+        }
+    }
+
+    return bytes;
+}
+
+// must be called with the lock held
+bool TGStageStore::Reserve( size_t bytes )
+{
+    if ( cur_bytes + bytes > max_bytes ) {
+        num_spilled++;
+        return false;
+    }
+
+    cur_bytes += bytes;
+    if ( cur_bytes > peak_bytes ) {
+        peak_bytes = cur_bytes;
+    }
+    num_stored++;
+
+    return true;
+}
+
+bool TGStageStore::PutTile( const SGBucket& b, unsigned int stage, tgAreas& polys, TGNodes& nodes )
+{
+    size_t bytes = EstimateSize( polys, nodes );
+
+    {
+        SGGuard<SGMutex> g( lock );
+        if ( !Reserve( bytes ) ) {
+            return false;
+        }
+    }
+
+    // move the data into the store outside of the lock
+    TileData* td = new TileData;
+    td->bytes = bytes;
+    td->polys.swap( polys );
+    td->polys.ClearUnsaved();
+    nodes.SaveToList( td->nodes );
+
+    SGGuard<SGMutex> g( lock );
+    TileData*& slot = tiles[ MakeKey(b, stage) ];
+    if ( slot ) {
+        // replaced - shouldn't happen, but don't leak
+        cur_bytes -= slot->bytes;
+        delete slot;
+    }
+    slot = td;
+
+    return true;
+}
+
+bool TGStageStore::TakeTile( const SGBucket& b, unsigned int stage, tgAreas& polys, TGNodes& nodes )
+{
+    TileData* td = NULL;
+
+    {
+        SGGuard<SGMutex> g( lock );
+        std::map<StageKey, TileData*>::iterator it = tiles.find( MakeKey(b, stage) );
+        if ( it == tiles.end() ) {
+            return false;
+        }
+
+        td = it->second;
+        tiles.erase( it );
+        cur_bytes -= td->bytes;
+    }
+
+    polys.swap( td->polys );
+    nodes.LoadFromList( td->nodes );
+    delete td;
+
+    return true;
+}
+
+bool TGStageStore::PutEdges( const SGBucket& b, unsigned int stage, const TGTileEdges& e )
+{
+    size_t bytes = EstimateSize( e );
+
+    SGGuard<SGMutex> g( lock );
+    if ( !Reserve( bytes ) ) {
+        return false;
+    }
+
+    EdgeData*& slot = edges[ MakeKey(b, stage) ];
+    if ( slot ) {
+        cur_bytes -= slot->bytes;
+        delete slot;
+    }
+    slot = new EdgeData;
+    slot->edges = e;
+    slot->bytes = bytes;
+
+    return true;
+}
+
+bool TGStageStore::GetEdges( const SGBucket& b, unsigned int stage, TGTileEdges& e )
+{
+    SGGuard<SGMutex> g( lock );
+
+    std::map<StageKey, EdgeData*>::const_iterator it = edges.find( MakeKey(b, stage) );
+    if ( it == edges.end() ) {
+        return false;
+    }
+
+    e = it->second->edges;
+    return true;
+}
+
+void TGStageStore::ReleaseEdges( const SGBucket& b, unsigned int stage )
+{
+    SGGuard<SGMutex> g( lock );
+
+    std::map<StageKey, EdgeData*>::iterator it = edges.find( MakeKey(b, stage) );
+    if ( it != edges.end() ) {
+        cur_bytes -= it->second->bytes;
+        delete it->second;
+        edges.erase( it );
+    }
+}
+
+void TGStageStore::PrintStats( void )
+{
+    SGGuard<SGMutex> g( lock );
+
+    SG_LOG(SG_GENERAL, SG_ALERT, "Stage store: " << num_stored << " handed off in memory, " << num_spilled << " spilled to disk, peak " << peak_bytes / (1024*1024) << " of " << max_bytes / (1024*1024) << " MB" );
+}
@@ -0,0 +1,119 @@
+// stagestore.hxx -- in memory hand off of tile data between construct stages
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+#ifndef _TG_STAGESTORE_HXX
+#define _TG_STAGESTORE_HXX
+
+#include <map>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/threads/SGThread.hxx>
+
+#include <terragear/tg_nodes.hxx>
+#include <terragear/tg_areas.hxx>
+
+// Shared edge data for a single node on a tile border.  Stage 1 only
+// needs the position, stage 2 adds the faces the node is a member of.
+struct TGEdgeNode {
+    SGGeod                  node;
+    std::vector<double>     face_areas;
+    std::vector<SGVec3f>    face_normals;
+};
+typedef std::vector<TGEdgeNode> tgedgenode_list;
+
+struct TGTileEdges {
+    enum { NORTH = 0, SOUTH, EAST, WEST };
+
+    tgedgenode_list north;
+    tgedgenode_list south;
+    tgedgenode_list east;
+    tgedgenode_list west;
+
+    tgedgenode_list& get_side( unsigned int side ) {
+        switch( side ) {
+            case NORTH: return north;
+            case SOUTH: return south;
+            case EAST:  return east;
+            default:    return west;
+        }
+    }
+};
+
+// When a single tg-construct process builds a whole area, the clipped
+// polys, node list and shared edges can be handed from one stage to the
+// next in memory.  Anything that doesn't fit under the memory ceiling is
+// refused, and the caller falls back to the intermediate files on disk.
+class TGStageStore
+{
+public:
+    TGStageStore( size_t max_bytes );
+    ~TGStageStore();
+
+    // Tile data is taken by the next stage of the same tile, so it is moved
+    // in and out of the store without a copy.  Anything the intermediate
+    // files don't keep is dropped on the way in, so the next stage sees the
+    // same state either way.
+    bool PutTile( const SGBucket& b, unsigned int stage, tgAreas& polys, TGNodes& nodes );
+    bool TakeTile( const SGBucket& b, unsigned int stage, tgAreas& polys, TGNodes& nodes );
+
+    // Edge data is read by each neighbor, so it's copied out, and
+    // released once the scheduler says every neighbor is done with it
+    bool PutEdges( const SGBucket& b, unsigned int stage, const TGTileEdges& edges );
+    bool GetEdges( const SGBucket& b, unsigned int stage, TGTileEdges& edges );
+    void ReleaseEdges( const SGBucket& b, unsigned int stage );
+
+    void PrintStats( void );
+
+private:
+    struct TileData {
+        tgAreas             polys;
+        std::vector<TGNode> nodes;
+        size_t              bytes;
+    };
+
+    struct EdgeData {
+        TGTileEdges         edges;
+        size_t              bytes;
+    };
+
+    typedef std::pair<long, unsigned int> StageKey;
+
+    static StageKey MakeKey( const SGBucket& b, unsigned int stage ) {
+        return StageKey( b.gen_index(), stage );
+    }
+
+    static size_t EstimateSize( const tgAreas& polys, const TGNodes& nodes );
+    static size_t EstimateSize( const TGTileEdges& edges );
+
+    bool Reserve( size_t bytes );
+
+    std::map<StageKey, TileData*>   tiles;
+    std::map<StageKey, EdgeData*>   edges;
+
+    size_t  max_bytes;
+    size_t  cur_bytes;
+    size_t  peak_bytes;
+
+    unsigned int num_stored;
+    unsigned int num_spilled;
+
+    SGMutex lock;
+};
+
+#endif // _TG_STAGESTORE_HXX
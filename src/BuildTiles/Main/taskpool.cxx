@@ -0,0 +1,96 @@
+// taskpool.cxx -- runs the independent pieces of a single tile on a few threads
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <vector>
+
+#include <simgear/threads/SGGuard.hxx>
+
+#include "taskpool.hxx"
+
+TGTaskPool::TGTaskPool( unsigned int n ) :
+        num_threads( n > 0 ? n : 1 ),
+        task(NULL),
+        count(0),
+        next(0)
+{
+}
+
+bool TGTaskPool::GetNext( unsigned int& idx )
+{
+    SGGuard<SGMutex> g( lock );
+
+    if ( next >= count ) {
+        return false;
+    }
+    idx = next++;
+
+    return true;
+}
+
+void TGTaskPool::Work( void )
+{
+    unsigned int idx;
+
+    while ( GetNext( idx ) ) {
+        task->Run( idx );
+    }
+}
+
+void TGTaskPool::Worker::run()
+{
+    pool.Work();
+}
+
+void TGTaskPool::Run( TGTask& t, unsigned int c )
+{
+    // not worth a thread
+    if ( num_threads < 2 || c < 2 ) {
+        for (unsigned int i=0; i<c; i++) {
+            t.Run( i );
+        }
+        return;
+    }
+
+    task  = &t;
+    count = c;
+    next  = 0;
+
+    // the helpers only live for this run - the steps we split up are
+    // long enough that starting a thread is noise
+    unsigned int num_helpers = ( num_threads < c ? num_threads : c ) - 1;
+    std::vector<Worker*> helpers;
+
+    for (unsigned int i=0; i<num_helpers; i++) {
+        Worker* w = new Worker( *this );
+        w->start();
+        helpers.push_back( w );
+    }
+
+    Work();
+
+    for (unsigned int i=0; i<helpers.size(); i++) {
+        helpers[i]->join();
+        delete helpers[i];
+    }
+
+    task  = NULL;
+    count = 0;
+    next  = 0;
+}
@@ -0,0 +1,77 @@
+// taskpool.hxx -- runs the independent pieces of a single tile on a few threads
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+#ifndef _TG_TASKPOOL_HXX
+#define _TG_TASKPOOL_HXX
+
+#include <simgear/compiler.h>
+#include <simgear/threads/SGThread.hxx>
+
+// A set of work items that can run in any order, on any thread.
+// Run() must only touch data belonging to its own index.
+class TGTask
+{
+public:
+    virtual ~TGTask() {}
+    virtual void Run( unsigned int idx ) = 0;
+};
+
+// With the tile scheduler, every construct thread works on its own tile.
+// At the end of a build, only a few heavy tiles are left, and most cores
+// are idle.  The pool lets a construct thread split the clipping,
+// tesselation and elevation steps of its tile over a few helper threads.
+// With one thread (the default), tasks run in order on the calling thread.
+class TGTaskPool
+{
+public:
+    TGTaskPool( unsigned int num_threads = 1 );
+
+    void SetNumThreads( unsigned int n ) {
+        num_threads = ( n > 0 ) ? n : 1;
+    }
+    unsigned int GetNumThreads( void ) const {
+        return num_threads;
+    }
+
+    // Run the task for every index in [0, count), and return once all
+    // of them are done.  The calling thread works on the tasks as well.
+    void Run( TGTask& task, unsigned int count );
+
+private:
+    class Worker : public SGThread
+    {
+    public:
+        Worker( TGTaskPool& p ) : pool(p) {}
+    private:
+        virtual void run();
+        TGTaskPool& pool;
+    };
+
+    bool GetNext( unsigned int& idx );
+    void Work( void );
+
+    unsigned int    num_threads;
+
+    // the current run
+    TGTask*         task;
+    unsigned int    count;
+    unsigned int    next;
+
+    SGMutex         lock;
+};
+
+#endif // _TG_TASKPOOL_HXX
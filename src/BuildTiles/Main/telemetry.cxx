@@ -0,0 +1,225 @@
+// telemetry.cxx -- per tile / step timing and memory counters for tg-construct
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cstdio>
+#include <map>
+
+#ifdef _MSC_VER
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <time.h>
+#  include <sys/time.h>
+#  include <sys/resource.h>
+#endif
+
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGGuard.hxx>
+
+#include "telemetry.hxx"
+
+TGTelemetry::TGTelemetry()
+{
+    start.stamp();
+}
+
+int64_t TGTelemetry::GetElapsedUSecs( void ) const
+{
+    SGTimeStamp now;
+    now.stamp();
+
+    return ( now - start ).toUSecs();
+}
+
+void TGTelemetry::Add( const Record& r )
+{
+    SGGuard<SGMutex> g( lock );
+    records.push_back( r );
+}
+
+int64_t TGTelemetry::GetThreadCpuUSecs( void )
+{
+#ifdef _MSC_VER
+    FILETIME create_time, exit_time, kernel_time, user_time;
+    if ( !GetThreadTimes( GetCurrentThread(), &create_time, &exit_time, &kernel_time, &user_time ) ) {
+        return 0;
+    }
+
+    // 100ns units
+    int64_t kernel = ( (int64_t)kernel_time.dwHighDateTime << 32 ) | kernel_time.dwLowDateTime;
+    int64_t user   = ( (int64_t)user_time.dwHighDateTime << 32 )   | user_time.dwLowDateTime;
+
+    return ( kernel + user ) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if ( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) != 0 ) {
+        return 0;
+    }
+
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    // no per thread clock - fall back to the process
+    struct rusage ru;
+    if ( getrusage( RUSAGE_SELF, &ru ) != 0 ) {
+        return 0;
+    }
+
+    return (int64_t)( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+}
+
+long TGTelemetry::GetPeakRssKB( void )
+{
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS pmc;
+    if ( !GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof(pmc) ) ) {
+        return 0;
+    }
+
+    return pmc.PeakWorkingSetSize / 1024;
+#else
+    struct rusage ru;
+    if ( getrusage( RUSAGE_SELF, &ru ) != 0 ) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    // bytes on OSX
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+// chrome trace event format : a complete ('X') event per step, with the
+// counters as args.  Times are in microseconds.
+bool TGTelemetry::WriteTrace( const std::string& file )
+{
+    SGGuard<SGMutex> g( lock );
+
+    FILE* fp = fopen( file.c_str(), "w" );
+    if ( !fp ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << file << " for writing!" );
+        return false;
+    }
+
+    fprintf( fp, "{\"traceEvents\":[\n" );
+    for (unsigned int i=0; i<records.size(); i++) {
+        Record const& r = records[i];
+        SGBucket b( r.tile );
+
+        fprintf( fp, "%s{\"name\":\"%s\",\"cat\":\"stage%u\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%lld,\"dur\":%lld,\"args\":{\"tile\":\"%s\",\"stage\":%u,\"cpu_us\":%lld,"
+                     "\"peak_rss_kb\":%ld,\"polys\":%u,\"nodes\":%u,\"triangles\":%u}}",
+                 i ? ",\n" : "",
+                 r.step.c_str(), r.stage, r.thread,
+                 (long long)r.start_us, (long long)r.wall_us,
+                 b.gen_index_str().c_str(), r.stage, (long long)r.cpu_us,
+                 r.peak_rss_kb, r.polys, r.nodes, r.triangles );
+    }
+    fprintf( fp, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+
+    bool ok = ( ferror( fp ) == 0 );
+    if ( fclose( fp ) != 0 ) {
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool TGTelemetry::WriteTileSummary( const std::string& file )
+{
+    struct TileSummary {
+        int64_t         wall_us[3];
+        int64_t         cpu_us;
+        long            peak_rss_kb;
+        unsigned int    polys;
+        unsigned int    nodes;
+        unsigned int    triangles;
+        std::string     slowest_step;
+        int64_t         slowest_us;
+    };
+
+    SGGuard<SGMutex> g( lock );
+
+    // records are added in completion order - the counters of the last
+    // step of a tile describe the final tile
+    std::map<long, TileSummary> tiles;
+    for (unsigned int i=0; i<records.size(); i++) {
+        Record const& r = records[i];
+
+        std::map<long, TileSummary>::iterator it = tiles.find( r.tile );
+        if ( it == tiles.end() ) {
+            TileSummary ts;
+            ts.wall_us[0] = ts.wall_us[1] = ts.wall_us[2] = 0;
+            ts.cpu_us      = 0;
+            ts.peak_rss_kb = 0;
+            ts.slowest_us  = -1;
+            it = tiles.insert( std::make_pair( r.tile, ts ) ).first;
+        }
+
+        TileSummary& ts = it->second;
+        if ( r.stage >= 1 && r.stage <= 3 ) {
+            ts.wall_us[r.stage-1] += r.wall_us;
+        }
+        ts.cpu_us += r.cpu_us;
+        if ( r.peak_rss_kb > ts.peak_rss_kb ) {
+            ts.peak_rss_kb = r.peak_rss_kb;
+        }
+        ts.polys     = r.polys;
+        ts.nodes     = r.nodes;
+        ts.triangles = r.triangles;
+        if ( r.wall_us > ts.slowest_us ) {
+            ts.slowest_us   = r.wall_us;
+            ts.slowest_step = r.step;
+        }
+    }
+
+    FILE* fp = fopen( file.c_str(), "w" );
+    if ( !fp ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << file << " for writing!" );
+        return false;
+    }
+
+    fprintf( fp, "tile,path,stage1_s,stage2_s,stage3_s,total_s,cpu_s,peak_rss_mb,polys,nodes,triangles,slowest_step,slowest_s\n" );
+
+    std::map<long, TileSummary>::const_iterator it;
+    for ( it = tiles.begin(); it != tiles.end(); it++ ) {
+        TileSummary const& ts = it->second;
+        SGBucket b( it->first );
+        int64_t total = ts.wall_us[0] + ts.wall_us[1] + ts.wall_us[2];
+
+        fprintf( fp, "%s,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%u,%u,%u,%s,%.3f\n",
+                 b.gen_index_str().c_str(), b.gen_base_path().c_str(),
+                 ts.wall_us[0] / 1e6, ts.wall_us[1] / 1e6, ts.wall_us[2] / 1e6, total / 1e6,
+                 ts.cpu_us / 1e6, ts.peak_rss_kb / 1024.0,
+                 ts.polys, ts.nodes, ts.triangles,
+                 ts.slowest_step.c_str(), ts.slowest_us / 1e6 );
+    }
+
+    bool ok = ( ferror( fp ) == 0 );
+    if ( fclose( fp ) != 0 ) {
+        ok = false;
+    }
+
+    return ok;
+}
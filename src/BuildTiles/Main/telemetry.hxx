@@ -0,0 +1,72 @@
+// telemetry.hxx -- per tile / step timing and memory counters for tg-construct
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+#ifndef _TG_TELEMETRY_HXX
+#define _TG_TELEMETRY_HXX
+
+#include <string>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/misc/stdint.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/timing/timestamp.hxx>
+
+// Collects a record for every step of every tile the construct threads
+// run.  At the end of the build, the records are written as a chrome
+// trace (load it in chrome://tracing or ui.perfetto.dev) and as a csv
+// with one line per tile.
+class TGTelemetry
+{
+public:
+    struct Record {
+        std::string     step;
+        long            tile;
+        unsigned int    stage;
+        unsigned int    thread;
+
+        int64_t         start_us;       // since the telemetry was created
+        int64_t         wall_us;
+        int64_t         cpu_us;         // of the calling thread only
+        long            peak_rss_kb;    // of the process, at the end of the step
+
+        // size of the tile data at the end of the step
+        unsigned int    polys;
+        unsigned int    nodes;
+        unsigned int    triangles;
+    };
+
+    TGTelemetry();
+
+    // microseconds since the telemetry was created
+    int64_t GetElapsedUSecs( void ) const;
+
+    void Add( const Record& r );
+
+    bool WriteTrace( const std::string& file );
+    bool WriteTileSummary( const std::string& file );
+
+    static int64_t GetThreadCpuUSecs( void );
+    static long    GetPeakRssKB( void );
+
+private:
+    SGTimeStamp         start;
+    std::vector<Record> records;
+    SGMutex             lock;
+};
+
+#endif // _TG_TELEMETRY_HXX
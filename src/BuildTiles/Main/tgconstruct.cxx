@@ -33,19 +33,25 @@
 const double TGConstruct::gSnap = 0.00000001;      // approx 1 mm
 
 // Constructor
-TGConstruct::TGConstruct( const TGAreaDefinitions& areas, unsigned int s, SGLockedQueue<SGBucket>& q, SGMutex* l) :
+TGConstruct::TGConstruct( const TGAreaDefinitions& areas, TGTileScheduler& s, SGMutex* l) :
         area_defs(areas),
-        workQueue(q),
-        stage(s),
+        scheduler(s),
+        stage_store(NULL),
+        bin_compression(-1),
+        telemetry(NULL),
+        telemetry_id(0),
+        step_name(NULL),
+        step_start_us(0),
+        step_cpu_us(0),
+        stage(0),
         ignoreLandmass(false),
         debug_all(false),
         ds_id((void*)-1),
         isOcean(false)
 {
-    total_tiles = q.size();
     num_areas = areas.size();
     
-    lock = l;
+    dir_lock = l;
 }
 
 
@@ -68,14 +74,62 @@ void TGConstruct::set_options( bool ignore_lm, double n ) {
     nudge          = n;
 }
 
-void TGConstruct::run()
+void TGConstruct::BeginStep( const char* name )
+{
+    if ( !telemetry ) {
+        return;
+    }
+
+    EndStep();
+
+    step_name     = name;
+    step_start_us = telemetry->GetElapsedUSecs();
+    step_cpu_us   = TGTelemetry::GetThreadCpuUSecs();
+}
+
+void TGConstruct::EndStep( void )
 {
-    unsigned int tiles_complete;
+    if ( !telemetry || !step_name ) {
+        return;
+    }
+
+    TGTelemetry::Record r;
+    r.step        = step_name;
+    r.tile        = bucket.gen_index();
+    r.stage       = stage;
+    r.thread      = telemetry_id;
+    r.start_us    = step_start_us;
+    r.wall_us     = telemetry->GetElapsedUSecs() - step_start_us;
+    r.cpu_us      = TGTelemetry::GetThreadCpuUSecs() - step_cpu_us;
+    r.peak_rss_kb = TGTelemetry::GetPeakRssKB();
+
+    // count whatever the tile has at this point - the input polys
+    // until they have been clipped
+    r.polys     = 0;
+    r.triangles = 0;
+    for (unsigned int area = 0; area < polys_clipped.size(); area++) {
+        r.polys += polys_clipped.area_size(area);
+        for (unsigned int p = 0; p < polys_clipped.area_size(area); p++) {
+            r.triangles += polys_clipped.get_poly(area, p).Triangles();
+        }
+    }
+    if ( !r.polys ) {
+        for (unsigned int area = 0; area < polys_in.size(); area++) {
+            r.polys += polys_in.area_size(area);
+        }
+    }
+    r.nodes = nodes.size();
+
+    telemetry->Add( r );
+    step_name = NULL;
+}
 
-    // as long as we have feometry to parse, do so
-    while ( !workQueue.empty() ) {
-        bucket = workQueue.pop();
-        tiles_complete = total_tiles - workQueue.size();
+void TGConstruct::run()
+{
+    // as long as we have geometry to parse, do so - the scheduler hands
+    // out each tile / stage once its neighbors are ready for it
+    while ( scheduler.GetJob( bucket, stage ) ) {
+        unsigned int jobs_complete = scheduler.GetCompletedJobs();
 
         // assume non ocean tile until proven otherwise
         isOcean = false;
@@ -84,7 +138,7 @@ void TGConstruct::run()
         polys_in.init( num_areas, area_defs.get_name_array() );        
         polys_clipped.init( num_areas, area_defs.get_name_array() );
 
-        SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Construct in " << bucket.gen_base_path() << " tile " << tiles_complete << " of " << total_tiles << " using thread " << current() );
+        SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Construct stage " << stage << " in " << bucket.gen_base_path() << " job " << jobs_complete+1 << " of " << scheduler.GetNumJobs() << " using thread " << current() );
 
         // Init debug shapes and area for this bucket
         get_debug();
@@ -95,6 +149,7 @@ void TGConstruct::run()
         }
 
         if ( stage > 1 ) {
+            BeginStep( "LoadIntermediateData" );
             LoadFromIntermediateFiles( stage-1 );
             LoadSharedEdgeData( stage-1 );
         }
@@ -103,11 +158,13 @@ void TGConstruct::run()
             case 1:
                 // STEP 1)
                 // Load grid of elevation data (Array), and add the nodes
+                BeginStep( "LoadElevationArray" );
                 LoadElevationArray( true );
 
                 // STEP 2)
                 // Clip 2D polygons against one another
                 SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Loading landclass polys" );
+                BeginStep( "LoadLandclassPolys" );
                 if ( LoadLandclassPolys() == 0 ) {
                     // don't build the tile if there is no 2d data ... it *must*
                     // be ocean and the sim can build the tile on the fly.
@@ -127,6 +184,7 @@ void TGConstruct::run()
                 // STEP 4)
                 // Clip the Landclass polygons
                 SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Clipping landclass polys" );
+                BeginStep( "ClipLandclassPolys" );
                 ClipLandclassPolys();
 
                 // Now make sure any newly added intersection nodes are added to the tgnodes
@@ -136,6 +194,7 @@ void TGConstruct::run()
                 // Clean the polys - after this, we shouldn't change their shape (other than slightly for
                 // fix T-Junctions - as This is the end of the first pass for multicore design
                 SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Cleaning landclass polys" );
+                BeginStep( "CleanClippedPolys" );
                 CleanClippedPolys();
                 
                 // Now make sure any newly added intersection nodes are added to the tgnodes
@@ -147,12 +206,14 @@ void TGConstruct::run()
                 if ( !IsOceanTile() ) {
                     // STEP 6)
                     // Need the array of elevation data for stage 2, but don't add the nodes - we already have them
+                    BeginStep( "LoadElevationArray" );
                     LoadElevationArray( false );
 
                     // STEP 7)
                     // Fix T-Junctions by finding nodes that lie close to polygon edges, and
                     // inserting them into the edge
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Fix T-Junctions" );
+                    BeginStep( "FixTJunctions" );
                     nodes.init_spacial_query();
                     FixTJunctions();
 
@@ -163,6 +224,7 @@ void TGConstruct::run()
                     // Generate triangles - we can't generate the node-face lookup table
                     // until all polys are tesselated, as extra nodes can still be generated
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Tesselate" );
+                    BeginStep( "TesselatePolys" );
                     TesselatePolys();
 
                     // Now make sure any newly added intersection nodes are added to the tgnodes
@@ -171,17 +233,20 @@ void TGConstruct::run()
                     // STEP 9)
                     // We have all the nodes we need (plus extra that were clipped away)
                     // mark the used and remove the unused
+                    BeginStep( "LookupUnusedNodes" );
                     LookupUnusedNodes();
                     
                     // STEP 10)
                     // Generate triangle vertex coordinates to node index lists
                     // NOTE: After this point, no new nodes can be added
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Lookup Nodes Per Vertex");
+                    BeginStep( "LookupNodesPerVertex" );
                     LookupNodesPerVertex();
 
                     // STEP 11)
                     // Interpolate elevations, and flatten stuff
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Calculate Elevation Per Node");
+                    BeginStep( "CalcElevations" );
                     CalcElevations();
 #if 0  // ROADS ON AIRPORT DEBUGGING
                     // debug : dump the nodes
@@ -193,6 +258,7 @@ void TGConstruct::run()
                     // STEP 11)
                     // Generate face-connected list - needed for saving the edge data
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Lookup Faces Per Node");
+                    BeginStep( "LookupFacesPerNode" );
                     LookupFacesPerNode();
                 }
                 break;
@@ -204,21 +270,25 @@ void TGConstruct::run()
                     // edge nodes, but saving the entire tile is i/o intensive - it's faster
                     // too just recompute the list
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Lookup Faces Per Node (again)");
+                    BeginStep( "LookupFacesPerNode" );
                     LookupFacesPerNode();
 
                     // STEP 13)
                     // Average out the elevation for nodes on tile boundaries
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Average Edge Node Elevations");
+                    BeginStep( "AverageEdgeElevations" );
                     AverageEdgeElevations();
 
                     // STEP 14)
                     // Calculate Face Normals
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Calculate Face Normals");
+                    BeginStep( "CalcFaceNormals" );
                     CalcFaceNormals();
 
                     // STEP 15)
                     // Calculate Point Normals
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Calculate Point Normals");
+                    BeginStep( "CalcPointNormals" );
                     CalcPointNormals();
 
 #if 0
@@ -234,21 +304,25 @@ void TGConstruct::run()
                     // STEP 17)
                     // Calculate Texture Coordinates
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Calculate Texture Coordinates");
+                    BeginStep( "CalcTextureCoordinates" );
                     CalcTextureCoordinates();
 
                     // STEP 18)
                     // Generate the mesh file for LOD
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Generate Mesh File");
+                    BeginStep( "WriteMeshFile" );
                     WriteMeshFile();
                     
                     // STEP 19)
                     // Generate the btg file
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Generate BTG File");
+                    BeginStep( "WriteBtgFile" );
                     WriteBtgFile();
 
                     // STEP 20)
                     // Write Custom objects to .stg file
                     SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Generate Custom Objects");
+                    BeginStep( "AddCustomObjects" );
                     AddCustomObjects();
                 }
                 break;
@@ -256,20 +330,40 @@ void TGConstruct::run()
 
         if ( ( stage < 3 ) && ( !IsOceanTile() ) ) {
             // Save data for next stage
+            BeginStep( "SaveIntermediateData" );
             if ( stage == 2 ) {
                 nodes.init_spacial_query(); // for stage 2 only...
             }
             SaveSharedEdgeData( stage );
             SaveToIntermediateFiles( stage );
         }
+        EndStep();
 
         // Clean up for next work queue item
-        array.unload();
+        array.reset();
         polys_in.clear();
         polys_clipped.clear();
         nodes.clear();
         neighbor_faces.clear();
+        neighbor_face_lookup.clear();
         debug_shapes.clear();
         debug_areas.clear();
+
+        scheduler.CompleteJob( bucket, stage );
+
+        // drop shared edges from the store once no neighbor needs them anymore
+        if ( stage_store ) {
+            if ( scheduler.IsStageConsumed( bucket, stage ) ) {
+                stage_store->ReleaseEdges( bucket, stage );
+            }
+            for (int dx=-1; dx<=1; dx++) {
+                for (int dy=-1; dy<=1; dy++) {
+                    SGBucket nb = bucket.sibling( dx, dy );
+                    if ( stage > 1 && scheduler.IsStageConsumed( nb, stage-1 ) ) {
+                        stage_store->ReleaseEdges( nb, stage-1 );
+                    }
+                }
+            }
+        }
     }
 }
\ No newline at end of file
@@ -32,14 +32,21 @@
 
 #include <simgear/threads/SGThread.hxx>
 #include <simgear/threads/SGQueue.hxx>
+#include <simgear/misc/sg_path.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <boost/unordered_map.hpp>
+
+#include <terragear/tg_array_cache.hxx>
 #include <terragear/tg_nodes.hxx>
 #include <terragear/tg_areas.hxx>
 
 #include <landcover/landcover.hxx>
 
 #include "priorities.hxx"
+#include "scheduler.hxx"
+#include "stagestore.hxx"
+#include "taskpool.hxx"
+#include "telemetry.hxx"
 
 #define FIND_SLIVERS    (0)
 
@@ -57,11 +64,18 @@ typedef std::vector < TGNeighborFaces > neighbor_face_list;
 typedef neighbor_face_list::iterator neighbor_face_list_iterator;
 typedef neighbor_face_list::const_iterator const_neighbor_face_list_iterator;
 
+// Index into the neighbor face list, keyed on the node's lon / lat
+// quantized to 1e-9 degrees.  Edge nodes are written out bit for bit, but
+// their elevations differ between tiles until they are averaged, so the
+// elevation is not part of the key.
+typedef std::pair<long long, long long> neighbor_face_key;
+typedef boost::unordered_map<neighbor_face_key, unsigned int> neighbor_face_index;
+
 class TGConstruct : public SGThread
 {
 public:
     // Constructor
-    TGConstruct( const TGAreaDefinitions& areas, unsigned int s, SGLockedQueue<SGBucket>& q, SGMutex* l );
+    TGConstruct( const TGAreaDefinitions& areas, TGTileScheduler& s, SGMutex* l );
 
     // Destructor
     ~TGConstruct();
@@ -87,6 +101,19 @@ public:
     void set_paths( const std::string work, const std::string share, const std::string output, const std::vector<std::string> load_dirs );
     void set_options( bool ignore_lm, double n );
 
+    // hand stage data off in memory instead of through the intermediate files
+    void set_stage_store( TGStageStore* s ) { stage_store = s; }
+
+    // write intermediate files in the binary format (zlib level, 0 = none)
+    // instead of gzip streams. -1 keeps the gzip format
+    void set_bin_intermediate( int compression ) { bin_compression = compression; }
+
+    // split clipping, tesselation and elevation of a tile over n threads
+    void set_tile_threads( unsigned int n ) { tile_pool.SetNumThreads( n ); }
+
+    // record timing and counters of every step
+    void set_telemetry( TGTelemetry* t, unsigned int id ) { telemetry = t; telemetry_id = id; }
+
     // TODO : REMOVE
     inline TGNodes* get_nodes() { return &nodes; }
 
@@ -102,6 +129,10 @@ public:
 private:
     virtual void run();
 
+    // Telemetry - a step runs until the next one begins
+    void BeginStep( const char* name );
+    void EndStep( void );
+
     // Ocean tile or not
     bool IsOceanTile()  { return isOcean; }
 
@@ -121,8 +152,11 @@ private:
     void LoadSharedEdgeData( int stage );
 
     void LoadNeighboorEdgeDataStage1( SGBucket& b, std::vector<SGGeod>& north, std::vector<SGGeod>& south, std::vector<SGGeod>& east, std::vector<SGGeod>& west );
+    void LoadNeighboorEdgeDataStage2( const SGBucket& b, unsigned int side );
     void ReadNeighborFaces( gzFile& fp );
     void WriteNeighborFaces( gzFile& fp, const SGGeod& pt ) const;
+    void GetNeighborFaces( const SGGeod& pt, TGEdgeNode& en ) const;
+    void MergeNeighborFaces( const tgedgenode_list& edge );
     TGNeighborFaces* AddNeighborFaces( const SGGeod& node );
     TGNeighborFaces* FindNeighborFaces( const SGGeod& node );
 
@@ -152,6 +186,13 @@ private:
     void WriteBtgFile( void );
     void AddCustomObjects( void );
 
+    // Every file is written under a temp name, and renamed into place
+    // once complete.  Tiles never share a file, so only the directory
+    // creation is serialized.
+    void CreateOutputDir( const SGPath& file );
+    std::string GetTempFile( const std::string& file ) const;
+    bool CommitFile( const std::string& tmp, const std::string& file ) const;
+
     // Misc
     void calc_normals( std::vector<SGGeod>& geod_nodes, std::vector<SGVec3d>& wgs84_nodes, tgPolygon& sp );
 
@@ -163,9 +204,26 @@ private:
 private:
     TGAreaDefinitions const& area_defs;
     
-    // construct stage to perform
-    SGLockedQueue<SGBucket>& workQueue;
-    unsigned int total_tiles;
+    // tile and stage work scheduler
+    TGTileScheduler& scheduler;
+
+    // optional in memory stage hand off
+    TGStageStore* stage_store;
+
+    // intermediate file format
+    int bin_compression;
+
+    // helper threads for the current tile
+    TGTaskPool tile_pool;
+
+    // step telemetry
+    TGTelemetry*    telemetry;
+    unsigned int    telemetry_id;
+    const char*     step_name;
+    int64_t         step_start_us;
+    int64_t         step_cpu_us;
+
+    // construct stage being performed on the current tile
     unsigned int stage;
 
     // path to land-cover file (if any)
@@ -209,8 +267,8 @@ private:
     // this bucket
     SGBucket bucket;
 
-    // Elevation data
-    tgArray array;
+    // Elevation data - shared with any other tile using the same array
+    tgArrayRef array;
 
     // land class polygons
     tgAreas polys_in;
@@ -226,9 +284,10 @@ private:
 
     // Neighbor Faces
     neighbor_face_list  neighbor_faces;
+    neighbor_face_index neighbor_face_lookup;
     
-    // file lock
-    SGMutex*    lock;
+    // directory creation lock
+    SGMutex*    dir_lock;
 };
 
 #endif // _CONSTRUCT_HXX
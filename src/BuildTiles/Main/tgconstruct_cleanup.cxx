@@ -40,12 +40,13 @@ void TGConstruct::FixTJunctions( void ) {
     // traverse each poly, and add intermediate nodes
     for ( unsigned int i = 0; i < area_defs.size(); ++i ) {
         for( unsigned int j = 0; j < polys_clipped.area_size(i); ++j ) {
-            tgPolygon current = polys_clipped.get_poly(i, j);
+            tgPolygon current;
+            polys_clipped.take_poly(i, j, current);
             bb = current.GetBoundingBox();
             nodes.get_nodes_inside( bb.getMin(), bb.getMax(), points );
 
             before  = current.TotalNodes();
-            current = tgPolygon::AddColinearNodes( current, points );
+            tgPolygon::AddColinearNodes( current, points ).swap( current );
             after   = current.TotalNodes();
 
             if (before != after) {
@@ -53,7 +54,7 @@ void TGConstruct::FixTJunctions( void ) {
             }
 
             /* Save it back */
-            polys_clipped.set_poly( i, j, current );
+            polys_clipped.put_poly( i, j, current );
         }
     }
 }
@@ -87,30 +88,31 @@ void TGConstruct::CleanClippedPolys() {
         for( unsigned int p = 0; p < polys_clipped.area_size(area); p++ ) {
             char layer[32];
 
-            tgPolygon poly = polys_clipped.get_poly(area, p);
+            tgPolygon poly;
+            polys_clipped.take_poly(area, p, poly);
 
             // step 1 : snap
-            poly = tgPolygon::Snap(poly, gSnap);
+            tgPolygon::Snap(poly, gSnap).swap( poly );
             if ( IsDebugShape( poly.GetId() ) ) {
                 sprintf(layer, "snapped_%d", poly.GetId() );
                 tgShapefile::FromPolygon( poly, true, false, ds_name, layer, "poly" );
             }
 
             // step 2 : remove_dups
-            poly = tgPolygon::RemoveDups( poly );
+            tgPolygon::RemoveDups( poly ).swap( poly );
             if ( IsDebugShape( poly.GetId() ) ) {
                 sprintf(layer, "rem_dups_%d", poly.GetId() );
                 tgShapefile::FromPolygon( poly, true, false, ds_name, layer, "poly" );
             }
 
             // step 3 : remove cycles
-            poly = tgPolygon::RemoveCycles( poly );
+            tgPolygon::RemoveCycles( poly ).swap( poly );
             if ( IsDebugShape( poly.GetId() ) ) {
                 sprintf(layer, "rem_cycles_%d", poly.GetId() );
                 tgShapefile::FromPolygon( poly, true, false, ds_name, layer, "poly" );
             }
 
-            polys_clipped.set_poly(area, p, poly);
+            polys_clipped.put_poly(area, p, poly);
         }
     }
 }
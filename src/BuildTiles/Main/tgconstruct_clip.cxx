@@ -34,6 +34,73 @@
 
 using std::string;
 
+// The land, water and island masks are independent unions
+class MaskUnionTask : public TGTask
+{
+public:
+    MaskUnionTask( const tgpolygon_list* l, tgPolygon* m ) : lists(l), masks(m) {}
+
+    virtual void Run( unsigned int idx ) {
+        masks[idx] = tgPolygon::Union( lists[idx] );
+    }
+
+private:
+    const tgpolygon_list*   lists;
+    tgPolygon*              masks;
+};
+
+// Clipping a poly to the land mask, and cutting the islands out of water,
+// only depends on the masks - just the accumulator has to go in order
+class MaskClipTask : public TGTask
+{
+public:
+    MaskClipTask( const tgPolygon& land, const tgPolygon& island ) :
+        land_mask(land), island_mask(island) {}
+
+    void AddPoly( const tgPolygon& poly, bool clip_land, bool clip_island ) {
+        Work w;
+        w.poly        = &poly;
+        w.clip_land   = clip_land;
+        w.clip_island = clip_island;
+        work.push_back( w );
+    }
+    unsigned int size( void ) const {
+        return work.size();
+    }
+    tgPolygon const& get_result( unsigned int idx ) const {
+        return results[idx];
+    }
+
+    void Prepare( void ) {
+        results.resize( work.size() );
+    }
+
+    virtual void Run( unsigned int idx ) {
+        tgPolygon tmp = *work[idx].poly;
+
+        if ( work[idx].clip_land ) {
+            tmp = tgPolygon::Intersect( tmp, land_mask );
+        }
+        if ( work[idx].clip_island ) {
+            tmp = tgPolygon::Diff( tmp, const_cast<tgPolygon&>(island_mask) );
+        }
+
+        results[idx] = tmp;
+    }
+
+private:
+    struct Work {
+        const tgPolygon*    poly;
+        bool                clip_land;
+        bool                clip_island;
+    };
+
+    tgPolygon const&        land_mask;
+    tgPolygon const&        island_mask;
+    std::vector<Work>       work;
+    tgpolygon_list          results;
+};
+
 bool TGConstruct::ClipLandclassPolys( void ) {
     tgPolygon clipped, tmp;
     tgPolygon remains;
@@ -89,9 +156,24 @@ bool TGConstruct::ClipLandclassPolys( void ) {
         }
     }
 
-    land_mask   = tgPolygon::Union( land_list );
-    water_mask  = tgPolygon::Union( water_list );
-    island_mask = tgPolygon::Union( island_list );
+    if ( tile_pool.GetNumThreads() > 1 ) {
+        tgpolygon_list mask_lists[3];
+        tgPolygon      masks[3];
+        MaskUnionTask  task( mask_lists, masks );
+
+        mask_lists[0].swap( land_list );
+        mask_lists[1].swap( water_list );
+        mask_lists[2].swap( island_list );
+        tile_pool.Run( task, 3 );
+
+        land_mask   = masks[0];
+        water_mask  = masks[1];
+        island_mask = masks[2];
+    } else {
+        land_mask   = tgPolygon::Union( land_list );
+        water_mask  = tgPolygon::Union( water_list );
+        island_mask = tgPolygon::Union( island_list );
+    }
 
     // Dump the masks
     if ( debug_all || debug_shapes.size() || debug_areas.size() ) {
@@ -100,6 +182,21 @@ bool TGConstruct::ClipLandclassPolys( void ) {
         tgShapefile::FromPolygon( island_mask, true, false, ds_name, "island_mask", "" );
     }
 
+    // the mask clipping of each poly is independent, so do all of it up front
+    MaskClipTask mask_clip( land_mask, island_mask );
+    unsigned int mask_clip_idx = 0;
+
+    if ( tile_pool.GetNumThreads() > 1 ) {
+        for ( unsigned int i = 0; i < area_defs.size(); i++ ) {
+            for( unsigned int j = 0; j < polys_in.area_size(i); ++j ) {
+                mask_clip.AddPoly( polys_in.get_poly(i, j), !ignoreLandmass && !area_defs.is_hole_area(i), area_defs.is_water_area(i) );
+            }
+        }
+
+        mask_clip.Prepare();
+        tile_pool.Run( mask_clip, mask_clip.size() );
+    }
+
     // process polygons in priority order
     for ( unsigned int i = 0; i < area_defs.size(); i++ ) {
         debug_area = IsDebugArea( i );
@@ -109,17 +206,21 @@ bool TGConstruct::ClipLandclassPolys( void ) {
 
             SG_LOG( SG_CLIPPER, SG_DEBUG, "Clipping " << area_defs.get_area_name( i ) << "(" << i << "):" << j+1 << " of " << polys_in.area_size(i) << " id " << polys_in.get_poly( i, j ).GetId() );
 
-            tmp = current;
+            if ( mask_clip.size() ) {
+                tmp = mask_clip.get_result( mask_clip_idx++ );
+            } else {
+                tmp = current;
 
-            // if not a hole, clip the area to the land_mask
-            if ( !ignoreLandmass && !area_defs.is_hole_area(i) ) {
-                tmp = tgPolygon::Intersect( tmp, land_mask );
-            }
+                // if not a hole, clip the area to the land_mask
+                if ( !ignoreLandmass && !area_defs.is_hole_area(i) ) {
+                    tmp = tgPolygon::Intersect( tmp, land_mask );
+                }
 
-            // if a water area, cut out potential islands
-            if ( area_defs.is_water_area(i) ) {
-                // clip against island mask
-                tmp = tgPolygon::Diff( tmp, island_mask );
+                // if a water area, cut out potential islands
+                if ( area_defs.is_water_area(i) ) {
+                    // clip against island mask
+                    tmp = tgPolygon::Diff( tmp, island_mask );
+                }
             }
 
             if ( debug_area || debug_shape ) {
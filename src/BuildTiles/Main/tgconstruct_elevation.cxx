@@ -33,34 +33,44 @@ using std::string;
 // Load elevation data from an Array file (a regular grid of elevation data)
 // and return list of fitted nodes.
 void TGConstruct::LoadElevationArray( bool add_nodes ) {
-    string base = bucket.gen_base_path();
-    int i;
+    string_list dirs;
 
-    for ( i = 0; i < (int)load_dirs.size(); ++i ) {
-        string array_path = work_base + "/" + load_dirs[i] + "/" + base + "/" + bucket.gen_index_str();
-
-        if ( array.open(array_path) ) {
-            break;
-        } else {
-            SG_LOG(SG_GENERAL, SG_DEBUG, "Failed to open Array file " << array_path);
-        }
+    for ( unsigned int i = 0; i < load_dirs.size(); ++i ) {
+        dirs.push_back( work_base + "/" + load_dirs[i] );
     }
 
-    array.parse( bucket );
-    array.remove_voids( );
+    // stage 1 and stage 2 of this tile, and every other thread, share the
+    // parsed array
+    array = tgArrayCache::instance().Get( dirs, bucket );
     if ( add_nodes ) {
-        std::vector<SGGeod> const& corner_list = array.get_corner_list();
+        std::vector<SGGeod> const& corner_list = array->get_corner_list();
         for (unsigned int i=0; i<corner_list.size(); i++) {
             nodes.unique_add( corner_list[i] );
         }
 
-        std::vector<SGGeod> const& fit_list = array.get_fitted_list();
+        std::vector<SGGeod> const& fit_list = array->get_fitted_list();
         for (unsigned int i=0; i<fit_list.size(); i++) {
             nodes.unique_add( fit_list[i] );
         }
     }
 }
 
+// Interpolating the node elevations from the array is independent per
+// node, so split the node list into chunks
+class NodeElevationTask : public TGTask
+{
+public:
+    NodeElevationTask( TGNodes& n, unsigned int c ) : nodes(n), chunk(c) {}
+
+    virtual void Run( unsigned int idx ) {
+        nodes.CalcElevations( TG_NODE_INTERPOLATED, idx * chunk, (idx+1) * chunk );
+    }
+
+private:
+    TGNodes&        nodes;
+    unsigned int    chunk;
+};
+
 // fix the elevations of the geodetic nodes
 // This should be done in the nodes class itself, except for the need for the triangle type
 // hopefully, this will get better when we have the area lookup via superpoly...
@@ -70,16 +80,26 @@ void TGConstruct::CalcElevations( void )
     double e1, e2, e3, min;
     int    n1, n2, n3;
 
-    nodes.SetArray( &array );
-    nodes.CalcElevations( TG_NODE_INTERPOLATED );
+    nodes.SetArray( array.get() );
+    if ( tile_pool.GetNumThreads() > 1 ) {
+        const unsigned int chunk = 4096;
+        NodeElevationTask task( nodes, chunk );
+
+        tile_pool.Run( task, ( nodes.size() + chunk - 1 ) / chunk );
+    } else {
+        nodes.CalcElevations( TG_NODE_INTERPOLATED );
+    }
     nodes.get_geod_nodes(raw_nodes);
 
+    // the flattening below stays on this thread - polys share nodes, and
+    // the result depends on the order the polys are visited
+
     // now flatten some stuff
     for (unsigned int area = 0; area < area_defs.size(); area++) {
         if ( area_defs.is_lake_area(area) ) {
             for (int p = 0; p < (int)polys_clipped.area_size(area); ++p ) {
                 SG_LOG( SG_CLIPPER, SG_DEBUG, "Flattening " << area_defs.get_area_name(area) << ":" << p+1 << " of " << polys_clipped.area_size(area) );
-                tgPolygon poly = polys_clipped.get_poly( area, p );
+                tgPolygon const& poly = polys_clipped.get_poly( area, p );
 
                 for (unsigned int tri=0; tri < poly.Triangles(); tri++) {
                     n1 = poly.GetTriIdx( tri, 0 );
@@ -103,7 +123,7 @@ void TGConstruct::CalcElevations( void )
         if ( area_defs.is_stream_area(area) ) {
             for (unsigned int p = 0; p < polys_clipped.area_size(area); ++p ) {
                 SG_LOG( SG_CLIPPER, SG_DEBUG, "Flattening " << area_defs.get_area_name(area) << ":" << p+1 << " of " << polys_clipped.area_size(area) );
-                tgPolygon poly = polys_clipped.get_poly( area, p );
+                tgPolygon const& poly = polys_clipped.get_poly( area, p );
 
                 for (unsigned int tri=0; tri < poly.Triangles(); tri++) {
                     n1 = poly.GetTriIdx( tri, 0 );
@@ -150,7 +170,7 @@ void TGConstruct::CalcElevations( void )
         if ( area_defs.is_road_area(area) ) {
             for (int p = 0; p < (int)polys_clipped.area_size(area); ++p ) {
                 SG_LOG( SG_CLIPPER, SG_DEBUG, "Flattening " << area_defs.get_area_name(area) << ":" << p+1 << " of " << polys_clipped.area_size(area) );
-                tgPolygon poly = polys_clipped.get_poly( area, p );
+                tgPolygon const& poly = polys_clipped.get_poly( area, p );
 
                 for (unsigned int tri=0; tri < poly.Triangles(); tri++) {
                     n1 = poly.GetTriIdx( tri, 0 );
@@ -197,7 +217,7 @@ void TGConstruct::CalcElevations( void )
         if ( area_defs.is_ocean_area(area) ) {
             for (int p = 0; p < (int)polys_clipped.area_size(area); ++p ) {
                 SG_LOG( SG_CLIPPER, SG_DEBUG, "Flattening " << area_defs.get_area_name(area) << ":" << p+1 << " of " << polys_clipped.area_size(area) );
-                tgPolygon poly = polys_clipped.get_poly( area, p );
+                tgPolygon const& poly = polys_clipped.get_poly( area, p );
 
                 for (unsigned int tri=0; tri < poly.Triangles(); tri++) {
                     n1 = poly.GetTriIdx( tri, 0 );
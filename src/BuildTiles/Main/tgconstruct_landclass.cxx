@@ -92,10 +92,10 @@ double TGConstruct::measure_roughness( tgContour &contour ) {
 
     for ( unsigned int i = 0; i < contour.GetSize(); i++ ) {
         double z;
-        z = array.altitude_from_grid( contour[i].getLongitudeDeg() * 3600.0,
+        z = array->altitude_from_grid( contour[i].getLongitudeDeg() * 3600.0,
                                       contour[i].getLatitudeDeg()  * 3600.0 );
         if ( z < -9000 ) {
-            z = array.closest_nonvoid_elev( contour[i].getLongitudeDeg() * 3600.0,
+            z = array->closest_nonvoid_elev( contour[i].getLongitudeDeg() * 3600.0,
                                             contour[i].getLatitudeDeg()  * 3600.0 );
         }
 
@@ -65,7 +65,7 @@ void TGConstruct::LookupNodesPerVertex( void )
                         poly.SetTriIdx( tri, vertex, idx );
                     } else {
                         SG_LOG(SG_GENERAL, SG_ALERT, "didn't find vertex! " << poly.GetTriNode( tri, vertex ) );
-                        exit(0);
+                        exit(1);
                     }
                 }
             }
@@ -76,6 +76,7 @@ void TGConstruct::LookupNodesPerVertex( void )
 void TGConstruct::LookupFacesPerNode( void )
 {
     // Add each face that includes a node to the node's face list
+    nodes.ClearFaces();
     for ( unsigned int area = 0; area < area_defs.size(); area++ ) {
         for( unsigned int p = 0; p < polys_clipped.area_size(area); p++ ) {
             tgPolygon const& poly = polys_clipped.get_poly(area, p );
@@ -88,4 +89,5 @@ void TGConstruct::LookupFacesPerNode( void )
             }
         }
     }
+    nodes.BuildFaceLists();
 }
@@ -119,7 +119,7 @@ void TGConstruct::CalcPointNormals( void )
 
     for ( unsigned int i = 0; i<nodes.size(); i++ ) {
         TGNode const& node = nodes.get_node( i );
-        TGFaceList const& faces  = node.GetFaces();
+        unsigned int node_faces = nodes.GetNumFaces( i );
         TGNeighborFaces const* neighbor_faces = NULL;
         double total_area = 0.0;
 
@@ -132,10 +132,11 @@ void TGConstruct::CalcPointNormals( void )
         }
 
         // for each triangle that shares this node
-        for ( unsigned int j = 0; j < faces.size(); ++j ) {
-            unsigned int at      = faces[j].area;
-            unsigned int poly    = faces[j].poly;
-            unsigned int tri     = faces[j].tri;
+        for ( unsigned int j = 0; j < node_faces; ++j ) {
+            TGFaceLookup const& face = nodes.GetFace( i, j );
+            unsigned int at      = face.area;
+            unsigned int poly    = face.poly;
+            unsigned int tri     = face.tri;
 
             normal     = polys_clipped.get_face_normal( at, poly, tri );
             face_area  = polys_clipped.get_face_area( at, poly, tri );
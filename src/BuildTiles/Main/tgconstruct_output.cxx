@@ -37,22 +37,55 @@
 
 using std::string;
 
+void TGConstruct::CreateOutputDir( const SGPath& file )
+{
+    // concurrent mkdirs of a shared parent can fail each other
+    dir_lock->lock();
+    SGPath dir( file );
+    dir.create_dir( 0755 );
+    dir_lock->unlock();
+}
+
+// each tile is built by one thread at a time, and owns its output files,
+// so a fixed suffix can't collide
+string TGConstruct::GetTempFile( const string& file ) const
+{
+    return file + ".tmp";
+}
+
+bool TGConstruct::CommitFile( const string& tmp, const string& file ) const
+{
+#ifdef _MSC_VER
+    // rename won't replace an existing file on windows
+    remove( file.c_str() );
+#endif
+
+    if ( rename( tmp.c_str(), file.c_str() ) != 0 ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: renaming " << tmp << " to " << file );
+        remove( tmp.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
 // collect custom objects and move to scenery area
 void TGConstruct::AddCustomObjects( void ) {
     // Create/open the output .stg file for writing
     SGPath dest_d(output_base.c_str());
     dest_d.append(bucket.gen_base_path().c_str());
-    string dest_dir = dest_d.str_native();
     SGPath dest_i(dest_d);
     dest_i.append(bucket.gen_index_str());
     dest_i.concat(".stg");
     string dest_ind = dest_i.str_native();
 
     FILE *fp;
-    
-    lock->lock();
-    if ( (fp = fopen( dest_ind.c_str(), "w" )) == NULL ) {
-        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << dest_ind << " for writing!" );
+
+    CreateOutputDir( dest_i );
+
+    string tmp_ind = GetTempFile( dest_ind );
+    if ( (fp = fopen( tmp_ind.c_str(), "w" )) == NULL ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << tmp_ind << " for writing!" );
         exit(-1);
     }
 
@@ -93,17 +126,25 @@ void TGConstruct::AddCustomObjects( void ) {
                         srcbase.append(name);
                         srcbase.concat(".gz");
                         string basecom = srcbase.str_native();
+
+                        // copy next to the object, and rename it into place
+                        SGPath destobj(dest_d);
+                        destobj.append(name);
+                        destobj.concat(".gz");
+                        string destcom = destobj.str_native();
+                        string tmpcom  = GetTempFile( destcom );
 #ifdef _MSC_VER
-                        string command = "copy " + basecom + " " + dest_dir;
+                        string command = "copy " + basecom + " " + tmpcom;
 #else
-                        string command = "cp " + basecom + " " + dest_dir;
+                        string command = "cp " + basecom + " " + tmpcom;
 #endif
                         SG_LOG( SG_GENERAL, SG_DEBUG, "running " << command );
                         
-                        if ( system( command.c_str() ) != -1 ) {
+                        if ( system( command.c_str() ) == 0 && CommitFile( tmpcom, destcom ) ) {
                             fprintf(fp, "OBJECT %s\n", name);
                         } else {
-                            SG_LOG( SG_GENERAL, SG_ALERT, "Could not issue command " << command ); 
+                            SG_LOG( SG_GENERAL, SG_ALERT, "Could not copy " << basecom << " to " << destcom );
+                            remove( tmpcom.c_str() );
                         }
                     } else {
                         fprintf(fp, "%s\n", line);
@@ -114,8 +155,8 @@ void TGConstruct::AddCustomObjects( void ) {
     }
 
     fclose(fp);
-    
-    lock->unlock();
+
+    CommitFile( tmp_ind, dest_ind );
 }
 
 void TGConstruct::WriteBtgFile( void )
@@ -155,7 +196,7 @@ void TGConstruct::WriteBtgFile( void )
             for (unsigned int p = 0; p < polys_clipped.area_size(area); p++ ) {
                 SG_LOG( SG_CLIPPER, SG_DEBUG, "Ouput nodes for " << area_defs.get_area_name(area) << ":" << p+1 << " of " << polys_clipped.area_size(area) );
                 
-                tgPolygon           poly      = polys_clipped.get_poly(area, p);
+                tgPolygon const&    poly      = polys_clipped.get_poly(area, p);
                 string              material  = poly.GetMaterial();
                 SGBinObjectTriangle sgboTri;
                 
@@ -190,21 +231,24 @@ void TGConstruct::WriteBtgFile( void )
     obj.set_texcoords( texcoords.get_list() );
     
     bool result;
-    
-    lock->lock();
-    result = obj.write_bin( base, binname, bucket );
-    lock->unlock();
-    
+
+    SGPath binfile( base );
+    binfile.append( bucket.gen_base_path() );
+    binfile.append( binname + ".gz" );
+    CreateOutputDir( binfile );
+
+    string tmp = GetTempFile( binfile.str() );
+    result = obj.write_bin_file( tmp ) && CommitFile( tmp, binfile.str() );
+
     if ( !result )
     {
         throw sg_exception("error writing file. :-(");
     }
     if (debug_all || debug_shapes.size())
     {
-        lock->lock();
+        // debug output - the directory already exists
         result = obj.write_ascii( base, txtname, bucket );
-        lock->unlock();
-        
+
         if ( !result )
         {
             throw sg_exception("error writing file. :-(");
@@ -34,6 +34,96 @@
 
 using std::string;
 
+static void GeodsToEdgeNodes( const std::vector<SGGeod>& geods, tgedgenode_list& edge )
+{
+    edge.resize( geods.size() );
+    for (unsigned int i=0; i<geods.size(); i++) {
+        edge[i].node = geods[i];
+    }
+}
+
+static void EdgeNodesToGeods( const tgedgenode_list& edge, std::vector<SGGeod>& geods )
+{
+    geods.resize( edge.size() );
+    for (unsigned int i=0; i<edge.size(); i++) {
+        geods[i] = edge[i].node;
+    }
+}
+
+// binary shared edge files hold a block of arrays per edge :
+// the nodes, the face count per node, then all face areas and normals
+static bool SaveEdgeNodesBin( const string& file, tgedgenode_list* const* sides, unsigned int num_sides, int compression )
+{
+    tgBinFileWriter wr;
+
+    for (unsigned int s=0; s<num_sides; s++) {
+        tgedgenode_list const&  edge = *sides[s];
+        std::vector<tgBinGeod>  bin_nodes( edge.size() );
+        std::vector<uint32_t>   bin_counts( edge.size() );
+        std::vector<double>     bin_areas;
+        std::vector<tgBinVec3f> bin_normals;
+
+        for (unsigned int i=0; i<edge.size(); i++) {
+            bin_nodes[i]  = tgBinGeod::fromGeod( edge[i].node );
+            bin_counts[i] = edge[i].face_areas.size();
+
+            for (unsigned int j=0; j<edge[i].face_areas.size(); j++) {
+                bin_areas.push_back( edge[i].face_areas[j] );
+                bin_normals.push_back( tgBinVec3f::fromVec3f( edge[i].face_normals[j] ) );
+            }
+        }
+
+        wr.WriteArray( bin_nodes );
+        wr.WriteArray( bin_counts );
+        wr.WriteArray( bin_areas );
+        wr.WriteArray( bin_normals );
+    }
+
+    return wr.Save( file, compression );
+}
+
+static bool LoadEdgeNodesBin( const string& file, tgedgenode_list* const* sides, unsigned int num_sides )
+{
+    tgBinFileReader rd;
+
+    if ( !rd.Open( file ) ) {
+        return false;
+    }
+
+    for (unsigned int s=0; s<num_sides; s++) {
+        tgedgenode_list&        edge = *sides[s];
+        std::vector<tgBinGeod>  bin_nodes;
+        std::vector<uint32_t>   bin_counts;
+        std::vector<double>     bin_areas;
+        std::vector<tgBinVec3f> bin_normals;
+
+        rd.ReadArray( bin_nodes );
+        rd.ReadArray( bin_counts );
+        rd.ReadArray( bin_areas );
+        rd.ReadArray( bin_normals );
+
+        if ( !rd.IsOk() || bin_counts.size() != bin_nodes.size() || bin_areas.size() != bin_normals.size() ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: bad shared edge file " << file );
+            return false;
+        }
+
+        unsigned int face = 0;
+        edge.resize( bin_nodes.size() );
+        for (unsigned int i=0; i<bin_nodes.size(); i++) {
+            edge[i].node = bin_nodes[i].toGeod();
+            edge[i].face_areas.clear();
+            edge[i].face_normals.clear();
+
+            for (unsigned int j=0; j<bin_counts[i] && face < bin_areas.size(); j++, face++) {
+                edge[i].face_areas.push_back( bin_areas[face] );
+                edge[i].face_normals.push_back( bin_normals[face].toVec3f() );
+            }
+        }
+    }
+
+    return true;
+}
+
 void TGConstruct::SaveSharedEdgeData( int stage )
 {
     switch( stage ) {
@@ -48,13 +138,35 @@ void TGConstruct::SaveSharedEdgeData( int stage )
             filepath = share_base + "/stage1/" + bucket.gen_base_path() + "/" + bucket.gen_index_str() + "_edges";
             SGPath file(filepath);
 
-            lock->lock();
-            
-            file.create_dir( 0755 );
+            if ( stage_store || bin_compression >= 0 ) {
+                TGTileEdges edges;
+                GeodsToEdgeNodes( north, edges.north );
+                GeodsToEdgeNodes( south, edges.south );
+                GeodsToEdgeNodes( east,  edges.east );
+                GeodsToEdgeNodes( west,  edges.west );
+
+                if ( stage_store && stage_store->PutEdges( bucket, 1, edges ) ) {
+                    break;
+                }
 
+                if ( bin_compression >= 0 ) {
+                    tgedgenode_list* sides[4] = { &edges.north, &edges.south, &edges.east, &edges.west };
+
+                    CreateOutputDir( file );
+                    string tmp = GetTempFile( filepath );
+                    if ( SaveEdgeNodesBin( tmp, sides, 4, bin_compression ) ) {
+                        CommitFile( tmp, filepath );
+                    }
+                    break;
+                }
+            }
+
+            CreateOutputDir( file );
+
+            string tmp = GetTempFile( filepath );
             gzFile fp;
-            if ( (fp = gzopen( filepath.c_str(), "wb9" )) == NULL ) {
-                SG_LOG( SG_GENERAL, SG_INFO, "ERROR: opening " << file.str() << " for writing!" );
+            if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                SG_LOG( SG_GENERAL, SG_INFO, "ERROR: opening " << tmp << " for writing!" );
                 return;
             }
 
@@ -89,8 +201,8 @@ void TGConstruct::SaveSharedEdgeData( int stage )
             }
 
             gzclose(fp);
-            
-            lock->unlock();
+
+            CommitFile( tmp, filepath );
         }
         break;
 
@@ -122,13 +234,43 @@ void TGConstruct::SaveSharedEdgeData( int stage )
             
             SGPath sgp( dir );
             sgp.append( "dummy" );
-            
-            lock->lock();
-            sgp.create_dir( 0755 );
+
+            if ( stage_store || bin_compression >= 0 ) {
+                TGTileEdges edges;
+                tgedgenode_list* sides[4]         = { &edges.north, &edges.south, &edges.east, &edges.west };
+                std::vector<SGGeod>* side_geods[4] = { &north, &south, &east, &west };
+                string* side_files[4]              = { &file_north, &file_south, &file_east, &file_west };
+
+                for (unsigned int s=0; s<4; s++) {
+                    sides[s]->resize( side_geods[s]->size() );
+                    for (unsigned int i=0; i<side_geods[s]->size(); i++) {
+                        GetNeighborFaces( (*side_geods[s])[i], (*sides[s])[i] );
+                    }
+                }
+
+                if ( stage_store && stage_store->PutEdges( bucket, 2, edges ) ) {
+                    break;
+                }
+
+                if ( bin_compression >= 0 ) {
+                    CreateOutputDir( sgp );
+                    for (unsigned int s=0; s<4; s++) {
+                        string tmp = GetTempFile( *side_files[s] );
+                        if ( SaveEdgeNodesBin( tmp, &sides[s], 1, bin_compression ) ) {
+                            CommitFile( tmp, *side_files[s] );
+                        }
+                    }
+                    break;
+                }
+            }
+
+            CreateOutputDir( sgp );
+            string tmp;
 
             // north edge
-            if ( (fp = gzopen( file_north.c_str(), "wb9" )) == NULL ) {
-                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_north.c_str() << " for writing!" );
+            tmp = GetTempFile( file_north );
+            if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                 return;
             }
             sgClearWriteError();
@@ -141,10 +283,12 @@ void TGConstruct::SaveSharedEdgeData( int stage )
                 WriteNeighborFaces( fp, north[i] );
             }
             gzclose(fp);
+            CommitFile( tmp, file_north );
 
             // south edge
-            if ( (fp = gzopen( file_south.c_str(), "wb9" )) == NULL ) {
-                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_south.c_str() << " for writing!" );
+            tmp = GetTempFile( file_south );
+            if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                 return;
             }
             sgClearWriteError();
@@ -156,10 +300,12 @@ void TGConstruct::SaveSharedEdgeData( int stage )
                 WriteNeighborFaces( fp, south[i] );
             }
             gzclose(fp);
+            CommitFile( tmp, file_south );
 
             // east edge
-            if ( (fp = gzopen( file_east.c_str(), "wb9" )) == NULL ) {
-                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_east.c_str() << " for writing!" );
+            tmp = GetTempFile( file_east );
+            if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                 return;
             }
             sgClearWriteError();
@@ -171,10 +317,12 @@ void TGConstruct::SaveSharedEdgeData( int stage )
                 WriteNeighborFaces( fp, east[i] );
             }
             gzclose(fp);
+            CommitFile( tmp, file_east );
 
             // west egde
-            if ( (fp = gzopen( file_west.c_str(), "wb9" )) == NULL ) {
-                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_west.c_str() << " for writing!" );
+            tmp = GetTempFile( file_west );
+            if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                 return;
             }
             sgClearWriteError();
@@ -186,8 +334,7 @@ void TGConstruct::SaveSharedEdgeData( int stage )
                 WriteNeighborFaces( fp, west[i] );
             }
             gzclose(fp);
-            
-            lock->unlock();
+            CommitFile( tmp, file_west );
         }
         break;
     }
@@ -235,75 +382,73 @@ void TGConstruct::LoadSharedEdgeData( int stage )
 
         case 2:
         {
-            string dir;
-            string file;
-            gzFile     fp;
-            SGBucket   b;
-
             // Read Northern tile and add its southern node faces
-            b    = bucket.sibling(0, 1);
-            dir  = share_base + "/stage2/" + b.gen_base_path();
-            file = dir + "/" + b.gen_index_str() + "_south_edge";
-            fp = gzopen( file.c_str(), "rb" );
-            if (fp) {
-                sgClearReadError();
-                ReadNeighborFaces( fp );
-                gzclose( fp );
-            }
+            LoadNeighboorEdgeDataStage2( bucket.sibling(0, 1), TGTileEdges::SOUTH );
 
             // Read Southern tile and add its northern node faces
-            b    = bucket.sibling(0, -1);
-            dir  = share_base + "/stage2/" + b.gen_base_path();
-            file = dir + "/" + b.gen_index_str() + "_north_edge";
-            fp = gzopen( file.c_str(), "rb" );
-            if (fp) {
-                sgClearReadError();
-                ReadNeighborFaces( fp );
-                gzclose( fp );
-            }
+            LoadNeighboorEdgeDataStage2( bucket.sibling(0, -1), TGTileEdges::NORTH );
 
             // Read Eastern tile and add its western node faces
-            b    = bucket.sibling(1, 0);
-            dir  = share_base + "/stage2/" + b.gen_base_path();
-            file = dir + "/" + b.gen_index_str() + "_west_edge";
-            fp = gzopen( file.c_str(), "rb" );
-            if (fp) {
-                sgClearReadError();
-                ReadNeighborFaces( fp );
-                gzclose( fp );
-            }
+            LoadNeighboorEdgeDataStage2( bucket.sibling(1, 0), TGTileEdges::WEST );
 
             // Read Western tile and add its eastern node faces
-            b    = bucket.sibling(-1, 0);
-            dir  = share_base + "/stage2/" + b.gen_base_path();
-            file = dir + "/" + b.gen_index_str() + "_east_edge";
-            fp = gzopen( file.c_str(), "rb" );
-            if (fp) {
-                sgClearReadError();
-                ReadNeighborFaces( fp );
-                gzclose( fp );
-            }
+            LoadNeighboorEdgeDataStage2( bucket.sibling(-1, 0), TGTileEdges::EAST );
         }
         break;
     }
 }
 
+void TGConstruct::LoadNeighboorEdgeDataStage2( const SGBucket& b, unsigned int side )
+{
+    static const char* side_names[4] = { "north", "south", "east", "west" };
+
+    if ( stage_store ) {
+        TGTileEdges edges;
+
+        if ( stage_store->GetEdges( b, 2, edges ) ) {
+            MergeNeighborFaces( edges.get_side( side ) );
+            return;
+        }
+    }
+
+    string dir  = share_base + "/stage2/" + b.gen_base_path();
+    string file = dir + "/" + b.gen_index_str() + "_" + side_names[side] + "_edge";
+
+    if ( tgBinFileReader::IsBinFile( file ) ) {
+        tgedgenode_list  edge;
+        tgedgenode_list* sides[1] = { &edge };
+
+        if ( LoadEdgeNodesBin( file, sides, 1 ) ) {
+            MergeNeighborFaces( edge );
+        }
+        return;
+    }
+
+    gzFile fp = gzopen( file.c_str(), "rb" );
+    if (fp) {
+        sgClearReadError();
+        ReadNeighborFaces( fp );
+        gzclose( fp );
+    }
+}
+
 // Neighbor faces
-void TGConstruct::WriteNeighborFaces( gzFile& fp, const SGGeod& pt ) const
+void TGConstruct::GetNeighborFaces( const SGGeod& pt, TGEdgeNode& en ) const
 {
     // find all neighboors of this point
-    int               n     = nodes.find( pt );
-    TGNode const&     node  = nodes.get_node( n );
-    TGFaceList const& faces = node.GetFaces();
+    int               n         = nodes.find( pt );
+    unsigned int      num_faces = nodes.GetNumFaces( n );
 
-    // write the number of neighboor faces
-    sgWriteInt( fp, faces.size() );
+    en.node = pt;
+    en.face_areas.clear();
+    en.face_normals.clear();
 
-    // write out each face normal and size
-    for (unsigned int j=0; j<faces.size(); j++) {
+    // calculate each face normal and size
+    for (unsigned int j=0; j<num_faces; j++) {
         // for each connected face, get the nodes
-        unsigned int tri      = faces[j].tri;
-        tgPolygon const& poly = polys_clipped.get_poly( faces[j].area, faces[j].poly );
+        TGFaceLookup const& face = nodes.GetFace( n, j );
+        unsigned int tri      = face.tri;
+        tgPolygon const& poly = polys_clipped.get_poly( face.area, face.poly );
 
         SGGeod const& p1 = nodes[ poly.GetTriIdx( tri, 0) ].GetPosition();
         SGGeod const& p2 = nodes[ poly.GetTriIdx( tri, 1) ].GetPosition();
@@ -316,23 +461,40 @@ void TGConstruct::WriteNeighborFaces( gzFile& fp, const SGGeod& pt ) const
         double  face_area   = tgTriangle::area( p1, p2, p3 );
         SGVec3f face_normal = calc_normal( face_area, wgs_p1, wgs_p2, wgs_p3 );
 
-        sgWriteDouble( fp, face_area );
-        sgWriteVec3( fp, face_normal );
+        en.face_areas.push_back( face_area );
+        en.face_normals.push_back( face_normal );
     }
 }
 
-TGNeighborFaces* TGConstruct::FindNeighborFaces( const SGGeod& node )
+void TGConstruct::WriteNeighborFaces( gzFile& fp, const SGGeod& pt ) const
 {
-    TGNeighborFaces* faces = NULL;
+    TGEdgeNode en;
+    GetNeighborFaces( pt, en );
 
-    for (unsigned int i=0; i<neighbor_faces.size(); i++) {
-        if ( node == neighbor_faces[i].node ) {
-            faces = &neighbor_faces[i];
-            break;
-        }
+    // write the number of neighboor faces
+    sgWriteInt( fp, en.face_areas.size() );
+
+    // write out each face normal and size
+    for (unsigned int j=0; j<en.face_areas.size(); j++) {
+        sgWriteDouble( fp, en.face_areas[j] );
+        sgWriteVec3( fp, en.face_normals[j] );
     }
+}
 
-    return faces;
+static neighbor_face_key NeighborFaceKey( const SGGeod& node )
+{
+    return neighbor_face_key( (long long)SGMisc<double>::round( node.getLongitudeDeg() * 1000000000.0 ),
+                              (long long)SGMisc<double>::round( node.getLatitudeDeg()  * 1000000000.0 ) );
+}
+
+TGNeighborFaces* TGConstruct::FindNeighborFaces( const SGGeod& node )
+{
+    neighbor_face_index::const_iterator it = neighbor_face_lookup.find( NeighborFaceKey( node ) );
+    if ( it == neighbor_face_lookup.end() ) {
+        return NULL;
+    }
+
+    return &neighbor_faces[it->second];
 }
 
 TGNeighborFaces* TGConstruct::AddNeighborFaces( const SGGeod& node )
@@ -340,6 +502,7 @@ TGNeighborFaces* TGConstruct::AddNeighborFaces( const SGGeod& node )
     TGNeighborFaces faces;
     faces.node = node;
 
+    neighbor_face_lookup[ NeighborFaceKey( node ) ] = neighbor_faces.size();
     neighbor_faces.push_back( faces );
 
     return &neighbor_faces[neighbor_faces.size()-1];
@@ -347,17 +510,40 @@ TGNeighborFaces* TGConstruct::AddNeighborFaces( const SGGeod& node )
 
 void TGConstruct::ReadNeighborFaces( gzFile& fp )
 {
+    tgedgenode_list edge;
     int count;
 
     // read the count
     sgReadInt( fp, &count );
+    edge.resize( count );
 
     for (int i=0; i<count; i++) {
-        TGNeighborFaces* pFaces;
-        SGGeod           node;
-        int              num_faces;
+        int num_faces;
+
+        sgReadGeod( fp, edge[i].node );
 
-        sgReadGeod( fp, node );
+        sgReadInt( fp, &num_faces );
+        for (int j=0; j<num_faces; j++)
+        {
+            double  area;
+            SGVec3f normal;
+
+            sgReadDouble( fp, &area );
+            edge[i].face_areas.push_back( area );
+
+            sgReadVec3( fp, normal );
+            edge[i].face_normals.push_back( normal );
+        }
+    }
+
+    MergeNeighborFaces( edge );
+}
+
+void TGConstruct::MergeNeighborFaces( const tgedgenode_list& edge )
+{
+    for (unsigned int i=0; i<edge.size(); i++) {
+        TGNeighborFaces* pFaces;
+        SGGeod const&    node = edge[i].node;
 
         // look to see if we already have this node
         // If we do, (it's a corner) add more faces to it.
@@ -377,18 +563,8 @@ void TGConstruct::ReadNeighborFaces( gzFile& fp )
         // remember all of the elevation data for the node, so we can average
         pFaces->elevations.push_back( node.getElevationM() );
 
-        sgReadInt( fp, &num_faces );
-        for (int j=0; j<num_faces; j++)
-        {
-            double  area;
-            SGVec3f normal;
-
-            sgReadDouble( fp, &area );
-            pFaces->face_areas.push_back( area );
-
-            sgReadVec3( fp, normal );
-            pFaces->face_normals.push_back( normal );
-        }
+        pFaces->face_areas.insert( pFaces->face_areas.end(), edge[i].face_areas.begin(), edge[i].face_areas.end() );
+        pFaces->face_normals.insert( pFaces->face_normals.end(), edge[i].face_normals.begin(), edge[i].face_normals.end() );
     }
 }
 
@@ -401,6 +577,40 @@ void TGConstruct::SaveToIntermediateFiles( int stage )
     string file_nodes;
     gzFile fp;
 
+    // hand off in memory, if there's room
+    if ( !IsOceanTile() && stage_store ) {
+        if ( stage_store->PutTile( bucket, stage, polys_clipped, nodes ) ) {
+            return;
+        }
+    }
+
+    // or write the binary intermediate format
+    if ( !IsOceanTile() && bin_compression >= 0 && ( stage == 1 || stage == 2 ) ) {
+        tgBinFileWriter polys_wr, nodes_wr;
+
+        dir  = share_base + ( stage == 1 ? "/stage1/" : "/stage2/" ) + bucket.gen_base_path();
+        SGPath sgp( dir );
+        sgp.append( "dummy" );
+        file_clipped = dir + "/" + bucket.gen_index_str() + "_clipped_polys";
+        file_nodes = dir + "/" + bucket.gen_index_str() + "_nodes";
+
+        polys_clipped.SaveToBinFile( polys_wr );
+        nodes.SaveToBinFile( nodes_wr );
+
+        CreateOutputDir( sgp );
+
+        string tmp = GetTempFile( file_clipped );
+        if ( polys_wr.Save( tmp, bin_compression ) ) {
+            CommitFile( tmp, file_clipped );
+        }
+        tmp = GetTempFile( file_nodes );
+        if ( nodes_wr.Save( tmp, bin_compression ) ) {
+            CommitFile( tmp, file_nodes );
+        }
+
+        return;
+    }
+
     switch( stage ) {
         case 1:     // Save the clipped polys and node list
         {
@@ -412,26 +622,27 @@ void TGConstruct::SaveToIntermediateFiles( int stage )
                 file_clipped = dir + "/" + bucket.gen_index_str() + "_clipped_polys";
                 file_nodes = dir + "/" + bucket.gen_index_str() + "_nodes";
                 
-                lock->lock();                
-                
-                sgp.create_dir( 0755 );
-                if ( (fp = gzopen( file_clipped.c_str(), "wb9" )) == NULL ) {
-                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_clipped.c_str() << " for writing!" );
+                CreateOutputDir( sgp );
+
+                string tmp = GetTempFile( file_clipped );
+                if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                     return;
                 }
                 sgClearWriteError();
                 polys_clipped.SaveToGzFile( fp );
                 gzclose( fp );
+                CommitFile( tmp, file_clipped );
 
-                if ( (fp = gzopen( file_nodes.c_str(), "wb9" )) == NULL ) {
-                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_nodes.c_str() << " for writing!" );
+                tmp = GetTempFile( file_nodes );
+                if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                     return;
                 }
                 sgClearWriteError();
                 nodes.SaveToGzFile( fp );
                 gzclose( fp );
-                
-                lock->unlock();
+                CommitFile( tmp, file_nodes );
             }
 
             break;
@@ -447,26 +658,27 @@ void TGConstruct::SaveToIntermediateFiles( int stage )
                 file_clipped = dir + "/" + bucket.gen_index_str() + "_clipped_polys";
                 file_nodes = dir + "/" + bucket.gen_index_str() + "_nodes";
                 
-                lock->lock();
-                sgp.create_dir( 0755 );
+                CreateOutputDir( sgp );
 
-                if ( (fp = gzopen( file_clipped.c_str(), "wb9" )) == NULL ) {
-                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_clipped.c_str() << " for writing!" );
+                string tmp = GetTempFile( file_clipped );
+                if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                     return;
                 }
                 sgClearWriteError();
                 polys_clipped.SaveToGzFile( fp );
                 gzclose( fp );
+                CommitFile( tmp, file_clipped );
 
-                if ( (fp = gzopen( file_nodes.c_str(), "wb9" )) == NULL ) {
-                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << file_nodes.c_str() << " for writing!" );
+                tmp = GetTempFile( file_nodes );
+                if ( (fp = gzopen( tmp.c_str(), "wb9" )) == NULL ) {
+                    SG_LOG( SG_GENERAL, SG_INFO,"ERROR: opening " << tmp << " for writing!" );
                     return;
                 }
                 sgClearWriteError();
                 nodes.SaveToGzFile( fp );
                 gzclose( fp );
-                
-                lock->unlock();
+                CommitFile( tmp, file_nodes );
             }
             break;
         }
@@ -481,8 +693,39 @@ void TGConstruct::LoadNeighboorEdgeDataStage1( SGBucket& b, std::vector<SGGeod>&
     SGGeod pt;
     int nCount;
 
+    if ( stage_store ) {
+        TGTileEdges edges;
+
+        if ( stage_store->GetEdges( b, 1, edges ) ) {
+            EdgeNodesToGeods( edges.north, north );
+            EdgeNodesToGeods( edges.south, south );
+            EdgeNodesToGeods( edges.east,  east );
+            EdgeNodesToGeods( edges.west,  west );
+            return;
+        }
+    }
+
     dir  = share_base + "/stage1/" + b.gen_base_path();
     file = dir + "/" + b.gen_index_str() + "_edges";
+
+    if ( tgBinFileReader::IsBinFile( file ) ) {
+        TGTileEdges edges;
+        tgedgenode_list* sides[4] = { &edges.north, &edges.south, &edges.east, &edges.west };
+
+        north.clear();
+        south.clear();
+        east.clear();
+        west.clear();
+
+        if ( LoadEdgeNodesBin( file, sides, 4 ) ) {
+            EdgeNodesToGeods( edges.north, north );
+            EdgeNodesToGeods( edges.south, south );
+            EdgeNodesToGeods( edges.east,  east );
+            EdgeNodesToGeods( edges.west,  west );
+        }
+        return;
+    }
+
     fp = gzopen( file.c_str(), "rb" );
 
     north.clear();
@@ -534,6 +777,38 @@ void TGConstruct::LoadFromIntermediateFiles( int stage )
     gzFile fp;
     bool   read_ok = false;
 
+    // handed off in memory?
+    if ( stage_store ) {
+        if ( stage_store->TakeTile( bucket, stage, polys_clipped, nodes ) ) {
+            return;
+        }
+    }
+
+    // binary intermediate format?
+    if ( stage == 1 || stage == 2 ) {
+        dir  = share_base + ( stage == 1 ? "/stage1/" : "/stage2/" ) + bucket.gen_base_path();
+        file = dir + "/" + bucket.gen_index_str() + "_clipped_polys";
+
+        if ( tgBinFileReader::IsBinFile( file ) ) {
+            tgBinFileReader rd;
+
+            if ( rd.Open( file ) ) {
+                polys_clipped.LoadFromBinFile( rd );
+
+                file = dir + "/" + bucket.gen_index_str() + "_nodes";
+                if ( rd.Open( file ) ) {
+                    nodes.LoadFromBinFile( rd );
+                    read_ok = rd.IsOk();
+                }
+            }
+
+            if ( !read_ok ) {
+                isOcean = true;
+            }
+            return;
+        }
+    }
+
     switch( stage ) {
         case 1:     // Load the clipped polys and node list
         {
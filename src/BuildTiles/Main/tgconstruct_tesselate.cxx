@@ -31,18 +31,91 @@
 
 #include "tgconstruct.hxx"
 
+// Each poly is tesselated on its own - the node list is only queried
+class TesselateTask : public TGTask
+{
+public:
+    TesselateTask( tgAreas& p, const TGNodes& n ) : polys(p), nodes(n) {}
+
+    void AddPoly( unsigned int area, unsigned int p ) {
+        work.push_back( std::make_pair( area, p ) );
+    }
+    unsigned int size( void ) const {
+        return work.size();
+    }
+
+    virtual void Run( unsigned int idx ) {
+        std::vector<SGGeod> poly_extra;
+        unsigned int area = work[idx].first;
+        unsigned int p    = work[idx].second;
+
+        tgPolygon poly;
+        polys.take_poly( area, p, poly );
+
+        tgPolygon::SplitLongEdges( poly, 100.0 ).swap( poly );
+
+        tgRectangle rect = poly.GetBoundingBox();
+        nodes.get_geod_inside( rect.getMin(), rect.getMax(), poly_extra );
+
+        poly.Tesselate( poly_extra );
+
+        polys.put_poly( area, p, poly );
+    }
+
+private:
+    tgAreas&        polys;
+    TGNodes const&  nodes;
+    std::vector< std::pair<unsigned int, unsigned int> > work;
+};
+
+// how many polys needed the exact triangulation
+static void LogTessPaths( tgAreas& polys, unsigned int num_areas )
+{
+    unsigned int num_fast = 0, num_exact = 0;
+
+    for (unsigned int area = 0; area < num_areas; area++) {
+        for (unsigned int p = 0; p < polys.area_size(area); p++ ) {
+            switch( polys.get_poly(area, p).GetTessPath() ) {
+                case TG_TESS_FAST:  num_fast++;  break;
+                case TG_TESS_EXACT: num_exact++; break;
+                default: break;
+            }
+        }
+    }
+
+    SG_LOG( SG_CLIPPER, SG_INFO, "Tesselated " << num_fast << " polys with inexact constructions, " << num_exact << " with exact constructions" );
+}
+
 void TGConstruct::TesselatePolys( void )
 {
     // tesselate the polygons and prepair them for final output
     std::vector<SGGeod> poly_extra;
     SGGeod min, max;
 
+    // the debug shapefiles can't be written from more than one thread
+    if ( tile_pool.GetNumThreads() > 1 && !debug_all && debug_shapes.empty() ) {
+        TesselateTask task( polys_clipped, nodes );
+
+        for (unsigned int area = 0; area < area_defs.size(); area++) {
+            for (unsigned int p = 0; p < polys_clipped.area_size(area); p++ ) {
+                task.AddPoly( area, p );
+            }
+        }
+
+        SG_LOG( SG_CLIPPER, SG_DEBUG, "Tesselating " << task.size() << " polys on " << tile_pool.GetNumThreads() << " threads" );
+        tile_pool.Run( task, task.size() );
+
+        LogTessPaths( polys_clipped, area_defs.size() );
+        return;
+    }
+
     for (unsigned int area = 0; area < area_defs.size(); area++) {
         for (unsigned int p = 0; p < polys_clipped.area_size(area); p++ ) {
-            tgPolygon poly = polys_clipped.get_poly(area, p );
+            tgPolygon poly;
+            polys_clipped.take_poly( area, p, poly );
 
             // test test test
-            poly = tgPolygon::SplitLongEdges( poly, 100.0 );
+            tgPolygon::SplitLongEdges( poly, 100.0 ).swap( poly );
 
             if ( IsDebugShape( poly.GetId() ) ) {
                 char layer[32];
@@ -62,7 +135,9 @@ void TGConstruct::TesselatePolys( void )
 
             poly.Tesselate( poly_extra );
 
-            polys_clipped.set_poly( area, p, poly );
+            polys_clipped.put_poly( area, p, poly );
         }
     }
+
+    LogTessPaths( polys_clipped, area_defs.size() );
 }
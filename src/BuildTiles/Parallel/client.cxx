@@ -19,10 +19,12 @@
 #else
 #  include <sys/time.h>		// FD_ISSET(), etc.
 #  include <sys/socket.h>
+#  include <sys/wait.h>
 #  include <netdb.h>
 #  include <netinet/in.h>
 #  include <unistd.h>
 #  include <utmp.h>
+#  include <signal.h>
 #  include <strings.h>		// bcopy() on Irix
 #endif
 #include <sys/types.h>
@@ -34,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>		// atoi()
 #include <string.h>		// bcopy(), sterror()
+#include <time.h>
 
 #include <simgear/compiler.h>
 
@@ -48,6 +51,8 @@
 #include <simgear/misc/sg_dir.hxx>
 #include <simgear/misc/strutils.hxx>
 
+#include "protocol.hxx"
+
 using std::cout;
 using std::cerr;
 using std::endl;
@@ -105,7 +110,7 @@ int system_free() {
 }
 
 
-int make_socket (char *host, unsigned short int port) {
+int make_socket (const char *host, unsigned short int port) {
     int sock;
     struct sockaddr_in name;
     struct hostent *hp;
@@ -122,6 +127,11 @@ int make_socket (char *host, unsigned short int port) {
 
     // get the hosts official name/info
     hp = gethostbyname(host);
+    if ( hp == NULL ) {
+	close(sock);
+	cout << "Cannot resolve server host " << host << endl;
+	return -1;
+    }
 
     // Connect this socket to the host and the port specified on the
     // command line
@@ -140,55 +150,83 @@ int make_socket (char *host, unsigned short int port) {
 }
 
 
-// connect to the server and get the next task
-long int get_next_task( const string& host, int port, long int last_tile ) {
-    long int tile;
-    int sock, len;
-    fd_set ready;
-    char message[MAXBUF];
+// send one request to the server, and wait for the reply.  With retry, keep
+// trying to connect (for as long as the master switch is on), otherwise
+// give up if the server can't be reached.
+bool send_request( const string& host, int port, const string& request,
+		   string& reply, bool retry ) {
+    int sock;
+
+    while ( (sock = make_socket( host.c_str(), port )) < 0 ) {
+	if ( !retry ) {
+	    return false;
+	}
 
-    // loop till we get a socket connection
-    while ( (sock = make_socket( (char *)host.c_str(), port )) < 0 ) {
 	// check if the master switch is on
 	check_master_switch();
 
 	sleep(1);
     }
 
-    // build a command string from the argv[]'s
-    sprintf(message, "%ld", last_tile);
-
-    // send command and arguments to remote server
-    if ( write(sock, message, sizeof(message)) < 0 ) {
-        perror("Cannot write to stream socket");
+    bool ok = tg_send_line( sock, request ) && tg_recv_line( sock, reply );
+    if ( !ok ) {
+	cout << "No reply from server to " << request << endl;
     }
+    close(sock);
 
-    // loop until remote program finishes
-    cout << "querying server for next task ..." << endl;
+    return ok;
+}
 
-    FD_ZERO(&ready);
-    FD_SET(sock, &ready);
 
-    // block until input from sock
-    select(sock+1, &ready, 0, 0, NULL);
-    cout << " received reply" << endl;
+// connect to the server and get the next task.  Returns -1 once there is
+// nothing left to build.
+long int get_next_task( const string& host, int port, const string& client_id ) {
+    string request = string(TG_MSG_NEXT) + " " + client_id;
+    string reply;
+    char   cmd[32];
+    long   value;
 
-    if ( FD_ISSET(sock, &ready) ) {
-	/* input coming from socket */
-	if ( (len = read(sock, message, MAXBUF)) > 0 ) {
-	    message[len] = '\0';
-	    tile = atoi(message);
-	    cout << "  tile to construct = " << tile << endl;
-	    close(sock);
-	    return tile;
-	} else {
-	    close(sock);
+    for ( ;; ) {
+	cout << "querying server for next task ..." << endl;
+	if ( !send_request( host, port, request, reply, true ) ) {
+	    sleep(1);
+	    continue;
+	}
+
+	if ( sscanf( reply.c_str(), "%31s %ld", cmd, &value ) < 1 ) {
+	    cout << "Bad reply from server: " << reply << endl;
+	    sleep(1);
+	} else if ( !strcmp( cmd, TG_MSG_TILE ) ) {
+	    cout << "  tile to construct = " << value << endl;
+	    return value;
+	} else if ( !strcmp( cmd, TG_MSG_WAIT ) ) {
+	    // everything left is next to a tile being built, or waiting to
+	    // be retried
+	    sleep( value > 0 ? value : 1 );
+	} else if ( !strcmp( cmd, TG_MSG_DONE ) ) {
+	    cout << "  all tiles are done" << endl;
 	    return -1;
+	} else {
+	    cout << "Bad reply from server: " << reply << endl;
+	    sleep(1);
 	}
+
+	// check if the master switch is on
+	check_master_switch();
     }
+}
 
-    close(sock);
-    return -1;
+
+// tell the server how the tile went
+void report_result( const string& host, int port, const string& client_id,
+		    long int tile, const char* status, long seconds, int code ) {
+    char request[TG_MSG_MAXLEN];
+    string reply;
+
+    snprintf( request, sizeof(request), "%s %ld %s %s %ld %d", TG_MSG_RESULT,
+	      tile, client_id.c_str(), status, seconds, code );
+
+    send_request( host, port, request, reply, true );
 }
 
 // check if the tile really has to be generated
@@ -242,7 +280,7 @@ static bool must_generate( const SGBucket& b ) {
              * least one polygon file.
              */
             string lext = c.complete_lower_extension();
-            if ((lext == "arr.gz") || (lext == "fit.gz")) {
+            if ((lext == "arr") || (lext == "arr.gz") || (lext == "fit.gz")) {
                 continue;
             }
             
@@ -258,63 +296,113 @@ static bool must_generate( const SGBucket& b ) {
 }
 
 
-// build the specified tile, return true if contruction completed
-// successfully
-bool construct_tile( const SGBucket& b,
-		     const string& result_file,
-		     const string &cover ) {
-
-    string command = "tg-construct ";
-    command = command + " --work-dir=" + work_base;
-    command = command + " --output-dir=" + output_base;
-    command = command + " --tile-id=" + b.gen_index_str();
+// build the specified tile, and return the tg-construct exit code.  While
+// it runs, keep the lease on the tile with heartbeats.  If the server has
+// given the tile to someone else, stop building it and set lost.
+int construct_tile( const SGBucket& b,
+		    const string& result_file,
+		    const string& cover,
+		    const string& host, int port,
+		    const string& client_id,
+		    bool& lost ) {
+    vector<string> args;
+    args.push_back( "tg-construct" );
+    args.push_back( "--work-dir=" + work_base );
+    args.push_back( "--output-dir=" + output_base );
+    args.push_back( "--tile-id=" + b.gen_index_str() );
     if ( cover.size() > 0 ) {
-        command = command + " --cover=" + cover;
+        args.push_back( "--cover=" + cover );
     }
     for (int i = 0; i < (int)load_dirs.size(); i++) {
-        command = command + " " + load_dirs[i];
+        args.push_back( load_dirs[i] );
     }
-    command = command + " > " + result_file + " 2>&1";
+
+    string command;
+    for (unsigned int i = 0; i < args.size(); i++) {
+        command = command + args[i] + " ";
+    }
+    command = command + "> " + result_file + " 2>&1";
     cout << command << endl;
-	
-    if ( system( command.c_str() ) != -1 ) {
-        FILE *fp = fopen( result_file.c_str(), "r" );
-        if ( fp == NULL) {
-            cout << "Missing results file " << result_file << endl;
-            return false;
-        } else {
-            char line[256];
-            while ( fgets( line, 256, fp ) != NULL ) {
-                string line_str = line;
-                line_str = line_str.substr(0, line_str.length() - 1);
-                // cout << line_str << endl;
-                if ( line_str == "[Finished successfully]" ) {
-                    cout << "Tile " << b.gen_index_str() << " finished successfully" << endl;
-                    fclose(fp);
-                    return true;
-                }
-                
+
+    int code = -1;
+    lost = false;
+
+#ifndef _MSC_VER
+    vector<char*> argv;
+    for (unsigned int i = 0; i < args.size(); i++) {
+        argv.push_back( (char*)args[i].c_str() );
+    }
+    argv.push_back( NULL );
+
+    pid_t child = fork();
+    if ( child < 0 ) {
+        perror("Cannot fork tg-construct");
+        return -1;
+    } else if ( child == 0 ) {
+        int fd = open( result_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if ( fd >= 0 ) {
+            dup2( fd, 1 );
+            dup2( fd, 2 );
+            close( fd );
+        }
+        execvp( argv[0], &argv[0] );
+        perror("Cannot run tg-construct");
+        _exit( 127 );
+    }
+
+    string heartbeat = string(TG_MSG_HEARTBEAT) + " " + b.gen_index_str() + " " + client_id;
+    time_t last_beat = time(NULL);
+    int status = 0;
+
+    for ( ;; ) {
+        pid_t done = waitpid( child, &status, WNOHANG );
+        if ( done == child ) {
+            break;
+        } else if ( done < 0 && errno != EINTR ) {
+            perror("waitpid");
+            return -1;
+        }
+
+        if ( !lost && time(NULL) - last_beat >= TG_HEARTBEAT_SECS ) {
+            string reply;
+
+            // if the server is unreachable, just keep going
+            last_beat = time(NULL);
+            if ( send_request( host, port, heartbeat, reply, false ) && reply == TG_MSG_LOST ) {
+                cout << "Lost the lease on tile " << b.gen_index_str() << " - stopping" << endl;
+                kill( child, SIGTERM );
+                lost = true;
             }
-            fclose(fp);            
         }
-    } else {
-        cout << "Could not issue command " << command << endl;
-        return false;        
+
+        sleep(1);
     }
-        
-    // Save the log file of the failed tile
-    cout << "Tile " << b.gen_index_str() << " failed" << endl;
-    string savelog=work_base+"/Status/failed-"+b.gen_index_str()+".log";
-    
-    command="mv "+result_file+" " +savelog;
-    cout << command << endl;
-    
-    if ( system(command.c_str()) == -1 ) {
-        cout << "Could not issue command " << command << endl;
-        return false;        
+
+    if ( WIFEXITED(status) ) {
+        code = WEXITSTATUS(status);
+    } else if ( WIFSIGNALED(status) ) {
+        code = 128 + WTERMSIG(status);
     }
-        
-    return false;
+#else
+    code = system( command.c_str() );
+#endif
+
+    if ( lost ) {
+        unlink( result_file.c_str() );
+    } else if ( code == 0 ) {
+        cout << "Tile " << b.gen_index_str() << " finished successfully" << endl;
+        unlink( result_file.c_str() );
+    } else {
+        // Save the log file of the failed tile
+        cout << "Tile " << b.gen_index_str() << " failed with exit code " << code << endl;
+        string savelog = work_base + "/Status/failed-" + b.gen_index_str() + ".log";
+
+        if ( rename( result_file.c_str(), savelog.c_str() ) != 0 ) {
+            cout << "Could not move " << result_file << " to " << savelog << endl;
+        }
+    }
+
+    return code;
 }
 
 
@@ -334,9 +422,8 @@ usage (const string name)
 }
 
 int main(int argc, char *argv[]) {
-    long int tile, last_tile;
+    long int tile;
     bool rude = false;
-    bool result;
 
     string cover;
     string host = "127.0.0.1";
@@ -398,24 +485,34 @@ int main(int argc, char *argv[]) {
     sprintf(tmp, "result.%s.%d.", hostname, pid);
     string result_file = tempnam( 0, tmp );
 
-    last_tile = 0;
+    // how the server knows us
+    sprintf(tmp, "%s.%d", hostname, pid);
+    string client_id = tmp;
 
     // check if the master switch is on
     check_master_switch();
 
-    while ( (tile = get_next_task( host, port, last_tile )) >= 0 ) {
+    while ( (tile = get_next_task( host, port, client_id )) >= 0 ) {
         SGBucket bucket(tile);
+        time_t start = time(NULL);
+        bool lost = false;
+        int code = 0;
+
 	if (!must_generate(bucket)) {
 	    cout << "No need to build tile " << tile << "\n";
-	    result=true;
-	} else {
-	    result=construct_tile( bucket, result_file, cover );
-	}
-	if ( result ) {
-	    last_tile = tile;
+	    report_result( host, port, client_id, tile, TG_RESULT_SKIPPED, 0, 0 );
 	} else {
-            cout << "Build of tile " << tile << " failed\n";
-	    last_tile = -tile;
+	    code = construct_tile( bucket, result_file, cover, host, port, client_id, lost );
+	    if ( code != 0 ) {
+		cout << "Build of tile " << tile << " failed\n";
+	    }
+
+	    // a lost tile belongs to someone else now - nothing to tell
+	    if ( !lost ) {
+		report_result( host, port, client_id, tile,
+			       code == 0 ? TG_RESULT_OK : TG_RESULT_FAILED,
+			       time(NULL) - start, code );
+	    }
 	}
 
 	// check if the master switch is on
@@ -0,0 +1,300 @@
+// jobqueue.cxx -- journaled tile job queue for the parallel construct server
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "jobqueue.hxx"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+// how long to tell a client to wait when everything left is blocked
+#define TG_JOB_MAX_WAIT     (30)
+
+TGJobQueue::TGJobQueue( int lease, int attempts, int backoff ) :
+        first_open(0),
+        lease_secs(lease),
+        max_attempts(attempts),
+        backoff_secs(backoff),
+        journal(NULL)
+{
+}
+
+TGJobQueue::~TGJobQueue()
+{
+    if ( journal ) {
+        fclose( journal );
+    }
+}
+
+void TGJobQueue::AddTile( long tile )
+{
+    if ( index.find( tile ) != index.end() ) {
+        return;
+    }
+
+    TGJob job;
+    job.tile          = tile;
+    job.state         = TG_JOB_PENDING;
+    job.attempts      = 0;
+    job.lease_expires = 0;
+    job.retry_after   = 0;
+
+    index[tile] = jobs.size();
+    jobs.push_back( job );
+}
+
+TGJob* TGJobQueue::Find( long tile )
+{
+    std::map<long, int>::const_iterator it = index.find( tile );
+    if ( it == index.end() ) {
+        return NULL;
+    }
+    return &jobs[it->second];
+}
+
+bool TGJobQueue::NeighborLeased( long tile ) const
+{
+    SGBucket b( tile );
+
+    for (int dx=-1; dx<=1; dx++) {
+        for (int dy=-1; dy<=1; dy++) {
+            if ( dx == 0 && dy == 0 ) {
+                continue;
+            }
+
+            long nb = b.sibling( dx, dy ).gen_index();
+            if ( nb != tile && leased.find( nb ) != leased.end() ) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void TGJobQueue::Journal( const TGJob& job, const char* event, time_t now )
+{
+    if ( journal ) {
+        fprintf( journal, "%ld %ld %s %d %s\n", (long)now, job.tile, event, job.attempts,
+                 job.client.empty() ? "-" : job.client.c_str() );
+        fflush( journal );
+    }
+}
+
+bool TGJobQueue::OpenJournal( const string& file, bool rerun_failed )
+{
+    FILE* fp = fopen( file.c_str(), "r" );
+    if ( fp ) {
+        char line[512];
+        char event[32];
+        char client[256];
+        long when, tile;
+        int  attempts;
+        int  num_events = 0;
+
+        while ( fgets( line, sizeof(line), fp ) ) {
+            // a torn last line from a crash just doesn't parse
+            if ( sscanf( line, "%ld %ld %31s %d %255s", &when, &tile, event, &attempts, client ) != 5 ) {
+                continue;
+            }
+
+            TGJob* job = Find( tile );
+            if ( !job ) {
+                continue;
+            }
+
+            if ( !strcmp( event, "done" ) ) {
+                job->state = TG_JOB_DONE;
+            } else if ( job->state != TG_JOB_DONE ) {
+                // whoever held a lease is gone, so leases are void
+                job->attempts = attempts;
+                if ( !strcmp( event, "fail" ) && attempts >= max_attempts ) {
+                    job->state = TG_JOB_FAILED;
+                } else {
+                    job->state = TG_JOB_PENDING;
+                }
+            }
+            num_events++;
+        }
+        fclose( fp );
+
+        cout << "Replayed " << num_events << " journal events from " << file << endl;
+    }
+
+    if ( rerun_failed ) {
+        for (unsigned int i=0; i<jobs.size(); i++) {
+            if ( jobs[i].state == TG_JOB_FAILED ) {
+                jobs[i].state    = TG_JOB_PENDING;
+                jobs[i].attempts = 0;
+            }
+        }
+    }
+
+    journal = fopen( file.c_str(), "a" );
+    if ( !journal ) {
+        cout << "ERROR: cannot open journal " << file << " for writing" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+long TGJobQueue::NextTile( const string& client, time_t now, int& wait_secs )
+{
+    while ( first_open < jobs.size() &&
+            ( jobs[first_open].state == TG_JOB_DONE || jobs[first_open].state == TG_JOB_FAILED ) ) {
+        first_open++;
+    }
+
+    if ( first_open == jobs.size() ) {
+        return TG_JOB_NONE;
+    }
+
+    // take the first tile that's pending, past its backoff, and has no
+    // neighbor being built
+    int wait = TG_JOB_MAX_WAIT;
+    for (unsigned int i=first_open; i<jobs.size(); i++) {
+        TGJob& job = jobs[i];
+
+        if ( job.state == TG_JOB_LEASED ) {
+            wait = std::min( wait, (int)(job.lease_expires - now) );
+            continue;
+        }
+        if ( job.state != TG_JOB_PENDING ) {
+            continue;
+        }
+        if ( job.retry_after > now ) {
+            wait = std::min( wait, (int)(job.retry_after - now) );
+            continue;
+        }
+        if ( NeighborLeased( job.tile ) ) {
+            continue;
+        }
+
+        job.state         = TG_JOB_LEASED;
+        job.client        = client;
+        job.lease_expires = now + lease_secs;
+        leased.insert( job.tile );
+        Journal( job, "lease", now );
+
+        return job.tile;
+    }
+
+    wait_secs = std::max( wait, 1 );
+    return TG_JOB_WAIT;
+}
+
+bool TGJobQueue::Heartbeat( long tile, const string& client, time_t now )
+{
+    TGJob* job = Find( tile );
+
+    if ( !job || job->state != TG_JOB_LEASED || job->client != client ) {
+        return false;
+    }
+
+    job->lease_expires = now + lease_secs;
+    return true;
+}
+
+void TGJobQueue::Fail( TGJob& job, time_t now )
+{
+    job.attempts++;
+    leased.erase( job.tile );
+
+    if ( job.attempts >= max_attempts ) {
+        job.state = TG_JOB_FAILED;
+        cout << "Tile " << job.tile << " failed " << job.attempts << " times - giving up" << endl;
+    } else {
+        // back off 1, 2, 4, ... times the base delay
+        job.state       = TG_JOB_PENDING;
+        job.retry_after = now + ( (time_t)backoff_secs << std::min( job.attempts - 1, 6 ) );
+        cout << "Tile " << job.tile << " failed, retry " << job.attempts << " in "
+             << job.retry_after - now << " seconds" << endl;
+    }
+
+    Journal( job, "fail", now );
+}
+
+bool TGJobQueue::Complete( long tile, const string& client, bool ok, time_t now )
+{
+    TGJob* job = Find( tile );
+
+    if ( !job || job->state == TG_JOB_DONE ) {
+        return true;
+    }
+
+    if ( job->state == TG_JOB_LEASED && job->client != client ) {
+        // someone else has it now - it stays leased until they report,
+        // so its neighbors stay protected while they build it
+        cout << "Ignoring result for tile " << tile << " from " << client
+             << ", it's now leased to " << job->client << endl;
+        return false;
+    }
+
+    job->client = client;
+    if ( ok ) {
+        // a good tile is a good tile, even if the lease ran out - as long
+        // as no one else is building it
+        job->state = TG_JOB_DONE;
+        leased.erase( tile );
+        Journal( *job, "done", now );
+    } else {
+        Fail( *job, now );
+    }
+
+    return true;
+}
+
+void TGJobQueue::ExpireLeases( time_t now )
+{
+    std::set<long>::iterator it = leased.begin();
+
+    while ( it != leased.end() ) {
+        TGJob* job = Find( *it );
+        ++it;
+
+        if ( job->lease_expires < now ) {
+            cout << "Lease on tile " << job->tile << " held by " << job->client
+                 << " expired" << endl;
+
+            leased.erase( job->tile );
+            job->state = TG_JOB_PENDING;
+            Journal( *job, "expire", now );
+        }
+    }
+}
+
+void TGJobQueue::PrintStats( void ) const
+{
+    unsigned int count[4] = { 0, 0, 0, 0 };
+
+    for (unsigned int i=0; i<jobs.size(); i++) {
+        count[ jobs[i].state ]++;
+    }
+
+    cout << "Tiles: " << jobs.size() << " total, " << count[TG_JOB_DONE] << " done, "
+         << count[TG_JOB_LEASED] << " building, " << count[TG_JOB_PENDING] << " pending, "
+         << count[TG_JOB_FAILED] << " failed" << endl;
+}
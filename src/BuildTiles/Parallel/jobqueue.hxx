@@ -0,0 +1,106 @@
+// jobqueue.hxx -- journaled tile job queue for the parallel construct server
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_JOBQUEUE_HXX
+#define _TG_JOBQUEUE_HXX
+
+#include <stdio.h>
+#include <time.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/bucket/newbucket.hxx>
+
+enum TGJobState {
+    TG_JOB_PENDING = 0,
+    TG_JOB_LEASED,
+    TG_JOB_DONE,
+    TG_JOB_FAILED           // out of retries
+};
+
+struct TGJob {
+    long            tile;
+    TGJobState      state;
+    int             attempts;       // failed builds so far
+    time_t          lease_expires;
+    time_t          retry_after;    // backoff after a failure
+    std::string     client;
+};
+
+// Every state change is appended to a journal as soon as it's made, and
+// before the client is answered, so a restarted server picks up where the
+// last one stopped.  Tiles that
+// were leased when it went down are simply handed out again.
+//
+// Tiles are handed out in the order they were added, but never while
+// one of the 8 neighbors is leased - two clients must not build adjacent
+// tiles at the same time, as they share edge data.
+class TGJobQueue
+{
+public:
+    TGJobQueue( int lease_secs, int max_attempts, int backoff_secs );
+    ~TGJobQueue();
+
+    // add a tile to the end of the queue - duplicates are ignored
+    void AddTile( long tile );
+
+    // Replay the journal (if it exists) onto the queue, and keep it open
+    // to record what happens from now on.  With rerun_failed, tiles that
+    // ran out of retries in an earlier run get a fresh set.
+    bool OpenJournal( const std::string& file, bool rerun_failed );
+
+    // returns a tile index, TG_JOB_WAIT (with the seconds to wait) when
+    // everything left is blocked, or TG_JOB_NONE once all tiles are done
+    enum { TG_JOB_NONE = -1, TG_JOB_WAIT = -2 };
+    long NextTile( const std::string& client, time_t now, int& wait_secs );
+
+    // false if the client no longer holds the lease
+    bool Heartbeat( long tile, const std::string& client, time_t now );
+
+    // false if the tile has been leased to another client meanwhile
+    bool Complete( long tile, const std::string& client, bool ok, time_t now );
+
+    // put tiles whose lease ran out back in the queue
+    void ExpireLeases( time_t now );
+
+    void PrintStats( void ) const;
+
+private:
+    TGJob* Find( long tile );
+    bool   NeighborLeased( long tile ) const;
+
+    void   Fail( TGJob& job, time_t now );
+    void   Journal( const TGJob& job, const char* event, time_t now );
+
+    std::vector<TGJob>  jobs;
+    std::map<long, int> index;
+    std::set<long>      leased;
+
+    // everything before this is done or failed for good
+    unsigned int        first_open;
+
+    int                 lease_secs;
+    int                 max_attempts;
+    int                 backoff_secs;
+
+    FILE*               journal;
+};
+
+#endif // _TG_JOBQUEUE_HXX
@@ -0,0 +1,108 @@
+// protocol.hxx -- messages between the parallel construct server and clients
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_PARALLEL_PROTOCOL_HXX
+#define _TG_PARALLEL_PROTOCOL_HXX
+
+// Every exchange is one request line from the client, and one reply line
+// from the server, on its own connection :
+//
+//   NEXT <client>                         -> TILE <index> | WAIT <seconds> | DONE
+//   HEARTBEAT <index> <client>            -> OK | LOST
+//   RESULT <index> <client> <status> <seconds> <exit code>
+//                                         -> OK | LOST
+//
+// status is one of ok, failed or skipped (up to date, nothing to build).
+// A client holds the lease on its tile for as long as it keeps sending
+// heartbeats.  A lease that isn't renewed in time is given to someone
+// else, and that client is told LOST on its next heartbeat - or in reply
+// to its RESULT, which is then ignored.
+
+#define TG_MSG_NEXT             "NEXT"
+#define TG_MSG_HEARTBEAT        "HEARTBEAT"
+#define TG_MSG_RESULT           "RESULT"
+
+#define TG_MSG_TILE             "TILE"
+#define TG_MSG_WAIT             "WAIT"
+#define TG_MSG_DONE             "DONE"
+#define TG_MSG_OK               "OK"
+#define TG_MSG_LOST             "LOST"
+
+#define TG_RESULT_OK            "ok"
+#define TG_RESULT_FAILED        "failed"
+#define TG_RESULT_SKIPPED       "skipped"
+
+#define TG_HEARTBEAT_SECS       (60)
+#define TG_LEASE_SECS           (5 * TG_HEARTBEAT_SECS)
+
+#define TG_MSG_MAXLEN           (512)
+
+#include <string.h>
+#include <string>
+
+#ifdef _MSC_VER
+#  include <winsock2.h>
+#else
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#endif
+
+// send one message line
+inline bool tg_send_line( int sock, const std::string& msg )
+{
+    std::string line = msg + "\n";
+    const char* p    = line.c_str();
+    int         left = line.size();
+
+    while ( left > 0 ) {
+        int len = send( sock, p, left, 0 );
+        if ( len <= 0 ) {
+            return false;
+        }
+        p    += len;
+        left -= len;
+    }
+
+    return true;
+}
+
+// read one message line, without the newline
+inline bool tg_recv_line( int sock, std::string& msg )
+{
+    char buf[TG_MSG_MAXLEN];
+    int  have = 0;
+
+    msg.clear();
+    while ( have < TG_MSG_MAXLEN - 1 ) {
+        int len = recv( sock, buf + have, TG_MSG_MAXLEN - 1 - have, 0 );
+        if ( len <= 0 ) {
+            break;
+        }
+        have += len;
+
+        buf[have] = '\0';
+        char* nl = strchr( buf, '\n' );
+        if ( nl ) {
+            *nl = '\0';
+            msg = buf;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif // _TG_PARALLEL_PROTOCOL_HXX
@@ -21,7 +21,6 @@
 #  include <unistd.h>
 #  include <sys/socket.h>		// bind
 #  include <netinet/in.h>
-#  include <sys/wait.h>
 #endif
 #include <sys/stat.h>		// for stat()
 #include <time.h>               // for time();
@@ -32,35 +31,17 @@
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/misc/sg_path.hxx>
 
+#include "jobqueue.hxx"
+#include "protocol.hxx"
+
 using std:: cout ;
 using std:: cerr ;
 using std:: endl ;
 using std:: string ;
 
-#if defined (__sun) || defined (__CYGWIN__) || defined(sgi)
-#  define WAIT_ANY (pid_t)-1
-#endif
-
-#define MAXBUF 16384
-
-static double start_lon, start_lat;
-static double lat = 0.0;
-static double lon = 0.0;
-static double dy = 0.0;
-static int pass = 0;
 static double area_width = 10.0; // width of generated area in degrees
 static double area_height = 10.0; // height of generated area in degrees
 
-#ifdef _MSC_VER
-
-#define numWorkerThreads 10
-
-HANDLE	gWorkerThreads[numWorkerThreads];
-HANDLE	gIoPort;
-DWORD WINAPI ThreadProc(void *);
-
-#endif
-
 
 int make_socket (unsigned short int* port) {
     int sock;
@@ -74,10 +55,13 @@ int make_socket (unsigned short int* port) {
 	exit (EXIT_FAILURE);
     }
 
-    // Give the socket a name.
+    // a restarted server wants its old port back right away
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+
+    // Give the socket a name.  Port 0 lets the system pick one.
     name.sin_family = AF_INET;
-    name.sin_addr.s_addr = INADDR_ANY;
-    name.sin_port = 0 /* htons (port) */;
+    name.sin_port = htons (*port);
     name.sin_addr.s_addr = htonl (INADDR_ANY);
     if (bind (sock, (struct sockaddr *) &name, sizeof (name)) < 0) {
 	perror ("bind");
@@ -130,172 +114,46 @@ static bool has_data( const string& path, const SGBucket& b ) {
 #endif
 
 
-// initialize the tile counting system
-void init_tile_count( const string& chunk ) {
-    // pre-pass
-    pass = 0;
-
-    // initial bogus value
-    lat = 100;
-
+// Queue all the tiles of a chunk.  The order is the old checkerboard
+// sweep - every other tile of every other row, in four passes - so the
+// tiles handed out early are rarely blocked by a neighbor being built.
+void add_chunk_tiles( TGJobQueue& queue, const string& chunk ) {
     // determine tile height
     SGBucket tmp1;
-    dy = tmp1.get_height();
+    double dy = tmp1.get_height();
 
     string lons = chunk.substr(0, 4);
     string lats = chunk.substr(4, 3);
     cout << "lons = " << lons << " lats = " << lats << endl;
 
     string horz = lons.substr(0, 1);
-    start_lon = atof( lons.substr(1,3).c_str() );
+    double start_lon = atof( lons.substr(1,3).c_str() );
     if ( horz == "w" ) { start_lon *= -1; }
 
     string vert = lats.substr(0, 1);
-    start_lat = atof( lats.substr(1,2).c_str() );
+    double start_lat = atof( lats.substr(1,2).c_str() );
     if ( vert == "s" ) { start_lat *= -1; }
 
     cout << "start_lon = " << start_lon << "  start_lat = " << start_lat
 	 << endl;
-}
-
-
-// return the next tile
-long int get_next_tile() {
-    SGBucket b;
-    static double shift_over = 0.0;
-    static double shift_up = 0.0;
-    static bool first_time = true;
-    static time_t start_seconds, seconds;
-    static int counter;
-    static int global_counter;
-
-    // first time this routine is called, init counters
-    if ( first_time ) {
-	first_time = false;
-	start_seconds = seconds = time(NULL);
-	counter = global_counter = 0;
-    }
-
-    // cout << "lon = " << lon << " lat = " << lat << endl;
-    // cout << "start_lat = " << start_lat << endl;
 
-    if ( lon > start_lon + area_width ) {
-	// increment to next row
-	// skip every other row (to avoid two clients working on
-	// adjacent tiles)
-	lat += 2.0 * dy;
+    for ( int pass = 0; pass < 4; ++pass ) {
+	double shift_over = pass % 2;
+	double shift_up   = pass / 2;
 
-	SGBucket tmp( SGGeod::fromDeg(0.0, lat) );
-	double dx = tmp.get_width();
-	lon = start_lon + (shift_over*dx) + (dx*0.5);
-    }
+	for ( double lat = start_lat + (shift_up*dy) + (dy*0.5);
+	      lat <= start_lat + area_height;
+	      lat += 2.0 * dy ) {
+	    SGBucket tmp( SGGeod::fromDeg(0.0, lat) );
+	    double dx = tmp.get_width();
 
-    if ( lat > start_lat + area_height ) {
-	++pass;
-	if ( pass == 1 ) {
-	    shift_over = 0.0;
-	    shift_up = 0.0;
-	} else if ( pass == 2 ) {
-	    shift_over = 1.0;
-	    shift_up = 0.0;
-	} else if ( pass == 3 ) {
-	    shift_over = 0.0;
-	    shift_up = 1.0;
-	} else if ( pass == 4 ) {
-	    shift_over = 1.0;
-	    shift_up = 1.0;
-	} else {
-	    return -1;
+	    for ( double lon = start_lon + (shift_over*dx) + (dx*0.5);
+		  lon <= start_lon + area_width;
+		  lon += 2.0 * dx ) {
+		queue.AddTile( SGBucket( SGGeod::fromDeg(lon, lat) ).gen_index() );
+	    }
 	}
-
-	// reset lat
-	// lat = -89.0 + (shift_up*dy) - (dy*0.5);
-	// lat = 27.0 + (0*dy) + (dy*0.5);
-	lat = start_lat + (shift_up*dy) + (dy*0.5);
-
-	// reset lon
-	SGBucket tmp( SGGeod::fromDeg(0.0, lat) );
-	double dx = tmp.get_width();
-	// lon = -82 + (shift_over*dx) + (dx*0.5);
-	lon = start_lon + (shift_over*dx) + (dx*0.5);
-
-	cout << "starting pass = " << pass
-	     << " with lat = " << lat << " lon = " << lon << endl;
     }
-
-    // if ( ! start_lon ) {
-    // lon = -180 + dx * 0.5;
-    // } else {
-    //    start_lon = false;
-    // }
-
-    b = SGBucket( SGGeod::fromDeg(lon, lat) );
-
-    // increment to next tile
-    SGBucket tmp( SGGeod::fromDeg(0.0, lat) );
-    double dx = tmp.get_width();
-
-    // skip every other column (to avoid two clients working on
-    // adjacent tiles)
-    lon += 2.0 * dx;
-
-    ++global_counter;
-    ++counter;
-
-    time_t tmp_time = time(NULL);
-    if ( tmp_time != seconds ) {
-	seconds = tmp_time;
-	cout << "Current tile per second rate = " << counter << endl;
-	cout << "Overall tile per second rate = "
-	     << (double)global_counter / (double)(seconds - start_seconds)
-	     << endl;
-	cout << "Overall tile per hour rate = "
-	     <<  (double)global_counter * 3600.0 /
-	           (double)(seconds - start_seconds)
-	     << endl;
-	counter = 0;
-    }
-
-    return b.gen_index();
-}
-
-
-// log a pending tile (has been given out as a taks for some client)
-void log_pending_tile( const string& path, long int tile ) {
-    SGBucket b(tile);
-
-    string pending_file = path + "/" + b.gen_index_str() + ".pending";
-
-    string command = "touch " + pending_file;
-    if ( system( command.c_str() ) == -1 ) {
-        cout << "Could not issue command " << command << endl;
-    }    
-}
-
-
-// a tile is finished (removed the .pending file)
-void log_finished_tile( const string& path, long int tile ) {
-    SGBucket b(tile);
-
-    string finished_file = path + "/" + b.gen_index_str() + ".pending";
-    // cout << "unlinking " << finished_file << endl;
-    unlink( finished_file.c_str() );
-}
-
-
-// make note of a failed tile
-void log_failed_tile( const string& path, long int tile ) {
-    SGBucket b(tile);
-
-    string failed_file = path + "/" + b.gen_index_str() + ".failed";
-
-    string command = "touch " + failed_file;
-    
-    if ( system( command.c_str() ) == -1 ) {
-        cout << "Could not issue command " << command << endl;
-    }
-
-    cout << "logged bad tile = " << tile << endl;
 }
 
 
@@ -303,6 +161,7 @@ void log_failed_tile( const string& path, long int tile ) {
 void usage( const string name ) {
     cout << "Usage: " << name
 	 << "[--width=<width> --height=<height>] "
+	 << "[--port=<number>] [--retries=<count>] [--backoff=<seconds>] [--rerun-failed] "
 	 << " <work_base> <output_base> chunk1 chunk2 ..."
 	 << endl;
     cout << "\twhere chunk represents the south west corner of the area"
@@ -312,97 +171,85 @@ void usage( const string name ) {
     cout << "\tw020n10 e150s70, and the width and height are supplied"
 	 << endl;
     cout << "\tin degrees (default: 10x10)." << endl;
+    cout << "\tA failed tile is retried up to <count> times (default: 3), waiting"
+	 << endl;
+    cout << "\t<seconds> (default: 60) before the first retry, and twice as long"
+	 << endl;
+    cout << "\tfor each one after that." << endl;
     exit(-1);
 }
 
-void alloc_new_tile( int msgsock, long int next_tile, const string &status_dir ) {
-    // cout << "new process started to handle new connection for "
-    //      << next_tile << endl;
-
-    // Read client's message (which is the status of the
-    // last scenery creation task.)
-    char buf[MAXBUF];
-    int length;
-    if ( (length = recv(msgsock, buf, MAXBUF, 0)) < 0) {
-        perror("Cannot read command");
-        exit(-1);
-    }
-    buf[length] = '\0';
-    long int returned_tile = atoi(buf);
-    cout << "client returned = " << returned_tile << endl;
-
-    // record status
-    if ( returned_tile < 0 ) {
-	// failure
-	log_failed_tile( status_dir, -returned_tile );
-	log_finished_tile( status_dir, -returned_tile );
-    } else {
-	// success
-	log_finished_tile( status_dir, returned_tile );
-    }
 
-    // reply to the client
-    char message[MAXBUF];
-    sprintf(message, "%ld", next_tile);
-    length = strlen(message);
-    if ( send(msgsock, message, length, 0) < 0 ) {
-	perror("Cannot write to stream socket");
+// answer one client request
+void handle_request( int msgsock, TGJobQueue& queue ) {
+    string request;
+    char   cmd[32];
+    char   client[256];
+    char   status[32];
+    long   tile;
+    int    seconds, code;
+    char   reply[TG_MSG_MAXLEN];
+    time_t now = time(NULL);
+
+    if ( !tg_recv_line( msgsock, request ) ) {
+	cout << "Incomplete request from client" << endl;
+	return;
     }
-#ifdef _MSC_VER
-    closesocket(msgsock);
-#else
-    close(msgsock);
-#endif
-    // cout << "process for " << next_tile << " ended" << endl;
-}
 
-#ifdef _MSC_VER
-
-struct Parameters {
-    int msgsock;
-    long next_tile;
-    string status_dir;
-};
-
-DWORD WINAPI
-ThreadProc(void* p)
-{
-    DWORD pN1;
-    ULONG_PTR pN2;
-    OVERLAPPED*	pOverLapped;
-
-    while( GetQueuedCompletionStatus(gIoPort, &pN1, &pN2, &pOverLapped, INFINITE)) {
-	if (pOverLapped == (OVERLAPPED*)0xFFFFFFFF)
-		break;
+    if ( sscanf( request.c_str(), "%31s", cmd ) != 1 ) {
+	cmd[0] = '\0';
+    }
 
-	Parameters *p = (Parameters*)pN1;
+    if ( !strcmp( cmd, TG_MSG_NEXT ) &&
+	 sscanf( request.c_str(), "%*s %255s", client ) == 1 ) {
+	int wait_secs = 0;
+	tile = queue.NextTile( client, now, wait_secs );
 
-	if ( p ) {
-	    alloc_new_tile( p->msgsock, p->next_tile, p->status_dir );
-	    delete p;
+	if ( tile == TGJobQueue::TG_JOB_NONE ) {
+	    sprintf( reply, "%s", TG_MSG_DONE );
+	} else if ( tile == TGJobQueue::TG_JOB_WAIT ) {
+	    sprintf( reply, "%s %d", TG_MSG_WAIT, wait_secs );
+	} else {
+	    cout << "Bucket = " << SGBucket(tile) << " to " << client << endl;
+	    sprintf( reply, "%s %ld", TG_MSG_TILE, tile );
 	}
+    } else if ( !strcmp( cmd, TG_MSG_HEARTBEAT ) &&
+		sscanf( request.c_str(), "%*s %ld %255s", &tile, client ) == 2 ) {
+	if ( queue.Heartbeat( tile, client, now ) ) {
+	    sprintf( reply, "%s", TG_MSG_OK );
+	} else {
+	    sprintf( reply, "%s", TG_MSG_LOST );
+	}
+    } else if ( !strcmp( cmd, TG_MSG_RESULT ) &&
+		sscanf( request.c_str(), "%*s %ld %255s %31s %d %d", &tile, client, status, &seconds, &code ) == 5 ) {
+	bool ok = strcmp( status, TG_RESULT_FAILED ) != 0;
+
+	cout << "Tile " << tile << " from " << client << ": " << status
+	     << " after " << seconds << " seconds (exit code " << code << ")" << endl;
+	if ( queue.Complete( tile, client, ok, now ) ) {
+	    sprintf( reply, "%s", TG_MSG_OK );
+	} else {
+	    sprintf( reply, "%s", TG_MSG_LOST );
+	}
+    } else {
+	cout << "Bad request from client: " << request << endl;
+	return;
     }
-    return 1;
-}
 
-#endif
+    if ( !tg_send_line( msgsock, reply ) ) {
+	perror("Cannot write to stream socket");
+    }
+}
 
 
 int main( int argc, char **argv ) {
-    int arg_counter;
-    long int next_tile;
     int sock, msgsock;
     fd_set ready;
-    short unsigned int port;
-
-#ifdef _MSC_VER
-    gIoPort = CreateIoCompletionPort((HANDLE)INVALID_HANDLE_VALUE, NULL, 0, 0);
+    short unsigned int port = 0;
+    int max_attempts = 3;
+    int backoff_secs = 60;
+    bool rerun_failed = false;
 
-    for (int n = 0; n < numWorkerThreads; ++n) {
-	DWORD id;
-	gWorkerThreads[n] = CreateThread(NULL, 0, ThreadProc, gIoPort, 0, &id);
-    }
-#endif
 				// Get any options first
     int arg_offset = 0;
     for (int i = 1; i < argc; i++) {
@@ -413,6 +260,18 @@ int main( int argc, char **argv ) {
       } else if (opt.find("--height=") == 0) {
 	area_height = atof(opt.substr(9).c_str());
 	arg_offset++;
+      } else if (opt.find("--port=") == 0) {
+	port = atoi(opt.substr(7).c_str());
+	arg_offset++;
+      } else if (opt.find("--retries=") == 0) {
+	max_attempts = atoi(opt.substr(10).c_str()) + 1;
+	arg_offset++;
+      } else if (opt.find("--backoff=") == 0) {
+	backoff_secs = atoi(opt.substr(10).c_str());
+	arg_offset++;
+      } else if (opt == "--rerun-failed") {
+	rerun_failed = true;
+	arg_offset++;
       } else if (opt == "--") {
 	break;
       } else if (opt.find("-") == 0) {
@@ -434,17 +293,11 @@ int main( int argc, char **argv ) {
     cout << "Area width: " << area_width << " degrees" << endl;
     cout << "Area height: " << area_height << " degrees" << endl;
 
-    arg_counter = arg_offset + 3;
-
-    // initialize tile counter / incrementer
-    init_tile_count( argv[arg_counter++] );
-
-    // temp test
-    // while ( (next_tile = get_next_tile()) != -1 ) {
-    //     cout << next_tile << " " << SGBucket(next_tile) << endl;
-    // }
-    // cout << "done" << endl;
-    // exit(0);
+    // queue up every chunk
+    TGJobQueue queue( TG_LEASE_SECS, max_attempts, backoff_secs );
+    for ( int i = arg_offset + 3; i < argc; i++ ) {
+	add_chunk_tiles( queue, argv[i] );
+    }
 
     // create the status directory
     string status_dir = work_base + "/Status";
@@ -452,6 +305,12 @@ int main( int argc, char **argv ) {
     sgp.append( "dummy" );
     sgp.create_dir( 0755 );
 
+    // pick up where the last server left off
+    if ( !queue.OpenJournal( status_dir + "/jobs.journal", rerun_failed ) ) {
+	exit(-1);
+    }
+    queue.PrintStats();
+
     // setup socket to listen on
     sock = make_socket( &port );
     cout << "socket is connected to port = " << port << endl;
@@ -459,71 +318,50 @@ int main( int argc, char **argv ) {
     // Specify the maximum length of the connection queue
     listen(sock, 10);
 
+    time_t last_stats = time(NULL);
+
     for ( ;; ) {
 	FD_ZERO(&ready);
 	FD_SET(sock, &ready);
 
-	// block until we get some input on sock
-	select(sock+1, &ready, 0, 0, NULL);
-
-	if ( FD_ISSET(sock, &ready) ) {
-	    // printf("%d %d Incomming message --> ", getpid(), pid);
-
-	    // get the next tile to work on
-	    next_tile = get_next_tile();
-
-	    if ( next_tile == -1 ) {
-		// end of chunk see if there are more chunks
-		if ( arg_counter < argc ) {
-		    // still more chunks to process
-		    init_tile_count( argv[arg_counter++] );
-		    next_tile = get_next_tile();
-		}
-	    }
+	// wake up once a second to look for expired leases
+	struct timeval tv;
+	tv.tv_sec  = 1;
+	tv.tv_usec = 0;
+	select(sock+1, &ready, 0, 0, &tv);
 
-	    cout << "Bucket = " << SGBucket(next_tile)
-		 << " (" << pass << ")" << endl;
+	time_t now = time(NULL);
+	queue.ExpireLeases( now );
 
-	    log_pending_tile( status_dir, next_tile );
-	    // cout << "next tile = " << next_tile << endl;;
+	if ( now - last_stats >= 60 ) {
+	    queue.PrintStats();
+	    last_stats = now;
+	}
 
+	if ( FD_ISSET(sock, &ready) ) {
 	    msgsock = accept(sock, 0, 0);
-	    // cout << "msgsock = " << msgsock << endl;
-
-#ifndef _MSC_VER
-	    // spawn a child
-	    int pid = fork();
-
-	    if ( pid < 0 ) {
-		// error
-		perror("Cannot fork child process");
-		exit(-1);
-	    } else if ( pid > 0 ) {
-		// This is the parent
-		close(msgsock);
-
-		// clean up all of our zombie children
-		int status;
-		while ( (pid = waitpid( WAIT_ANY, &status, WNOHANG )) > 0 ) {
-		    // cout << "waitpid(): pid = " << pid
-		    //      << " status = " << status << endl;
-		}
-	    } else {
-		// This is the child
-		close(sock);
-
-		alloc_new_tile( msgsock, next_tile, status_dir );
-
-		exit(0);
+	    if ( msgsock < 0 ) {
+		perror("accept");
+		continue;
 	    }
+
+	    // requests are tiny, so they're answered right here - but don't
+	    // let a stuck client hold everyone else up
+#ifdef _MSC_VER
+	    DWORD timeout = 10000;
 #else
+	    struct timeval timeout;
+	    timeout.tv_sec  = 10;
+	    timeout.tv_usec = 0;
+#endif
+	    setsockopt(msgsock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
 
-	    Parameters *p = new Parameters;
-	    p->msgsock = msgsock;
-	    p->next_tile = next_tile;
-	    p->status_dir = status_dir;
-	    PostQueuedCompletionStatus(gIoPort, (DWORD)p, 0, NULL);
+	    handle_request( msgsock, queue );
 
+#ifdef _MSC_VER
+	    closesocket(msgsock);
+#else
+	    close(msgsock);
 #endif
 	}
     }
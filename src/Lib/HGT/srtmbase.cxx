@@ -27,10 +27,8 @@
 
 #include <iostream>
 #include <stdlib.h>
-#include <zlib.h>
 
 #include <simgear/compiler.h>
-#include <simgear/io/lowlevel.hxx>
 
 #include "srtmbase.hxx"
 
@@ -97,7 +95,7 @@ TGSrtmBase::write_area( const string& root, SGBucket& b ) {
     sgp.append( "dummy" );
     sgp.create_dir( 0755 );
 
-    string array_file = path + "/" + b.gen_index_str() + ".arr.gz";
+    string array_file = path + "/" + b.gen_index_str();
     cout << "array_file = " << array_file << endl;
 
     write_area_bin(array_file, start_x, start_y, min_x, min_y,
@@ -110,25 +108,19 @@ bool TGSrtmBase::write_area_bin(const SGPath& aPath, int start_x, int start_y,
     int min_x, int min_y,
     int span_x, int span_y, int col_step, int row_step)
 {
-    gzFile fp;
-    if ( (fp = gzopen( aPath.c_str(), "wb9" )) == NULL ) {
-	    cout << "ERROR:  cannot open " << aPath.str() << " for writing!" << endl;
-	    return false;
-    }
+    tgArrayWriter writer( min_x, min_y, span_x + 1, col_step, span_y + 1, row_step );
 
-    int32_t header = 0x54474152; // 'TGAR'
-    sgWriteLong(fp, header);
-    sgWriteInt(fp, min_x); sgWriteInt(fp, min_y);
-    sgWriteInt(fp, span_x + 1); sgWriteInt(fp, col_step);
-    sgWriteInt(fp, span_y + 1); sgWriteInt(fp, row_step);
+    for ( int i = 0; i <= span_x; ++i ) {
+        for ( int j = 0; j <= span_y; ++j ) {
+            writer.set_elev( i, j, height(start_x + i, start_y + j) );
+        }
+    }
 
-    for ( int i = start_x; i <= start_x + span_x; ++i ) {
-	    for ( int j = start_y; j <= start_y + span_y; ++j ) {
-            sgWriteShort(fp, height(i,j));
-	    }
+    if ( !writer.write( aPath.str(), compression ) ) {
+        cout << "ERROR:  cannot write " << aPath.str() << endl;
+        return false;
     }
 
-    gzclose(fp);
     return true;
 }
 
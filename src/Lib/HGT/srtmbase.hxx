@@ -33,10 +33,13 @@
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/misc/sg_dir.hxx>
 
+#include <terragear/tg_array.hxx>
+
 class TGSrtmBase {
 
 protected:
-    TGSrtmBase() : remove_tmp_file(false)
+    TGSrtmBase() : remove_tmp_file(false),
+                   compression(TG_ARRAY_DEFAULT_COMPRESSION)
     {}
 
     ~TGSrtmBase();
@@ -53,6 +56,9 @@ protected:
     bool remove_tmp_file;
     simgear::Dir tmp_dir;
 
+    // gzip level of the array files, 0 for uncompressed
+    int compression;
+
 public:
 
     // write out the area of data covered by the specified bucket.
@@ -60,10 +66,14 @@ public:
     // hand corner.
     bool write_area( const std::string& root, SGBucket& b );
 
+    // aPath is the array file name without the extension, which
+    // depends on the compression
     bool write_area_bin(const SGPath& aPath,
         int start_x, int start_y, int min_x, int min_y,
     int span_x, int span_y, int col_step, int row_step);
 
+    void set_compression( int level ) { compression = level; }
+
     // Informational methods
     inline double get_originx() const { return originx; }
     inline double get_originy() const { return originy; }
@@ -0,0 +1,106 @@
+// test-tesselate.cxx - check that degenerate and self crossing contours tesselate
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#include <simgear/compiler.h>
+#include <simgear/debug/logstream.hxx>
+
+#include <cmath>
+#include <iostream>
+
+#include "tg_polygon.hxx"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// tesselate a unit square with the given extra nodes, and check that the
+// whole area is covered
+static bool check( const char* name, const SGGeod* nodes, unsigned int count )
+{
+    tgPolygon poly;
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        poly.AddNode( 0, nodes[i] );
+    }
+    poly.Tesselate();
+
+    double area = 0.0;
+    for ( unsigned int t = 0; t < poly.Triangles(); t++ ) {
+        SGGeod p0 = poly.GetTriNode( t, 0 );
+        SGGeod p1 = poly.GetTriNode( t, 1 );
+        SGGeod p2 = poly.GetTriNode( t, 2 );
+
+        area += fabs( ( p1.getLongitudeDeg() - p0.getLongitudeDeg() ) * ( p2.getLatitudeDeg() - p0.getLatitudeDeg() ) -
+                      ( p2.getLongitudeDeg() - p0.getLongitudeDeg() ) * ( p1.getLatitudeDeg() - p0.getLatitudeDeg() ) ) / 2.0;
+    }
+
+    bool ok = ( poly.Triangles() >= 2 && fabs( area - 1.0 ) < 1e-9 );
+    cout << name << " : " << poly.Triangles() << " triangles, area " << area << ( ok ? " ok" : " FAILED" ) << endl;
+
+    return ok;
+}
+
+// a contour that crosses itself can't be triangulated with the fast kernel,
+// so it must fall back to exact constructions, and still give triangles
+static bool check_crossing( const char* name, const SGGeod* nodes, unsigned int count )
+{
+    tgPolygon poly;
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        poly.AddNode( 0, nodes[i] );
+    }
+    poly.Tesselate();
+
+    bool ok = ( poly.GetTessPath() == TG_TESS_EXACT && poly.Triangles() >= 2 );
+    cout << name << " : " << poly.Triangles() << " triangles, " <<
+            ( poly.GetTessPath() == TG_TESS_EXACT ? "exact" : "fast" ) << ( ok ? " ok" : " FAILED" ) << endl;
+
+    return ok;
+}
+
+int main( int argc, char **argv )
+{
+    sglog().setLogLevels( SG_ALL, SG_WARN );
+
+    SGGeod sw = SGGeod::fromDeg( 0.0, 0.0 );
+    SGGeod se = SGGeod::fromDeg( 1.0, 0.0 );
+    SGGeod ne = SGGeod::fromDeg( 1.0, 1.0 );
+    SGGeod nw = SGGeod::fromDeg( 0.0, 1.0 );
+
+    const SGGeod plain[]    = { sw, se, ne, nw };
+    const SGGeod repeated[] = { sw, se, se, ne, nw };
+    const SGGeod closed[]   = { sw, se, ne, nw, sw };
+    const SGGeod bowtie[]   = { sw, ne, se, nw };
+
+    bool ok = true;
+    ok = check( "plain contour", plain, 4 ) && ok;
+    ok = check( "repeated node", repeated, 5 ) && ok;
+    ok = check( "closing node", closed, 5 ) && ok;
+    ok = check_crossing( "self crossing", bowtie, 4 ) && ok;
+
+    // a lone node has nothing to tesselate, but must not upset the triangulation
+    tgPolygon single;
+    single.AddNode( 0, sw );
+    single.Tesselate();
+    cout << "single node : " << single.Triangles() << " triangles" << endl;
+
+    if ( !ok ) {
+        cerr << "tesselation check failed" << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -18,12 +20,18 @@ tgPolygon tgAccumulator::Diff( const tgContour& subject )
         all_nodes.add( subject.GetNode(i) );
     }
 
-    for ( unsigned int i = 0; i < nodes.size(); i++ ) {
-        all_nodes.add( nodes[i] );
+    // only the accumulated polys that intersect our bb can touch the result
+    std::vector<unsigned int> hits;
+    GetHits( subject.GetBoundingBox(), hits );
+
+    for ( unsigned int i = 0; i < hits.size(); i++ ) {
+        std::vector<SGGeod> const& hit_nodes = accum[hits[i]].nodes;
+        for ( unsigned int j = 0; j < hit_nodes.size(); j++ ) {
+            all_nodes.add( hit_nodes[j] );
+        }
     }
 
-    unsigned int  num_hits = 0;
-    tgRectangle box1 = subject.GetBoundingBox();
+    unsigned int  num_hits = hits.size();
 
     ClipperLib::Path  clipper_subject = tgContour::ToClipper( subject );
     ClipperLib::Paths clipper_result;
@@ -34,14 +42,8 @@ tgPolygon tgAccumulator::Diff( const tgContour& subject )
     c.AddPath(clipper_subject, ClipperLib::ptSubject, true);
 
     // clip result against all polygons in the accum that intersect our bb
-    for (unsigned int i=0; i < accum.size(); i++) {
-        tgRectangle box2 = BoundingBox_FromClipper( accum[i] );
-
-        if ( box2.intersects(box1) )
-        {
-            c.AddPaths(accum[i], ClipperLib::ptClip, true);
-            num_hits++;
-        }
+    for (unsigned int i=0; i < hits.size(); i++) {
+        c.AddPaths(accum[hits[i]].paths, ClipperLib::ptClip, true);
     }
 
     if (num_hits) {
@@ -70,12 +72,18 @@ tgPolygon tgAccumulator::Diff( const tgPolygon& subject )
         }
     }
 
-    for ( unsigned int i = 0; i < nodes.size(); i++ ) {
-        all_nodes.add( nodes[i] );
+    // only the accumulated polys that intersect our bb can touch the result
+    std::vector<unsigned int> hits;
+    GetHits( subject.GetBoundingBox(), hits );
+
+    for ( unsigned int i = 0; i < hits.size(); i++ ) {
+        std::vector<SGGeod> const& hit_nodes = accum[hits[i]].nodes;
+        for ( unsigned int j = 0; j < hit_nodes.size(); j++ ) {
+            all_nodes.add( hit_nodes[j] );
+        }
     }
 
-    unsigned int  num_hits = 0;
-    tgRectangle box1 = subject.GetBoundingBox();
+    unsigned int  num_hits = hits.size();
 
     ClipperLib::Paths clipper_subject = tgPolygon::ToClipper( subject );
     ClipperLib::Paths clipper_result;
@@ -86,14 +94,8 @@ tgPolygon tgAccumulator::Diff( const tgPolygon& subject )
     c.AddPaths(clipper_subject, ClipperLib::ptSubject, true);
 
     // clip result against all polygons in the accum that intersect our bb
-    for (unsigned int i=0; i < accum.size(); i++) {
-        tgRectangle box2 = BoundingBox_FromClipper( accum[i] );
-
-        if ( box2.intersects(box1) )
-        {
-            c.AddPaths(accum[i], ClipperLib::ptClip, true);
-            num_hits++;
-        }
+    for (unsigned int i=0; i < hits.size(); i++) {
+        c.AddPaths(accum[hits[i]].paths, ClipperLib::ptClip, true);
     }
 
     if (num_hits) {
@@ -121,33 +123,126 @@ tgPolygon tgAccumulator::Diff( const tgPolygon& subject )
     return result;
 }
 
+static int CellIndex( double deg )
+{
+    // the bb of an empty poly is garbage - keep it in int range
+    deg = std::max( -720.0, std::min( 720.0, deg ) );
+
+    return (int)floor( deg / TG_ACCUM_CELL_SIZE );
+}
+
+void tgAccumulator::GetCells( const tgRectangle& box, int& x0, int& y0, int& x1, int& y1 )
+{
+    x0 = CellIndex( box.getMin().getLongitudeDeg() );
+    y0 = CellIndex( box.getMin().getLatitudeDeg() );
+    x1 = CellIndex( box.getMax().getLongitudeDeg() );
+    y1 = CellIndex( box.getMax().getLatitudeDeg() );
+}
+
+void tgAccumulator::AddEntry( const ClipperLib::Paths& paths, const std::vector<SGGeod>& nodes )
+{
+    unsigned int idx = accum.size();
+
+    accum.push_back( Entry() );
+    Entry& e   = accum.back();
+    e.paths    = paths;
+    e.bbox     = BoundingBox_FromClipper( paths );
+    e.nodes    = nodes;
+    e.query_id = 0;
+
+    int x0, y0, x1, y1;
+    GetCells( e.bbox, x0, y0, x1, y1 );
+
+    if ( (long long)(x1 - x0 + 1) * (y1 - y0 + 1) > TG_ACCUM_MAX_CELLS ) {
+        large.push_back( idx );
+    } else {
+        for ( int x = x0; x <= x1; x++ ) {
+            for ( int y = y0; y <= y1; y++ ) {
+                cells[ CellKey(x, y) ].push_back( idx );
+            }
+        }
+    }
+}
+
+void tgAccumulator::GetHits( const tgRectangle& box, std::vector<unsigned int>& hits )
+{
+    int x0, y0, x1, y1;
+    GetCells( box, x0, y0, x1, y1 );
+
+    hits.clear();
+
+    // a huge subject - cheaper to just check every cached bbox
+    if ( (long long)(x1 - x0 + 1) * (y1 - y0 + 1) > (long long)accum.size() ) {
+        for ( unsigned int i = 0; i < accum.size(); i++ ) {
+            if ( accum[i].bbox.intersects( box ) ) {
+                hits.push_back( i );
+            }
+        }
+        return;
+    }
+
+    // entries can be in more than one cell - only look at each once
+    query_id++;
+
+    for ( int x = x0; x <= x1; x++ ) {
+        for ( int y = y0; y <= y1; y++ ) {
+            cell_map::const_iterator it = cells.find( CellKey(x, y) );
+            if ( it == cells.end() ) {
+                continue;
+            }
+
+            std::vector<unsigned int> const& cell = it->second;
+            for ( unsigned int i = 0; i < cell.size(); i++ ) {
+                Entry& e = accum[cell[i]];
+                if ( e.query_id != query_id ) {
+                    e.query_id = query_id;
+                    if ( e.bbox.intersects( box ) ) {
+                        hits.push_back( cell[i] );
+                    }
+                }
+            }
+        }
+    }
+
+    for ( unsigned int i = 0; i < large.size(); i++ ) {
+        if ( accum[large[i]].bbox.intersects( box ) ) {
+            hits.push_back( large[i] );
+        }
+    }
+
+    // clip in the order the polys were accumulated
+    std::sort( hits.begin(), hits.end() );
+}
+
 void tgAccumulator::Add( const tgContour& subject )
 {
     tgPolygon poly;
+    std::vector<SGGeod> subject_nodes;
 
     // Add the nodes
     for ( unsigned int i = 0; i < subject.GetSize(); ++i ) {
-        nodes.add( subject.GetNode(i) );
+        subject_nodes.push_back( subject.GetNode(i) );
     }
 
     poly.AddContour( subject );
 
     ClipperLib::Paths clipper_subject = tgPolygon::ToClipper( poly );
-    accum.push_back( clipper_subject );
+    AddEntry( clipper_subject, subject_nodes );
 }
 
 void tgAccumulator::Add( const tgPolygon& subject )
 {
     if ( subject.Contours() ) {
         ClipperLib::Paths clipper_subject = tgPolygon::ToClipper( subject );
-        
+        std::vector<SGGeod> subject_nodes;
+
         for ( unsigned int i = 0; i < subject.Contours(); ++i ) {
             for ( unsigned int j = 0; j < subject.ContourSize( i ); ++j ) {
-                nodes.add( subject.GetNode(i, j) );
+                subject_nodes.push_back( subject.GetNode(i, j) );
             }
         }
 
-        accum.push_back( clipper_subject );
+        AddEntry( clipper_subject, subject_nodes );
     } else {
         SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::Add() - Adding poly with " << subject.Contours() << " contours " );
     }
@@ -159,8 +254,10 @@ tgPolygon tgAccumulator::Union()
     UniqueSGGeodSet all_nodes;
     
     /* before diff - gather all nodes */    
-    for ( unsigned int i = 0; i < nodes.size(); i++ ) {
-        all_nodes.add( nodes[i] );
+    for ( unsigned int i = 0; i < accum.size(); i++ ) {
+        for ( unsigned int j = 0; j < accum[i].nodes.size(); j++ ) {
+            all_nodes.add( accum[i].nodes[j] );
+        }
     }
     
     ClipperLib::Paths clipper_result;
@@ -169,7 +266,7 @@ tgPolygon tgAccumulator::Union()
     c.Clear();
     
     for (unsigned int i=0; i < accum.size(); i++) {
-        c.AddPaths(accum[i], ClipperLib::ptSubject, true);
+        c.AddPaths(accum[i].paths, ClipperLib::ptSubject, true);
     }
     
     if ( !c.Execute(ClipperLib::ctUnion, clipper_result, ClipperLib::pftNonZero, ClipperLib::pftNonZero) ) {
@@ -193,7 +290,7 @@ void tgAccumulator::ToShapefiles( const std::string& path, const std::string& la
             for (unsigned int i=0; i < accum.size(); i++) {
                 sprintf( layer, "%s_%d", layer_prefix.c_str(), i );
                 sprintf( shapefile, "accum_%d", i );
-                tgShapefile::FromClipper( accum[i], true, path, layer, std::string(shapefile) );
+                tgShapefile::FromClipper( accum[i].paths, true, path, layer, std::string(shapefile) );
             }
         } else {
             ClipperLib::Paths clipper_result;
@@ -201,7 +298,7 @@ void tgAccumulator::ToShapefiles( const std::string& path, const std::string& la
             c.Clear();
 
             for ( unsigned int i=0; i<accum.size(); i++ ) {
-                c.AddPaths(accum[i], ClipperLib::ptSubject, true);
+                c.AddPaths(accum[i].paths, ClipperLib::ptSubject, true);
             }
         
             if ( c.Execute( ClipperLib::ctUnion, clipper_result, ClipperLib::pftNonZero, ClipperLib::pftNonZero) ) {
@@ -224,7 +321,7 @@ void tgAccumulator::ToClipperfiles( const std::string& path, const std::string&
                 sprintf( filename, "%s/%s_%d", path.c_str(), layer_prefix.c_str(), i );
                                 
                 file.open (filename);
-                file << accum[i];
+                file << accum[i].paths;
                 file.close();
             }
         } else {
@@ -233,7 +330,7 @@ void tgAccumulator::ToClipperfiles( const std::string& path, const std::string&
             c.Clear();
             
             for ( unsigned int i=0; i<accum.size(); i++ ) {
-                c.AddPaths(accum[i], ClipperLib::ptSubject, true);
+                c.AddPaths(accum[i].paths, ClipperLib::ptSubject, true);
             }
             
             if ( c.Execute( ClipperLib::ctUnion, clipper_result, ClipperLib::pftNonZero, ClipperLib::pftNonZero) ) {
@@ -1,13 +1,24 @@
 #ifndef _TGACCUMULATOR_HXX
 #define _TGACCUMULATOR_HXX
 
+#include <boost/unordered_map.hpp>
+
 #include "tg_polygon.hxx"
 #include "tg_contour.hxx"
+#include "tg_rectangle.hxx"
 #include "clipper.hpp"
 
+// Accumulated polys are bucketed in a uniform grid of this size (degrees),
+// so a diff only visits the polys near the subject.  Polys covering more
+// than TG_ACCUM_MAX_CELLS cells are kept in a list that is always checked.
+#define TG_ACCUM_CELL_SIZE      (1.0/128.0)
+#define TG_ACCUM_MAX_CELLS      (256)
+
 class tgAccumulator
 {
 public:
+    tgAccumulator() : query_id(0) {}
+
     tgPolygon Diff( const tgContour& subject );
     tgPolygon Diff( const tgPolygon& subject );
 
@@ -20,10 +31,29 @@ public:
     tgPolygon Union( void );
     
 private:
-    typedef std::vector < ClipperLib::Paths > clipper_polygons_list;
+    struct Entry {
+        ClipperLib::Paths       paths;
+        tgRectangle             bbox;       // cached at Add()
+        std::vector<SGGeod>     nodes;
+        unsigned int            query_id;   // last query that visited us
+    };
+    typedef std::vector < Entry > entry_list;
+    typedef boost::unordered_map < long long, std::vector<unsigned int> > cell_map;
+
+    void AddEntry( const ClipperLib::Paths& paths, const std::vector<SGGeod>& nodes );
+
+    // indices of the entries whose bbox intersects box, in the order they were added
+    void GetHits( const tgRectangle& box, std::vector<unsigned int>& hits );
+
+    static long long CellKey( int x, int y ) {
+        return ( (long long)x << 32 ) | (unsigned int)y;
+    }
+    static void GetCells( const tgRectangle& box, int& x0, int& y0, int& x1, int& y1 );
 
-    clipper_polygons_list   accum;
-    UniqueSGGeodSet         nodes;
+    entry_list                  accum;
+    cell_map                    cells;
+    std::vector<unsigned int>   large;
+    unsigned int                query_id;
 };
 
 #endif // _TGACCUMULATOR_HXX
\ No newline at end of file
@@ -123,6 +123,176 @@ void tgAreas::SaveToGzFile(gzFile& fp)
     }
 }
 
+// binary intermediate records - same content as SaveToGzFile, but
+// each kind of record goes into its own contiguous array
+struct tgBinPoly {
+    uint32_t    material;
+    uint32_t    flag;
+    uint32_t    preserve3d;
+    uint32_t    num_contours;
+    uint32_t    num_triangles;
+    int32_t     tex_method;
+    double      tex[15];
+};
+
+struct tgBinContour {
+    uint32_t    num_nodes;
+    uint32_t    hole;
+};
+
+struct tgBinTriangle {
+    tgBinGeod   nodes[3];
+    int32_t     idx[3];
+    int32_t     pad;
+};
+
+void tgAreas::SaveToBinFile( tgBinFileWriter& wr ) const
+{
+    std::vector<uint32_t>       area_counts;
+    std::vector<tgBinPoly>      bin_polys;
+    std::vector<tgBinContour>   bin_contours;
+    std::vector<tgBinGeod>      bin_nodes;
+    std::vector<tgBinTriangle>  bin_triangles;
+
+    for (unsigned int i=0; i<polys.size(); i++) {
+        area_counts.push_back( polys[i].size() );
+
+        for (unsigned int j=0; j<polys[i].size(); j++) {
+            tgPolygon const&   poly = polys[i][j];
+            tgTexParams const& tp   = poly.GetTexParams();
+            tgBinPoly          bp;
+
+            bp.material      = wr.AddString( poly.GetMaterial() );
+            bp.flag          = wr.AddString( poly.GetFlag() );
+            bp.preserve3d    = poly.GetPreserve3D() ? 1 : 0;
+            bp.num_contours  = poly.Contours();
+            bp.num_triangles = poly.Triangles();
+            bp.tex_method    = (int32_t)tp.method;
+            bp.tex[0]  = tp.ref.getLongitudeDeg();
+            bp.tex[1]  = tp.ref.getLatitudeDeg();
+            bp.tex[2]  = tp.ref.getElevationM();
+            bp.tex[3]  = tp.width;
+            bp.tex[4]  = tp.length;
+            bp.tex[5]  = tp.heading;
+            bp.tex[6]  = tp.minu;
+            bp.tex[7]  = tp.maxu;
+            bp.tex[8]  = tp.minv;
+            bp.tex[9]  = tp.maxv;
+            bp.tex[10] = tp.min_clipu;
+            bp.tex[11] = tp.max_clipu;
+            bp.tex[12] = tp.min_clipv;
+            bp.tex[13] = tp.max_clipv;
+            bp.tex[14] = tp.center_lat;
+            bin_polys.push_back( bp );
+
+            for (unsigned int c=0; c<poly.Contours(); c++) {
+                tgBinContour bc;
+                bc.num_nodes = poly.ContourSize( c );
+                bc.hole      = poly.GetContour( c ).GetHole() ? 1 : 0;
+                bin_contours.push_back( bc );
+
+                for (unsigned int n=0; n<bc.num_nodes; n++) {
+                    bin_nodes.push_back( tgBinGeod::fromGeod( poly.GetNode( c, n ) ) );
+                }
+            }
+
+            for (unsigned int t=0; t<poly.Triangles(); t++) {
+                tgTriangle const& tri = poly.GetTriangle( t );
+                tgBinTriangle     bt;
+
+                for (unsigned int k=0; k<3; k++) {
+                    bt.nodes[k] = tgBinGeod::fromGeod( tri.GetNode( k ) );
+                    bt.idx[k]   = tri.GetIndex( k );
+                }
+                bt.pad = 0;
+                bin_triangles.push_back( bt );
+            }
+        }
+    }
+
+    wr.WriteArray( area_counts );
+    wr.WriteArray( bin_polys );
+    wr.WriteArray( bin_contours );
+    wr.WriteArray( bin_nodes );
+    wr.WriteArray( bin_triangles );
+}
+
+void tgAreas::LoadFromBinFile( tgBinFileReader& rd )
+{
+    std::vector<uint32_t>       area_counts;
+    std::vector<tgBinPoly>      bin_polys;
+    std::vector<tgBinContour>   bin_contours;
+    std::vector<tgBinGeod>      bin_nodes;
+    std::vector<tgBinTriangle>  bin_triangles;
+
+    rd.ReadArray( area_counts );
+    rd.ReadArray( bin_polys );
+    rd.ReadArray( bin_contours );
+    rd.ReadArray( bin_nodes );
+    rd.ReadArray( bin_triangles );
+
+    polys.clear();
+    if ( !rd.IsOk() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgAreas::LoadFromBinFile - truncated file" );
+        return;
+    }
+
+    unsigned int cur_poly = 0, cur_contour = 0, cur_node = 0, cur_tri = 0;
+
+    polys.resize( area_counts.size() );
+    for (unsigned int i=0; i<area_counts.size(); i++) {
+        polys[i].resize( area_counts[i] );
+
+        for (unsigned int j=0; j<area_counts[i] && cur_poly < bin_polys.size(); j++) {
+            tgBinPoly const& bp   = bin_polys[cur_poly++];
+            tgPolygon&       poly = polys[i][j];
+            tgTexParams      tp;
+
+            for (unsigned int c=0; c<bp.num_contours && cur_contour < bin_contours.size(); c++) {
+                tgBinContour const& bc = bin_contours[cur_contour++];
+                tgContour           contour;
+
+                for (unsigned int n=0; n<bc.num_nodes && cur_node < bin_nodes.size(); n++) {
+                    contour.AddNode( bin_nodes[cur_node++].toGeod() );
+                }
+                contour.SetHole( bc.hole != 0 );
+                poly.AddContour( contour );
+            }
+
+            for (unsigned int t=0; t<bp.num_triangles && cur_tri < bin_triangles.size(); t++) {
+                tgBinTriangle const& bt = bin_triangles[cur_tri++];
+                tgTriangle           triangle;
+
+                for (unsigned int k=0; k<3; k++) {
+                    triangle.SetNode( k, bt.nodes[k].toGeod() );
+                    triangle.SetIndex( k, bt.idx[k] );
+                }
+                poly.AddTriangle( triangle );
+            }
+
+            tp.method     = (tgTexMethod)bp.tex_method;
+            tp.ref        = SGGeod::fromDegM( bp.tex[0], bp.tex[1], bp.tex[2] );
+            tp.width      = bp.tex[3];
+            tp.length     = bp.tex[4];
+            tp.heading    = bp.tex[5];
+            tp.minu       = bp.tex[6];
+            tp.maxu       = bp.tex[7];
+            tp.minv       = bp.tex[8];
+            tp.maxv       = bp.tex[9];
+            tp.min_clipu  = bp.tex[10];
+            tp.max_clipu  = bp.tex[11];
+            tp.min_clipv  = bp.tex[12];
+            tp.max_clipv  = bp.tex[13];
+            tp.center_lat = bp.tex[14];
+            poly.SetTexParams( tp );
+
+            poly.SetMaterial( rd.GetString( bp.material ) );
+            poly.SetFlag( rd.GetString( bp.flag ) );
+            poly.SetPreserve3D( bp.preserve3d != 0 );
+        }
+    }
+}
+
 void tgAreas::ToShapefile( const std::string& datasource )
 {
     for (unsigned int area=0; area<polys.size(); area++) {
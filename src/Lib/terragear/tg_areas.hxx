@@ -39,6 +39,7 @@
 
 #include "tg_nodes.hxx"
 #include "tg_polygon.hxx"
+#include "tg_binfile.hxx"
 
 typedef std::vector<tgpolygon_list> tgarea_list;
 
@@ -62,6 +63,28 @@ public:
 
     void clear(void);
     void SyncNodes( TGNodes& nodes );
+
+    // reset everything SaveToGzFile doesn't keep in every polygon
+    inline void ClearUnsaved( void )
+    {
+        for (unsigned int i=0; i<polys.size(); i++) {
+            for (unsigned int j=0; j<polys[i].size(); j++) {
+                polys[i][j].ClearUnsaved();
+            }
+        }
+    }
+
+    // exchange contents without copying any polygons
+    inline void swap( tgAreas& other )
+    {
+        polys.swap( other.polys );
+        area_names.swap( other.area_names );
+    }
+
+    inline unsigned int size( void ) const
+    {
+        return polys.size();
+    }
     
     inline unsigned int area_size( unsigned int area ) const
     {
@@ -80,11 +103,18 @@ public:
     {
         if ( area > polys.capacity() ) {
             SG_LOG( SG_GENERAL, SG_ALERT, " area out of bounds " << area << " of " << polys.capacity() );
-            exit(0);
+            exit(1);
         }
         polys[area].push_back( p );
     }
 
+    // add an empty poly to the area, to be filled in place
+    inline tgPolygon& emplace_poly( unsigned int area )
+    {
+        polys[area].push_back( tgPolygon() );
+        return polys[area].back();
+    }
+
     // TODO : Let's get rid of this - it was a memory leak, and the polygons should really be modified in place
     // NOTE - this will be considerable work, so leaving as is for now (but fix the leak)
     inline void set_poly( unsigned int area, unsigned int poly, const tgPolygon& p )
@@ -92,6 +122,19 @@ public:
         polys[area][poly] = p;
     }
 
+    // Swap a poly out of the list to work on it, and back in when done.
+    // Neither copies the polygon - take leaves the slot without contours
+    // or triangles, and put leaves p with whatever was in the slot.
+    inline void take_poly( unsigned int area, unsigned int poly, tgPolygon& p )
+    {
+        p.Erase();
+        p.swap( polys[area][poly] );
+    }
+    inline void put_poly( unsigned int area, unsigned int poly, tgPolygon& p )
+    {
+        polys[area][poly].swap( p );
+    }
+
     inline tgpolygon_list& get_polys( unsigned int area )
     {
         return polys[area];
@@ -121,6 +164,9 @@ public:
     void SaveToGzFile( gzFile& fp );
     void LoadFromGzFile( gzFile& fp );
 
+    void SaveToBinFile( tgBinFileWriter& wr ) const;
+    void LoadFromBinFile( tgBinFileReader& rd );
+
     // Friend for output to stream
     friend std::ostream& operator<< ( std::ostream&, const tgAreas& );
 
@@ -23,23 +23,50 @@
 #  include <config.h>
 #endif
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
 #include <simgear/compiler.h>
+#include <simgear/constants.h>
 #include <simgear/misc/sgstream.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/strutils.hxx>
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/io/lowlevel.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include "tg_array.hxx"
 
 using std::string;
 
 
+// The array files are little endian.  This is only needed on big endian
+// hosts, and is written as a plain loop over the whole grid so the
+// compiler can vectorize it.
+static void swap_shorts( short* data, size_t count )
+{
+    uint16_t* p = (uint16_t*)data;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        p[i] = (uint16_t)( (p[i] << 8) | (p[i] >> 8) );
+    }
+}
+
+
 tgArray::tgArray( void ):
   array_in(NULL),
   fitted_in(NULL),
+  map_addr(NULL),
+  map_size(0),
   in_data(NULL)
 {
 
@@ -49,38 +76,94 @@ tgArray::tgArray( void ):
 tgArray::tgArray( const string &file ):
   array_in(NULL),
   fitted_in(NULL),
-      in_data(NULL)
+  map_addr(NULL),
+  map_size(0),
+  in_data(NULL)
 {
     tgArray::open(file);
 }
 
 
-// open an Array file (and fitted file if it exists)
+// map an uncompressed array file copy on write.  On Windows, it's just
+// read in with a single call.
+bool tgArray::map_array( const string& file ) {
+#ifndef _WIN32
+    int fd = ::open( file.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) == 0 && (size_t)st.st_size >= TG_ARRAY_HEADER_SIZE ) {
+        void* addr = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+        if ( addr != MAP_FAILED ) {
+            map_addr = addr;
+            map_size = st.st_size;
+        }
+    }
+    ::close( fd );
+#else
+    FILE* fp = fopen( file.c_str(), "rb" );
+    if ( !fp ) {
+        return false;
+    }
+    fseek( fp, 0, SEEK_END );
+    long len = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+    if ( len >= (long)TG_ARRAY_HEADER_SIZE ) {
+        char* buf = (char*)malloc( len );
+        if ( buf && fread( buf, len, 1, fp ) == 1 ) {
+            map_addr = buf;
+            map_size = len;
+        } else {
+            free( buf );
+        }
+    }
+    fclose( fp );
+#endif
+
+    if ( !map_addr ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "  Cannot map " << file );
+        return false;
+    }
+
+    SG_LOG(SG_GENERAL, SG_DEBUG, "  Mapped array file: " << file );
+    return true;
+}
+
+
+// open an Array file (and fitted file if it exists).  An uncompressed
+// .arr is preferred over the .arr.gz, as it doesn't need to be inflated.
 bool tgArray::open( const string& file_base ) {
+    // drop the grid of the last file, if it wasn't unloaded
+    free_data();
+
     // open array data file
-    string array_name = file_base + ".arr.gz";
+    string array_name = file_base + ".arr";
 
-    array_in = gzopen( array_name.c_str(), "rb" );
-    if (array_in == NULL) {
-        return false;
+    if ( !SGPath( array_name ).isFile() || !map_array( array_name ) ) {
+        array_name += ".gz";
+
+        array_in = gzopen( array_name.c_str(), "rb" );
+        if (array_in == NULL) {
+            return false;
+        }
     }
 
     // open fitted data file
     string fitted_name = file_base + ".fit.gz";
-    fitted_in = new sg_gzifstream( fitted_name );
-    if ( !fitted_in->is_open() ) {
+    fitted_in = gzopen( fitted_name.c_str(), "rb" );
+    if ( fitted_in == NULL ) {
         // not having a .fit file is unfortunate, but not fatal.  We
         // can do a really stupid/crude fit on the fly, but it will
         // not be nearly as nice as what the offline terrafit utility
         // would have produced.
         SG_LOG(SG_GENERAL, SG_DEBUG, "  Cannot open " << fitted_name );
-        delete fitted_in;
-        fitted_in = NULL;
     } else {
         SG_LOG(SG_GENERAL, SG_DEBUG, "  Opening fitted data file: " << fitted_name );
     }
 
-    return (array_in != NULL) ? true : false;
+    return true;
 }
 
 
@@ -93,31 +176,36 @@ tgArray::close() {
     }
 
     if (fitted_in ) {
-        fitted_in->close();
-        delete fitted_in;
+        gzclose(fitted_in);
         fitted_in = NULL;
     }
 
     return true;
 }
 
+// release the grid - either our own copy, or the mapped file
 void
-tgArray::unload( void ) {
-    if (array_in) {
-        gzclose(array_in);
-        array_in = NULL;
+tgArray::free_data( void ) {
+    if ( map_addr ) {
+#ifndef _WIN32
+        munmap( map_addr, map_size );
+#else
+        free( map_addr );
+#endif
+        map_addr = NULL;
+        map_size = 0;
+    } else if (in_data) {
+        delete[] in_data;
     }
 
-    if (fitted_in ) {
-        fitted_in->close();
-        delete fitted_in;
-        fitted_in = NULL;
-    }
+    in_data = NULL;
+    nearest_nonvoid.clear();
+}
 
-    if (in_data) {
-        delete[] in_data;
-        in_data = NULL;
-    }
+void
+tgArray::unload( void ) {
+    close();
+    free_data();
 
     corner_list.clear();
     fitted_list.clear();
@@ -128,7 +216,9 @@ tgArray::unload( void ) {
 bool
 tgArray::parse( SGBucket& b ) {
     // Parse/load the array data file
-    if ( array_in ) {
+    if ( map_addr ) {
+        parse_mapped();
+    } else if ( array_in ) {
         parse_bin();
     } else {
         // file not open (not found?), fill with zero'd data
@@ -155,46 +245,137 @@ tgArray::parse( SGBucket& b ) {
     }
 
     // Parse/load the fitted data file
-    if ( fitted_in && fitted_in->is_open() ) {
-        int fitted_size;
-        double x, y, z;
-        *fitted_in >> fitted_size;
-        for ( int i = 0; i < fitted_size; ++i ) {
-            *fitted_in >> x >> y >> z;
-            fitted_list.push_back( SGGeod::fromDegM(x, y, z) );
-            SG_LOG(SG_GENERAL, SG_DEBUG, " loading fitted = " << SGGeod::fromDegM(x, y, z) );
-        }
+    if ( fitted_in ) {
+        parse_fitted();
     }
 
     return true;
 }
 
-void tgArray::parse_bin()
+// check the magic, and pick up the grid geometry from the header
+bool tgArray::parse_header( const int32_t* header )
 {
-    int32_t header;
-    sgReadLong(array_in, &header);
-    if (header != 0x54474152) {
+    int32_t h[7];
+
+    memcpy( h, header, sizeof(h) );
+    if ( sgIsBigEndian() ) {
+        for ( int i = 0; i < 7; i++ ) {
+            sgEndianSwap( (uint32_t*)&h[i] );
+        }
+    }
+
+    if (h[0] != TG_ARRAY_MAGIC) {
         SG_LOG(SG_GENERAL, SG_ALERT, "\nThe .arr file is not in the correct binary format."
         << "\nPlease rebuild it using the latest TerraGear HGT tools.");
         exit(1);
     }
 
-    int minX, minY, intColStep, intRowStep;
-    sgReadInt(array_in, &minX);
-    sgReadInt(array_in, &minY);
-    originx = minX;
-    originy = minY;
+    originx  = h[1];
+    originy  = h[2];
+    cols     = h[3];
+    col_step = h[4];
+    rows     = h[5];
+    row_step = h[6];
+
+    if ( cols <= 0 || rows <= 0 ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "The .arr file has a bad size : " << cols << " x " << rows );
+        return false;
+    }
+
+    return true;
+}
+
+// inflate the header and the whole grid with one read each
+void tgArray::parse_bin()
+{
+    int32_t header[7];
+
+    if ( gzread( array_in, header, TG_ARRAY_HEADER_SIZE ) != (int)TG_ARRAY_HEADER_SIZE ||
+         !parse_header( header ) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe .arr file header could not be read.");
+        exit(1);
+    }
 
-    sgReadInt(array_in, &cols);
-    sgReadInt(array_in, &intColStep);
-    sgReadInt(array_in, &rows);
-    sgReadInt(array_in, &intRowStep);
+    size_t count = (size_t)cols * rows;
+    in_data = new short[count];
 
-    col_step = intColStep;
-    row_step = intRowStep;
+    int bytes = gzread( array_in, in_data, count * sizeof(short) );
+    if ( bytes < (int)(count * sizeof(short)) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "The .arr file is truncated - zeroing the missing data" );
+        size_t have = ( bytes > 0 ) ? bytes / sizeof(short) : 0;
+        memset( in_data + have, 0, (count - have) * sizeof(short) );
+    }
 
-    in_data = new short[cols * rows];
-    sgReadShort(array_in, cols * rows, in_data);
+    if ( sgIsBigEndian() ) {
+        swap_shorts( in_data, count );
+    }
+}
+
+// use the mapped grid in place
+void tgArray::parse_mapped()
+{
+    if ( !parse_header( (const int32_t*)map_addr ) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe .arr file header could not be read.");
+        exit(1);
+    }
+
+    size_t count = (size_t)cols * rows;
+    if ( TG_ARRAY_HEADER_SIZE + count * sizeof(short) > map_size ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe .arr file is truncated.");
+        exit(1);
+    }
+
+    short* grid = (short*)( (char*)map_addr + TG_ARRAY_HEADER_SIZE );
+
+    if ( sgIsBigEndian() ) {
+        // swapping would touch every page anyway - take a private copy
+        in_data = new short[count];
+        memcpy( in_data, grid, count * sizeof(short) );
+        swap_shorts( in_data, count );
+
+        short* keep = in_data;
+        in_data = NULL;
+        free_data();
+        in_data = keep;
+    } else {
+        in_data = grid;
+    }
+}
+
+// The fitted file is text : a count, followed by lon lat elev triples.
+// Inflate it in one go, and pull the numbers out with strtod rather
+// than a stream.
+void tgArray::parse_fitted()
+{
+    std::vector<char> text;
+    char chunk[64 * 1024];
+    int  len;
+
+    while ( (len = gzread( fitted_in, chunk, sizeof(chunk) )) > 0 ) {
+        text.insert( text.end(), chunk, chunk + len );
+    }
+    text.push_back( '\0' );
+
+    const char* p = &text[0];
+    char* end;
+
+    long fitted_size = strtol( p, &end, 10 );
+    p = end;
+
+    fitted_list.reserve( fitted_list.size() + ( fitted_size > 0 ? fitted_size : 0 ) );
+    for ( long i = 0; i < fitted_size; ++i ) {
+        char *ex, *ey, *ez;
+        double x = strtod( p,  &ex );
+        double y = strtod( ex, &ey );
+        double z = strtod( ey, &ez );
+        if ( ex == p || ey == ex || ez == ey ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "  fitted data ended early after " << i << " of " << fitted_size << " points" );
+            break;
+        }
+        p = ez;
+
+        fitted_list.push_back( SGGeod::fromDegM(x, y, z) );
+    }
 }
 
 // write an Array file
@@ -231,125 +412,155 @@ bool tgArray::write( const string root_dir, SGBucket& b ) {
 }
 
 
-// do our best to remove voids by picking data from the nearest neighbor.
-void tgArray::remove_voids( ) {
-    // need two passes to ensure that all voids are removed (unless entire
-    // array is a void.)
-    bool have_void = true;
-    int last_elev = -32768;
-    for ( int pass = 0; pass < 2 && have_void; ++pass ) {
-        // attempt to fill in any void data horizontally
-        for ( int i = 0; i < cols; i++ ) {
-            int j;
-
-            // fill in front ways
-            last_elev = -32768;
-            have_void = false;
-            for ( j = 0; j < rows; j++ ) {
-                if ( get_array_elev(i,j) > -9000 ) {
-                    last_elev = get_array_elev(i,j) ;
-                } else if ( last_elev > -9000 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
+// Find the closest non-void grid point to every grid point with a two pass
+// nearest seed sweep (8SSEDT).  Each pass carries the seeds of the already
+// visited neighbors forward, so the whole map costs a few passes over the
+// grid, no matter how big the voids are.  Distances are in arc seconds,
+// with the columns shrunk by the cosine of the latitude.
+void tgArray::build_nearest_map( std::vector<int>& nearest ) const {
+    const int n = cols * rows;
+
+    double lat = ( originy + 0.5 * (rows - 1) * row_step ) / 3600.0;
+    double wx  = col_step * cos( lat * SGD_DEGREES_TO_RADIANS );
+    double wy  = row_step;
+
+    nearest.assign( n, -1 );
+    for ( int i = 0; i < n; i++ ) {
+        if ( in_data[i] > -9000 ) {
+            nearest[i] = i;
+        }
+    }
+
+    // forward : from the previous column, then from the previous row
+    // backward: from the next column, then from the next row
+    for ( int pass = 0; pass < 2; pass++ ) {
+        int dc = ( pass == 0 ) ? 1 : -1;
+        int c0 = ( pass == 0 ) ? 0 : cols - 1;
+
+        for ( int col = c0; col >= 0 && col < cols; col += dc ) {
+            // take the seeds of the three neighbors in the previous column,
+            // and of the previous point in this column
+            int r0 = ( pass == 0 ) ? 0 : rows - 1;
+            for ( int row = r0; row >= 0 && row < rows; row += dc ) {
+                int idx  = col * rows + row;
+                int best = nearest[idx];
+                if ( best == idx ) {
+                    continue;
                 }
-            }
-            // fill in back ways
-            last_elev = -32768;
-            have_void = false;
-            for ( j = rows - 1; j >= 0; j-- ) {
-                if ( get_array_elev(i,j) > -9000 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9000 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
+
+                double best_d = 0.0;
+                if ( best >= 0 ) {
+                    double x = ( col - best / rows ) * wx;
+                    double y = ( row - best % rows ) * wy;
+                    best_d = x*x + y*y;
                 }
-            }
-        }
 
-        // attempt to fill in any void data vertically
-        for ( int j = 0; j < rows; j++ ) {
-            int i;
-
-            // fill in front ways
-            last_elev = -32768;
-            have_void = false;
-            for ( i = 0; i < cols; i++ ) {
-                if ( get_array_elev(i,j) > -9999 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9999 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
+                for ( int k = 0; k < 4; k++ ) {
+                    int nc = col - dc;
+                    int nr = row - 1 + k;
+                    if ( k == 3 ) {
+                        nc = col;
+                        nr = row - dc;
+                    }
+                    if ( nc < 0 || nc >= cols || nr < 0 || nr >= rows ) {
+                        continue;
+                    }
+
+                    int seed = nearest[ nc * rows + nr ];
+                    if ( seed < 0 ) {
+                        continue;
+                    }
+
+                    double x = ( col - seed / rows ) * wx;
+                    double y = ( row - seed % rows ) * wy;
+                    double d = x*x + y*y;
+                    if ( best < 0 || d < best_d ) {
+                        best   = seed;
+                        best_d = d;
+                    }
                 }
+                nearest[idx] = best;
             }
 
-            // fill in back ways
-            last_elev = -32768;
-            have_void = false;
-            for ( i = cols - 1; i >= 0; i-- ) {
-                if ( get_array_elev(i,j) > -9999 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9999 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
+            // and sweep back down the column
+            r0 = ( pass == 0 ) ? rows - 2 : 1;
+            for ( int row = r0; row >= 0 && row < rows; row -= dc ) {
+                int idx  = col * rows + row;
+                int seed = nearest[idx + dc];
+                if ( seed < 0 || nearest[idx] == idx ) {
+                    continue;
                 }
+
+                int best = nearest[idx];
+                double x = ( col - seed / rows ) * wx;
+                double y = ( row - seed % rows ) * wy;
+                double d = x*x + y*y;
+
+                if ( best >= 0 ) {
+                    double bx = ( col - best / rows ) * wx;
+                    double by = ( row - best % rows ) * wy;
+                    if ( bx*bx + by*by <= d ) {
+                        continue;
+                    }
+                }
+                nearest[idx] = seed;
             }
         }
     }
+}
 
-    if ( have_void ) {
-        // after all that work we still have a void, likely the
-        // entire array is void.  Fill in the void areas with zero
-        // as a panic fall back.
-        for ( int i = 0; i < cols; i++ ) {
-            for ( int j = 0; j < rows; j++ ) {
-                if ( get_array_elev(i,j) <= -9999 ) {
-                    set_array_elev(i, j, 0);
-                }
-            }
+
+// do our best to remove voids by picking data from the nearest neighbor.
+void tgArray::remove_voids( ) {
+    std::vector<int> nearest;
+    build_nearest_map( nearest );
+
+    // every void takes the elevation of the closest real data.  If there
+    // is none, the entire array is void - fill it in with zero as a panic
+    // fall back.
+    const int n = cols * rows;
+    for ( int i = 0; i < n; i++ ) {
+        if ( nearest[i] != i ) {
+            in_data[i] = ( nearest[i] >= 0 ) ? in_data[ nearest[i] ] : 0;
         }
     }
+
+    nearest_nonvoid.clear();
 }
 
 
 // Return the elevation of the closest non-void grid point to lon, lat
 double tgArray::closest_nonvoid_elev( double lon, double lat ) const {
-    double mindist = 99999999999.9;
-    double minelev = -9999.0;
-    SGGeod p0 = SGGeod::fromDeg( lon, lat );
-
-    for ( int row = 0; row < rows; row++ ) {
-        for ( int col = 0; col < cols; col++ ) {
-            SGGeod p1 = SGGeod::fromDeg( originx + col * col_step, originy + row * row_step );
-            double dist = SGGeodesy::distanceM( p0, p1 );
-            double elev = get_array_elev(col, row);
-            if ( dist < mindist && elev > -9000 ) {
-                mindist = dist;
-                minelev = elev;
-            }
-        }
+    SGGuard<SGMutex> g( nearest_lock );
+
+    if ( nearest_nonvoid.empty() ) {
+        build_nearest_map( nearest_nonvoid );
     }
 
-    if ( minelev > -9999.0 ) {
-        return minelev;
+    int col = (int)floor( (lon - originx) / col_step + 0.5 );
+    int row = (int)floor( (lat - originy) / row_step + 0.5 );
+
+    col = SGMisc<int>::clip( col, 0, cols - 1 );
+    row = SGMisc<int>::clip( row, 0, rows - 1 );
+
+    int seed = nearest_nonvoid[ col * rows + row ];
+    if ( seed >= 0 ) {
+        return in_data[seed];
     } else {
         return 0.0;
     }
 }
 
 
-// return the current altitude based on grid data.
+// Interpolate inside the grid cell containing (xlocal, ylocal), given in
+// grid units from the origin.  Returns false if a corner of the triangle is
+// void, and sets elev to -9999 if the point is outside of the array.
 // TODO: We should rewrite this to interpolate exact values, but for now this is good enough
-double tgArray::altitude_from_grid( double lon, double lat ) const {
-    // we expect incoming (lon,lat) to be in arcsec for now
-
-    double xlocal, ylocal, dx, dy, zA, zB, elev;
-    int x1, x2, x3, y1, y2, y3;
+inline bool tgArray::interpolate( double xlocal, double ylocal, double& elev ) const {
+    double dx, dy, zA, zB;
     float z1, z2, z3;
     int xindex, yindex;
+    int idx;
 
     /* determine if we are in the lower triangle or the upper triangle
        ______
@@ -362,14 +573,9 @@ double tgArray::altitude_from_grid( double lon, double lat ) const {
        then calculate our end points
      */
 
-    xlocal = (lon - originx) / col_step;
-    ylocal = (lat - originy) / row_step;
-
     xindex = (int)(xlocal);
     yindex = (int)(ylocal);
 
-    // printf("xindex = %d  yindex = %d\n", xindex, yindex);
-
     if ( xindex + 1 == cols ) {
 	xindex--;
     }
@@ -381,93 +587,101 @@ double tgArray::altitude_from_grid( double lon, double lat ) const {
     if ( (xindex < 0) || (xindex + 1 >= cols) ||
 	 (yindex < 0) || (yindex + 1 >= rows) ) {
 	SG_LOG(SG_GENERAL, SG_DEBUG, "WARNING: Attempt to interpolate value outside of array!!!" );
-	return -9999;
+	elev = -9999;
+	return true;
     }
 
     dx = xlocal - xindex;
     dy = ylocal - yindex;
 
+    // the two triangles share the SW and NE corners
+    idx = xindex * rows + yindex;
+    z1  = in_data[idx];
+    z3  = in_data[idx + rows + 1];
+
     if ( dx > dy ) {
 	// lower triangle
+	z2 = in_data[idx + rows];
+    } else {
+	// upper triangle : same as the lower one, with x and y swapped
+	z2 = in_data[idx + 1];
 
-	x1 = xindex;
-	y1 = yindex;
-	z1 = get_array_elev(x1, y1);
-
-	x2 = xindex + 1;
-	y2 = yindex;
-	z2 = get_array_elev(x2, y2);
-
-	x3 = xindex + 1;
-	y3 = yindex + 1;
-	z3 = get_array_elev(x3, y3);
+	double t = dx;
+	dx = dy;
+	dy = t;
+    }
 
-        if ( z1 < -9000 || z2 < -9000 || z3 < -9000 ) {
-            // don't interpolate off a void
-            return closest_nonvoid_elev( lon, lat );
-        }
+    if ( z1 < -9000 || z2 < -9000 || z3 < -9000 ) {
+        // don't interpolate off a void
+        return false;
+    }
 
-	zA = dx * (z2 - z1) + z1;
-	zB = dx * (z3 - z1) + z1;
+    zA = dx * (z2 - z1) + z1;
+    zB = dx * (z3 - z1) + z1;
 
-	if ( dx > SG_EPSILON ) {
-	    elev = dy * (zB - zA) / dx + zA;
-	} else {
-	    elev = zA;
-	}
+    if ( dx > SG_EPSILON ) {
+	elev = dy * (zB - zA) / dx + zA;
     } else {
-	// upper triangle
-
-	x1 = xindex;
-	y1 = yindex;
-	z1 = get_array_elev(x1, y1);
-
-	x2 = xindex;
-	y2 = yindex + 1;
-	z2 = get_array_elev(x2, y2);
+	elev = zA;
+    }
 
-	x3 = xindex + 1;
-	y3 = yindex + 1;
-	z3 = get_array_elev(x3, y3);
+    return true;
+}
 
-        if ( z1 < -9000 || z2 < -9000 || z3 < -9000 ) {
-            // don't interpolate off a void
-            return closest_nonvoid_elev( lon, lat );
-        }
 
-	zA = dy * (z2 - z1) + z1;
-	zB = dy * (z3 - z1) + z1;
+// return the current altitude based on grid data.
+double tgArray::altitude_from_grid( double lon, double lat ) const {
+    // we expect incoming (lon,lat) to be in arcsec for now
+    double elev;
 
-	if ( dy > SG_EPSILON ) {
-	    elev = dx * (zB - zA) / dy    + zA;
-	} else {
-	    elev = zA;
-	}
+    if ( !interpolate( (lon - originx) / col_step, (lat - originy) / row_step, elev ) ) {
+        return closest_nonvoid_elev( lon, lat );
     }
 
     return elev;
 }
 
 
-tgArray::~tgArray( void )
-{
-    if (in_data) {
-        delete[] in_data;
-        in_data = NULL;
+// return the current altitude of a list of points (in degrees).  The grid
+// coordinates are worked out for the whole list first, so that loop is
+// plain arithmetic the compiler can vectorize.  The few points next to a
+// void are looked up at the end.
+void tgArray::altitude_from_grid( const std::vector<SGGeod>& pos, std::vector<double>& elev ) const {
+    const unsigned int count = pos.size();
+    std::vector<double> xlocal( count );
+    std::vector<double> ylocal( count );
+    std::vector<unsigned int> voids;
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        xlocal[i] = pos[i].getLongitudeDeg() * 3600.0;
+        ylocal[i] = pos[i].getLatitudeDeg()  * 3600.0;
+    }
+    for ( unsigned int i = 0; i < count; i++ ) {
+        xlocal[i] = (xlocal[i] - originx) / col_step;
+        ylocal[i] = (ylocal[i] - originy) / row_step;
     }
 
-    if (array_in) {
-        gzclose(array_in);
-        array_in = NULL;
+    elev.resize( count );
+    for ( unsigned int i = 0; i < count; i++ ) {
+        if ( !interpolate( xlocal[i], ylocal[i], elev[i] ) ) {
+            voids.push_back( i );
+        }
     }
 
-    if (fitted_in ) {
-        fitted_in->close();
-        delete fitted_in;
-        fitted_in = NULL;
+    for ( unsigned int i = 0; i < voids.size(); i++ ) {
+        SGGeod const& p = pos[ voids[i] ];
+        elev[ voids[i] ] = closest_nonvoid_elev( p.getLongitudeDeg() * 3600.0,
+                                                 p.getLatitudeDeg()  * 3600.0 );
     }
 }
 
+
+tgArray::~tgArray( void )
+{
+    close();
+    free_data();
+}
+
 int tgArray::get_array_elev( int col, int row ) const
 {
     return in_data[(col * rows) + row];
@@ -476,13 +690,103 @@ int tgArray::get_array_elev( int col, int row ) const
 void tgArray::set_array_elev( int col, int row, int val )
 {
     in_data[(col * rows) + row] = val;
+    nearest_nonvoid.clear();
 }
 
 bool tgArray::is_open() const
 {
-  if ( array_in != NULL ) {
+  if ( array_in != NULL || map_addr != NULL ) {
       return true;
   } else {
       return false;
   }
 }
+
+
+tgArrayWriter::tgArrayWriter( int originx, int originy,
+                              int cols, int col_step,
+                              int r, int row_step ) :
+  rows(r),
+  data( (size_t)cols * r, 0 )
+{
+    header[0] = TG_ARRAY_MAGIC;
+    header[1] = originx;
+    header[2] = originy;
+    header[3] = cols;
+    header[4] = col_step;
+    header[5] = rows;
+    header[6] = row_step;
+}
+
+bool tgArrayWriter::write( const string& base, int compression ) const
+{
+    int32_t h[7];
+    const short* grid = data.empty() ? NULL : &data[0];
+    std::vector<short> swapped;
+
+    memcpy( h, header, sizeof(h) );
+    if ( sgIsBigEndian() ) {
+        for ( int i = 0; i < 7; i++ ) {
+            sgEndianSwap( (uint32_t*)&h[i] );
+        }
+
+        swapped = data;
+        if ( !swapped.empty() ) {
+            swap_shorts( &swapped[0], swapped.size() );
+            grid = &swapped[0];
+        }
+    }
+
+    size_t grid_bytes = data.size() * sizeof(short);
+    string file, other;
+    bool   ok;
+
+    if ( compression > 0 ) {
+        file  = base + ".arr.gz";
+        other = base + ".arr";
+
+        char mode[8];
+        sprintf( mode, "wb%d", compression > 9 ? 9 : compression );
+
+        gzFile fp = gzopen( file.c_str(), mode );
+        if ( fp == NULL ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "cannot open " << file << " for writing!");
+            return false;
+        }
+
+        ok = ( gzwrite( fp, h, sizeof(h) ) == (int)sizeof(h) );
+        if ( ok && grid_bytes ) {
+            ok = ( gzwrite( fp, grid, grid_bytes ) == (int)grid_bytes );
+        }
+        if ( gzclose( fp ) != Z_OK ) {
+            ok = false;
+        }
+    } else {
+        file  = base + ".arr";
+        other = base + ".arr.gz";
+
+        FILE* fp = fopen( file.c_str(), "wb" );
+        if ( fp == NULL ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "cannot open " << file << " for writing!");
+            return false;
+        }
+
+        ok = ( fwrite( h, sizeof(h), 1, fp ) == 1 );
+        if ( ok && grid_bytes ) {
+            ok = ( fwrite( grid, grid_bytes, 1, fp ) == 1 );
+        }
+        if ( fclose( fp ) != 0 ) {
+            ok = false;
+        }
+    }
+
+    if ( !ok ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "error writing " << file);
+        return false;
+    }
+
+    // tgArray prefers the .arr, so a stale one would hide a new .arr.gz
+    ::remove( other.c_str() );
+
+    return true;
+}
@@ -27,6 +27,19 @@
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/math/sg_types.hxx>
 #include <simgear/misc/sgstream.hxx>
+#include <simgear/misc/stdint.hxx>
+#include <simgear/threads/SGThread.hxx>
+
+// Array files come in two flavors :
+//   .arr.gz : the usual gzipped grid, inflated with a single bulk read
+//   .arr    : the same layout uncompressed.  It is mapped copy on write,
+//             so the pages are shared between every process (and thread)
+//             reading the same tile until someone fills a void in them.
+// Both are a 'TGAR' header of seven little endian int32s (magic, origin x,
+// origin y, cols, col step, rows, row step), followed by the column major
+// grid of little endian int16s.
+#define TG_ARRAY_MAGIC          (0x54474152)
+#define TG_ARRAY_HEADER_SIZE    (7 * sizeof(int32_t))
 
 class tgArray {
 
@@ -34,7 +47,11 @@ private:
     gzFile array_in;
 
     // fitted file pointer
-    sg_gzifstream *fitted_in;
+    gzFile fitted_in;
+
+    // mapped uncompressed array file
+    void*  map_addr;
+    size_t map_size;
 
     // coordinates (in arc seconds) of south west corner
     double originx, originy;
@@ -52,7 +69,22 @@ private:
     std::vector<SGGeod> corner_list;
     std::vector<SGGeod> fitted_list;
 
+    // index of the closest non-void grid point to each grid point (-1 if
+    // the whole grid is void).  Built on the first closest_nonvoid_elev
+    // query, and dropped whenever the grid changes.
+    mutable std::vector<int> nearest_nonvoid;
+    mutable SGMutex          nearest_lock;
+
+    void build_nearest_map( std::vector<int>& nearest ) const;
+
+    bool interpolate( double xlocal, double ylocal, double& elev ) const;
+
+    bool map_array( const std::string& file );
+    bool parse_header( const int32_t* header );
     void parse_bin();
+    void parse_mapped();
+    void parse_fitted();
+    void free_data();
 public:
 
     // Constructor
@@ -82,6 +114,7 @@ public:
     void remove_voids();
 
     // Return the elevation of the closest non-void grid point to lon, lat
+    // (in arc seconds)
     double closest_nonvoid_elev( double lon, double lat ) const;
 
     // return the current altitude based on grid data.  We should
@@ -89,6 +122,10 @@ public:
     // good enough
     double altitude_from_grid( double lon, double lat ) const;
 
+    // the same for a whole list of positions (in degrees) at once.  Gives
+    // exactly the same elevations as one call per point.
+    void altitude_from_grid( const std::vector<SGGeod>& pos, std::vector<double>& elev ) const;
+
     // Informational methods
     inline double get_originx() const { return originx; }
     inline double get_originy() const { return originy; }
@@ -107,4 +144,32 @@ public:
     void unload( void );
 };
 
+// Writes array files for the chop tools.  The grid is filled in column
+// major order, like tgArray keeps it, then written out with a single call.
+class tgArrayWriter {
+
+public:
+    tgArrayWriter( int originx, int originy,
+                   int cols, int col_step,
+                   int rows, int row_step );
+
+    inline void set_elev( int col, int row, short elev ) {
+        data[col * rows + row] = elev;
+    }
+
+    // compression is a zlib level.  1 - 9 write <base>.arr.gz, 0 writes an
+    // uncompressed <base>.arr that tgArray maps rather than reads.  The
+    // other flavor of the same tile is removed, so it can't shadow this one.
+    bool write( const std::string& base, int compression ) const;
+
+private:
+    int32_t header[7];
+    int rows;
+    std::vector<short> data;
+};
+
+// maximum compression barely shrinks elevation data, and costs several
+// times the cpu of the default level
+#define TG_ARRAY_DEFAULT_COMPRESSION    (6)
+
 #endif // _TG_ARRAY_HXX
@@ -0,0 +1,154 @@
+// tg_array_cache.cxx -- process wide cache of parsed elevation arrays
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGGuard.hxx>
+
+#include "tg_array_cache.hxx"
+
+tgArrayCache& tgArrayCache::instance( void )
+{
+    // function static, so it exists before any thread can ask for it
+    static tgArrayCache cache( (size_t)TG_ARRAY_CACHE_DEFAULT_MB * 1024 * 1024 );
+    return cache;
+}
+
+tgArrayCache::tgArrayCache( size_t max ) :
+        max_bytes(max),
+        cur_bytes(0),
+        hits(0),
+        misses(0)
+{
+}
+
+size_t tgArrayCache::EstimateSize( const tgArray& a )
+{
+    // the grid, plus the nearest non void map - that one is built lazily by
+    // the first closest_nonvoid_elev lookup, once the array is in the cache
+    return sizeof(tgArray) +
+           (size_t)a.get_cols() * a.get_rows() * ( sizeof(short) + sizeof(int) ) +
+           ( a.get_corner_list().size() + a.get_fitted_list().size() ) * sizeof(SGGeod);
+}
+
+// must be called with the lock held
+void tgArrayCache::Evict( void )
+{
+    while ( cur_bytes > max_bytes && !lru.empty() ) {
+        std::map<Key, Entry>::iterator it = entries.find( lru.back() );
+
+        // anyone still using the array keeps their reference
+        cur_bytes -= it->second.bytes;
+        entries.erase( it );
+        lru.pop_back();
+    }
+}
+
+tgArrayRef tgArrayCache::Get( const string_list& dirs, const SGBucket& b )
+{
+    std::string dir_key;
+    for (unsigned int i=0; i<dirs.size(); i++) {
+        dir_key += dirs[i];
+        dir_key += ';';
+    }
+    Key key( dir_key, b.gen_index() );
+
+    {
+        SGGuard<SGMutex> g( lock );
+
+        std::map<Key, Entry>::iterator it;
+        while ( (it = entries.find( key )) != entries.end() && it->second.loading ) {
+            loaded.wait( lock );
+        }
+
+        if ( it != entries.end() ) {
+            hits++;
+            lru.splice( lru.begin(), lru, it->second.lru );
+            return it->second.array;
+        }
+
+        // claim it, so other threads wait for us rather than parsing it too
+        misses++;
+        entries[key].loading = true;
+    }
+
+    // load it outside of the lock
+    tgArray* array = new tgArray();
+    std::string base = b.gen_base_path() + "/" + b.gen_index_str();
+
+    for (unsigned int i=0; i<dirs.size(); i++) {
+        std::string array_path = dirs[i] + "/" + base;
+
+        if ( array->open(array_path) ) {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Using array_path = " << array_path );
+            break;
+        }
+    }
+
+    // this will fill in a zero structure if no array data found/opened
+    SGBucket bucket( b );
+    array->parse( bucket );
+    array->remove_voids();
+    array->close();
+
+    tgArrayRef ref( array );
+
+    SGGuard<SGMutex> g( lock );
+
+    Entry& e  = entries[key];
+    e.array   = ref;
+    e.bytes   = EstimateSize( *array );
+    e.loading = false;
+
+    lru.push_front( key );
+    e.lru = lru.begin();
+    cur_bytes += e.bytes;
+
+    Evict();
+    loaded.broadcast();
+
+    return ref;
+}
+
+void tgArrayCache::SetMaxBytes( size_t bytes )
+{
+    SGGuard<SGMutex> g( lock );
+
+    max_bytes = bytes;
+    Evict();
+}
+
+unsigned int tgArrayCache::GetHits( void )
+{
+    SGGuard<SGMutex> g( lock );
+    return hits;
+}
+
+unsigned int tgArrayCache::GetMisses( void )
+{
+    SGGuard<SGMutex> g( lock );
+    return misses;
+}
+
+void tgArrayCache::PrintStats( void )
+{
+    SGGuard<SGMutex> g( lock );
+
+    SG_LOG(SG_GENERAL, SG_ALERT, "Elevation cache: " << hits << " hits, " << misses << " misses, " << entries.size() << " arrays in " << cur_bytes / (1024*1024) << " of " << max_bytes / (1024*1024) << " MB" );
+}
@@ -0,0 +1,93 @@
+// tg_array_cache.hxx -- process wide cache of parsed elevation arrays
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_ARRAY_CACHE_HXX
+#define _TG_ARRAY_CACHE_HXX
+
+#ifndef __cplusplus
+# error This library requires C++
+#endif
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <simgear/compiler.h>
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/math/sg_types.hxx>
+#include <simgear/threads/SGThread.hxx>
+
+#include "tg_array.hxx"
+
+// Arrays handed out by the cache are parsed, void filled, and never
+// modified again, so any number of threads can read them at once.  They
+// stay valid for as long as someone holds a reference, even after the
+// cache has dropped them.
+typedef boost::shared_ptr<const tgArray> tgArrayRef;
+
+#define TG_ARRAY_CACHE_DEFAULT_MB   (256)
+
+class tgArrayCache
+{
+public:
+    // the cache shared by every thread in the process
+    static tgArrayCache& instance( void );
+
+    // Return the array of bucket b from the first of the elevation
+    // directories that has one.  A bucket without any elevation data gets
+    // the zero'd array from tgArray::parse.
+    tgArrayRef Get( const string_list& dirs, const SGBucket& b );
+
+    // arrays not in use are dropped, least recently used first, to keep
+    // the cache under this size
+    void SetMaxBytes( size_t bytes );
+
+    unsigned int GetHits( void );
+    unsigned int GetMisses( void );
+    void PrintStats( void );
+
+private:
+    tgArrayCache( size_t max_bytes );
+
+    typedef std::pair<std::string, long> Key;
+
+    struct Entry {
+        tgArrayRef                  array;
+        size_t                      bytes;
+        bool                        loading;    // another thread is parsing it
+        std::list<Key>::iterator    lru;
+    };
+
+    static size_t EstimateSize( const tgArray& a );
+
+    // must be called with the lock held
+    void Evict( void );
+
+    std::map<Key, Entry>    entries;
+    std::list<Key>          lru;        // most recently used first
+
+    size_t          max_bytes;
+    size_t          cur_bytes;
+    unsigned int    hits;
+    unsigned int    misses;
+
+    SGMutex         lock;
+    SGWaitCondition loaded;
+};
+
+#endif // _TG_ARRAY_CACHE_HXX
@@ -0,0 +1,317 @@
+// tg_binfile.cxx -- versioned binary container for intermediate data
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+
+#include "tg_binfile.hxx"
+
+struct tgBinFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bom;
+    uint32_t compression;
+    uint64_t raw_size;          // body size, including the string table
+    uint64_t stored_size;       // body size on disk
+    uint64_t strings_offset;    // start of the string table in the body
+};
+
+uint32_t tgBinFileWriter::AddString( const std::string& s )
+{
+    std::map<std::string, uint32_t>::const_iterator it = string_index.find( s );
+    if ( it != string_index.end() ) {
+        return it->second;
+    }
+
+    uint32_t idx = strings.size();
+    strings.push_back( s );
+    string_index[s] = idx;
+
+    return idx;
+}
+
+void tgBinFileWriter::Append( const void* data, size_t size )
+{
+    const char* p = (const char*)data;
+    payload.insert( payload.end(), p, p + size );
+}
+
+bool tgBinFileWriter::Save( const std::string& path, int compression ) const
+{
+    // body is the payload, followed by the string table
+    std::vector<char> body( payload );
+
+    uint32_t count = strings.size();
+    body.insert( body.end(), (const char*)&count, (const char*)&count + sizeof(count) );
+    for (unsigned int i=0; i<strings.size(); i++) {
+        uint32_t len = strings[i].size();
+        body.insert( body.end(), (const char*)&len, (const char*)&len + sizeof(len) );
+        body.insert( body.end(), strings[i].begin(), strings[i].end() );
+    }
+
+    tgBinFileHeader hdr;
+    hdr.magic          = TG_BINFILE_MAGIC;
+    hdr.version        = TG_BINFILE_VERSION;
+    hdr.bom            = TG_BINFILE_BOM;
+    hdr.compression    = compression;
+    hdr.raw_size       = body.size();
+    hdr.strings_offset = payload.size();
+
+    std::vector<Bytef> packed;
+    const char* out      = body.empty() ? NULL : &body[0];
+    size_t      out_size = body.size();
+
+    if ( compression > 0 && !body.empty() ) {
+        uLongf packed_size = compressBound( body.size() );
+        packed.resize( packed_size );
+
+        if ( compress2( &packed[0], &packed_size, (const Bytef*)&body[0], body.size(), compression ) != Z_OK ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgBinFileWriter: compression failed for " << path );
+            return false;
+        }
+
+        out      = (const char*)&packed[0];
+        out_size = packed_size;
+    }
+    hdr.stored_size = out_size;
+
+    FILE* fp = fopen( path.c_str(), "wb" );
+    if ( !fp ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << path << " for writing!" );
+        return false;
+    }
+
+    bool ok = ( fwrite( &hdr, sizeof(hdr), 1, fp ) == 1 );
+    if ( ok && out_size ) {
+        ok = ( fwrite( out, out_size, 1, fp ) == 1 );
+    }
+    if ( fclose( fp ) != 0 ) {
+        ok = false;
+    }
+
+    if ( !ok ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: writing " << path );
+    }
+
+    return ok;
+}
+
+tgBinFileReader::tgBinFileReader() :
+        data(NULL),
+        data_size(0),
+        pos(0),
+        map_addr(NULL),
+        map_size(0),
+        ok(false)
+{
+}
+
+tgBinFileReader::~tgBinFileReader()
+{
+    Close();
+}
+
+bool tgBinFileReader::IsBinFile( const std::string& path )
+{
+    uint32_t magic = 0;
+
+    FILE* fp = fopen( path.c_str(), "rb" );
+    if ( !fp ) {
+        return false;
+    }
+    size_t num = fread( &magic, sizeof(magic), 1, fp );
+    fclose( fp );
+
+    return ( num == 1 && magic == TG_BINFILE_MAGIC );
+}
+
+void tgBinFileReader::Close( void )
+{
+#ifndef _WIN32
+    if ( map_addr ) {
+        munmap( map_addr, map_size );
+    }
+#endif
+    map_addr  = NULL;
+    map_size  = 0;
+
+    buffer.clear();
+    strings.clear();
+
+    data      = NULL;
+    data_size = 0;
+    pos       = 0;
+    ok        = false;
+}
+
+bool tgBinFileReader::Open( const std::string& path )
+{
+    const char* file_data = NULL;
+    size_t      file_size = 0;
+
+    Close();
+
+#ifndef _WIN32
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+        void* addr = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( addr != MAP_FAILED ) {
+            map_addr  = addr;
+            map_size  = st.st_size;
+            file_data = (const char*)addr;
+            file_size = st.st_size;
+        }
+    }
+    close( fd );
+#endif
+
+    if ( !file_data ) {
+        // no mmap, or it failed - read the whole file instead
+        FILE* fp = fopen( path.c_str(), "rb" );
+        if ( !fp ) {
+            return false;
+        }
+        fseek( fp, 0, SEEK_END );
+        long len = ftell( fp );
+        fseek( fp, 0, SEEK_SET );
+        if ( len > 0 ) {
+            buffer.resize( len );
+            if ( fread( &buffer[0], len, 1, fp ) == 1 ) {
+                file_data = &buffer[0];
+                file_size = len;
+            }
+        }
+        fclose( fp );
+    }
+
+    if ( !file_data || file_size < sizeof(tgBinFileHeader) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgBinFileReader: can't read " << path );
+        Close();
+        return false;
+    }
+
+    tgBinFileHeader hdr;
+    memcpy( &hdr, file_data, sizeof(hdr) );
+
+    if ( hdr.magic != TG_BINFILE_MAGIC || hdr.bom != TG_BINFILE_BOM ||
+         hdr.version != TG_BINFILE_VERSION ||
+         hdr.strings_offset > hdr.raw_size ||
+         sizeof(hdr) + hdr.stored_size > file_size ||
+         ( hdr.compression == 0 && hdr.stored_size != hdr.raw_size ) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgBinFileReader: " << path << " has a bad header, or was written on a different architecture" );
+        Close();
+        return false;
+    }
+
+    const char* stored = file_data + sizeof(hdr);
+
+    if ( hdr.compression == 0 ) {
+        // use the file data directly
+        data = stored;
+    } else {
+        std::vector<char> inflated( hdr.raw_size );
+        uLongf raw_size = hdr.raw_size;
+
+        if ( hdr.raw_size &&
+             ( uncompress( (Bytef*)&inflated[0], &raw_size, (const Bytef*)stored, hdr.stored_size ) != Z_OK ||
+               raw_size != hdr.raw_size ) ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgBinFileReader: can't inflate " << path );
+            Close();
+            return false;
+        }
+
+        // done with the file itself
+#ifndef _WIN32
+        if ( map_addr ) {
+            munmap( map_addr, map_size );
+            map_addr = NULL;
+            map_size = 0;
+        }
+#endif
+        buffer.swap( inflated );
+        data = buffer.empty() ? NULL : &buffer[0];
+    }
+
+    // load the string table
+    data_size = hdr.raw_size;
+    pos       = hdr.strings_offset;
+    ok        = true;
+
+    uint32_t count = ReadUInt();
+    for (uint32_t i=0; i<count && ok; i++) {
+        uint32_t len = ReadUInt();
+        if ( pos + len > data_size ) {
+            ok = false;
+            break;
+        }
+        strings.push_back( std::string( data + pos, len ) );
+        pos += len;
+    }
+
+    if ( !ok ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgBinFileReader: " << path << " has a bad string table" );
+        Close();
+        return false;
+    }
+
+    // and rewind to the records
+    data_size = hdr.strings_offset;
+    pos       = 0;
+
+    return true;
+}
+
+bool tgBinFileReader::Extract( void* dst, size_t size )
+{
+    if ( !ok || pos + size > data_size ) {
+        ok = false;
+        return false;
+    }
+
+    memcpy( dst, data + pos, size );
+    pos += size;
+
+    return true;
+}
+
+std::string const& tgBinFileReader::GetString( uint32_t idx ) const
+{
+    static const std::string empty;
+
+    if ( idx < strings.size() ) {
+        return strings[idx];
+    }
+    return empty;
+}
@@ -0,0 +1,181 @@
+// tg_binfile.hxx -- versioned binary container for intermediate data
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_BINFILE_HXX
+#define _TG_BINFILE_HXX
+
+#ifndef __cplusplus
+# error This library requires C++
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/misc/stdint.hxx>
+#include <simgear/math/SGMath.hxx>
+
+// File layout :
+//   header  : magic, version, byte order mark, compression level,
+//             raw body size, stored body size, string table offset
+//   body    : the records written by the caller, followed by the string
+//             table.  Arrays are stored as a count, followed by the
+//             contiguous records, so they can be pulled in with one copy.
+//
+// With compression 0, the body is stored as is, and the reader maps the
+// file instead of reading it (falling back to a plain read if it can't).
+// Otherwise the body is a single zlib stream that is inflated with one
+// call - level 1 is plenty for files that are thrown away at the end of
+// the run.
+#define TG_BINFILE_MAGIC        (0x46424754)    // "TGBF"
+#define TG_BINFILE_VERSION      (1)
+#define TG_BINFILE_BOM          (0x01020304)
+
+// Plain records for the contiguous arrays
+struct tgBinGeod {
+    double lon;
+    double lat;
+    double elev;
+
+    static tgBinGeod fromGeod( const SGGeod& g ) {
+        tgBinGeod b;
+        b.lon  = g.getLongitudeDeg();
+        b.lat  = g.getLatitudeDeg();
+        b.elev = g.getElevationM();
+        return b;
+    }
+    SGGeod toGeod( void ) const {
+        return SGGeod::fromDegM( lon, lat, elev );
+    }
+};
+
+struct tgBinVec3f {
+    float x;
+    float y;
+    float z;
+
+    static tgBinVec3f fromVec3f( const SGVec3f& v ) {
+        tgBinVec3f b;
+        b.x = v.x();
+        b.y = v.y();
+        b.z = v.z();
+        return b;
+    }
+    SGVec3f toVec3f( void ) const {
+        return SGVec3f( x, y, z );
+    }
+};
+
+class tgBinFileWriter
+{
+public:
+    tgBinFileWriter() {}
+
+    // strings are stored once, and referenced by index
+    uint32_t AddString( const std::string& s );
+
+    void WriteUInt( uint32_t v ) {
+        Append( &v, sizeof(v) );
+    }
+    void WriteInt( int32_t v ) {
+        Append( &v, sizeof(v) );
+    }
+
+    // T must be a plain record
+    template <class T>
+    void WriteArray( const std::vector<T>& a ) {
+        WriteUInt( a.size() );
+        if ( !a.empty() ) {
+            Append( &a[0], a.size() * sizeof(T) );
+        }
+    }
+
+    // compression is a zlib level : 0 for none (mappable), 1 for fast
+    bool Save( const std::string& path, int compression ) const;
+
+private:
+    void Append( const void* data, size_t size );
+
+    std::vector<char>               payload;
+    std::vector<std::string>        strings;
+    std::map<std::string, uint32_t> string_index;
+};
+
+class tgBinFileReader
+{
+public:
+    tgBinFileReader();
+    ~tgBinFileReader();
+
+    // quick check of the magic - lets callers fall back to the gz format
+    static bool IsBinFile( const std::string& path );
+
+    bool Open( const std::string& path );
+    void Close( void );
+
+    uint32_t ReadUInt( void ) {
+        uint32_t v = 0;
+        Extract( &v, sizeof(v) );
+        return v;
+    }
+    int32_t ReadInt( void ) {
+        int32_t v = 0;
+        Extract( &v, sizeof(v) );
+        return v;
+    }
+
+    template <class T>
+    bool ReadArray( std::vector<T>& a ) {
+        uint32_t count = ReadUInt();
+
+        // check the count against what's left before allocating - a bad
+        // file shouldn't be able to ask for gigabytes
+        if ( !ok || count > ( data_size - pos ) / sizeof(T) ) {
+            ok = false;
+            a.clear();
+            return false;
+        }
+
+        a.resize( count );
+        if ( count ) {
+            return Extract( &a[0], count * sizeof(T) );
+        }
+        return ok;
+    }
+
+    std::string const& GetString( uint32_t idx ) const;
+
+    // false once any read ran off the end of the data
+    bool IsOk( void ) const { return ok; }
+
+private:
+    bool Extract( void* dst, size_t size );
+
+    const char*         data;       // the body - mapped or inflated
+    size_t              data_size;  // size of the records (without strings)
+    size_t              pos;
+
+    std::vector<char>   buffer;     // file contents when not mapped, or the inflated body
+
+    void*               map_addr;
+    size_t              map_size;
+
+    std::vector<std::string> strings;
+    bool                ok;
+};
+
+#endif // _TG_BINFILE_HXX
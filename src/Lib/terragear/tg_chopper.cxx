@@ -1,15 +1,95 @@
-#include <boost/interprocess/sync/scoped_lock.hpp>
-#include <boost/interprocess/sync/named_mutex.hpp>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#  include <io.h>
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
 
 #include <simgear/debug/logstream.hxx>
 #include <simgear/structure/exception.hxx>
 #include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/sg_dir.hxx>
 #include <simgear/io/lowlevel.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include "tg_chopper.hxx"
 #include "tg_shapefile.hxx"
 #include "tg_misc.hxx"
 
+// bucket file numbers handed out by this process.  They are prefixed with
+// the pid, so earlier runs and other processes writing to the same work dir
+// don't share our numbers - the files are still created exclusively, in
+// case an old run had the same pid.
+static long int next_file_index = 1;
+static unsigned int next_spill_dir = 0;
+static SGMutex  file_index_lock;
+
+// ranges of more buckets than this are split in half at a bucket boundary
+// first, so each clip works on a smaller piece of the subject
+#define TG_CHOP_SPLIT_MIN   (4)
+
+// clip rectangle in degrees
+static tgPolygon ClipRect( double min_lon, double min_lat, double max_lon, double max_lat )
+{
+    tgPolygon rect;
+
+    rect.AddNode( 0, SGGeod::fromDeg( min_lon, min_lat ) );
+    rect.AddNode( 0, SGGeod::fromDeg( max_lon, min_lat ) );
+    rect.AddNode( 0, SGGeod::fromDeg( max_lon, max_lat ) );
+    rect.AddNode( 0, SGGeod::fromDeg( min_lon, max_lat ) );
+
+    return rect;
+}
+
+// intersection drops everything but the geometry
+static void CopyAttributes( tgPolygon& piece, const tgPolygon& subject, double center_lat, const std::string& type )
+{
+    if ( subject.GetPreserve3D() ) {
+        piece.InheritElevations( subject );
+        piece.SetPreserve3D( true );
+    }
+    piece.SetTexParams( subject.GetTexParams() );
+    if ( subject.GetTexMethod() == TG_TEX_BY_GEODE ) {
+        // need to set center latitude for geodetic texturing
+        piece.SetTexMethod( TG_TEX_BY_GEODE, center_lat );
+    }
+    piece.SetFlag(type);
+}
+
+tgChopper::~tgChopper()
+{
+    // chunks left over when Save was never called
+    bucket_chunks_map::iterator it;
+    for (it = chunks.begin(); it != chunks.end(); it++) {
+        for (unsigned int i=0; i<it->second.size(); i++) {
+            ::remove( it->second[i].file.c_str() );
+        }
+    }
+
+    if ( !spill_path.empty() ) {
+        simgear::Dir( spill_path ).remove();
+    }
+}
+
+// rough size of a clipped poly - we just need to stay in the
+// neighborhood of the ceiling
+size_t tgChopper::EstimateSize( const tgPolygon& poly )
+{
+    return sizeof(tgPolygon) +
+           poly.Contours()   * sizeof(tgContour) +
+           poly.TotalNodes() * sizeof(SGGeod) +
+           poly.GetFlag().size();
+}
+
 tgPolygon tgChopper::Clip( const tgPolygon& subject,
                       const std::string& type,
                       SGBucket& b )
@@ -24,20 +104,40 @@ tgPolygon tgChopper::Clip( const tgPolygon& subject,
 
     result = tgPolygon::Intersect( subject, base );    
     if ( result.Contours() > 0 ) {
-        if ( subject.GetPreserve3D() ) {
-            result.InheritElevations( subject );
-            result.SetPreserve3D( true );
-        }
-        result.SetTexParams( subject.GetTexParams() );
-        if ( subject.GetTexMethod() == TG_TEX_BY_GEODE ) {
-            // need to set center latitude for geodetic texturing
-            result.SetTexMethod( TG_TEX_BY_GEODE, b.get_center_lat() );
-        }
-        result.SetFlag(type);
+        CopyAttributes( result, subject, b.get_center_lat(), type );
+
+        size_t           bytes = EstimateSize( result );
+        bucket_polys_map spilled;
+        unsigned int     spill = 0;
 
         lock.lock();
         bp_map[b.gen_index()].push_back( result );
+        cur_bytes += bytes;
+
+        if ( max_bytes && cur_bytes > max_bytes ) {
+            // over the ceiling - take everything, and write it out
+            // after releasing the lock
+            spilled.swap( bp_map );
+            cur_bytes = 0;
+            spill = ++num_spills;
+
+            if ( spill_path.empty() ) {
+                char dir_name[64];
+
+                file_index_lock.lock();
+                sprintf( dir_name, "/chop-spill-%ld-%d-%u", (long)time(NULL), (int)getpid(), next_spill_dir++ );
+                file_index_lock.unlock();
+
+                spill_path = root_path + dir_name;
+                SGPath sgp( spill_path + "/dummy" );
+                sgp.create_dir( 0755 );
+            }
+        }
         lock.unlock();
+
+        if ( spill ) {
+            Spill( spilled, spill );
+        }
     }
 
     return result;
@@ -57,9 +157,76 @@ void tgChopper::ClipRow( const tgPolygon& subject, const double& center_lat, con
     sgBucketDiff(b_min, b_max, &dx, &dy);
     SGBucket start = SGBucket(SGGeod::fromDeg( b_min.get_center_lon(), center_lat ));
 
-    for ( int i = 0; i <= dx; ++i ) {
-        SGBucket b_cur = start.sibling(i, 0);
-        Clip( subject, type, b_cur );
+    ClipColumns( subject, start, 0, dx, type );
+}
+
+// clip the subject into buckets lo to hi of the row starting at start.  Wide
+// ranges are halved at a bucket boundary, so a subject spanning n buckets is
+// clipped in about log(n) rounds of ever smaller pieces, instead of n times
+// in full.
+void tgChopper::ClipColumns( const tgPolygon& subject, const SGBucket& start, int lo, int hi, const std::string& type )
+{
+    if ( hi - lo < TG_CHOP_SPLIT_MIN ) {
+        for ( int i = lo; i <= hi; ++i ) {
+            SGBucket b_cur = start.sibling(i, 0);
+            Clip( subject, type, b_cur );
+        }
+        return;
+    }
+
+    int       mid   = (lo + hi) / 2;
+    SGBucket  b_mid = start.sibling(mid, 0);
+    double    split = b_mid.get_center_lon() + b_mid.get_width() / 2.0;
+
+    tgPolygon west = tgPolygon::Intersect( subject, ClipRect( -180.0, -90.0, split, 90.0 ) );
+    if ( west.TotalNodes() > 0 ) {
+        CopyAttributes( west, subject, start.get_center_lat(), type );
+        ClipColumns( west, start, lo, mid, type );
+    }
+
+    tgPolygon east = tgPolygon::Intersect( subject, ClipRect( split, -90.0, 180.0, 90.0 ) );
+    if ( east.TotalNodes() > 0 ) {
+        CopyAttributes( east, subject, start.get_center_lat(), type );
+        ClipColumns( east, start, mid+1, hi, type );
+    }
+}
+
+// same for rows lo to hi above b_min : halve wide ranges, and clip each
+// row of the remaining ones out of the subject.
+void tgChopper::ClipRows( const tgPolygon& subject, const SGBucket& b_min, int lo, int hi, const std::string& type )
+{
+    if ( hi - lo >= TG_CHOP_SPLIT_MIN ) {
+        int       mid   = (lo + hi) / 2;
+        double    split = b_min.sibling(0, mid).get_center_lat() + SG_HALF_BUCKET_SPAN;
+
+        tgPolygon south = tgPolygon::Intersect( subject, ClipRect( -180.0, -90.0, 180.0, split ) );
+        if ( south.TotalNodes() > 0 ) {
+            CopyAttributes( south, subject, b_min.get_center_lat(), type );
+            ClipRows( south, b_min, lo, mid, type );
+        }
+
+        tgPolygon north = tgPolygon::Intersect( subject, ClipRect( -180.0, split, 180.0, 90.0 ) );
+        if ( north.TotalNodes() > 0 ) {
+            CopyAttributes( north, subject, b_min.get_center_lat(), type );
+            ClipRows( north, b_min, mid+1, hi, type );
+        }
+        return;
+    }
+
+    for ( int row = lo; row <= hi; row++ )
+    {
+        // Generate a clip rectangle for the whole row
+        SGBucket  b_clip      = b_min.sibling(0, row);
+        double    clip_bottom = b_clip.get_center_lat() - SG_HALF_BUCKET_SPAN;
+        double    clip_top    = b_clip.get_center_lat() + SG_HALF_BUCKET_SPAN;
+
+        SG_LOG( SG_GENERAL, SG_DEBUG, "   CLIPPED row " << row << " center lat is " << b_clip.get_center_lat() << " clip_botton is " << clip_bottom << " clip_top is " << clip_top );
+
+        tgPolygon clipped = tgPolygon::Intersect( subject, ClipRect( -180.0, clip_bottom, 180.0, clip_top ) );
+        if ( clipped.TotalNodes() > 0 ) {
+            CopyAttributes( clipped, subject, b_clip.get_center_lat(), type );
+            ClipRow( clipped, b_clip.get_center_lat(), type );
+        }
     }
 }
 
@@ -98,132 +265,186 @@ void tgChopper::Add( const tgPolygon& subject, const std::string& type )
         // since many shapes are narraw in some places, wide in others - bb will be at the widest part
         SG_LOG( SG_GENERAL, SG_DEBUG, "subject spans tile rows: bb is from lat " << bb.getMin().getLatitudeDeg() << " to " << bb.getMax().getLatitudeDeg() << " dy is " << dy );
 
-        for ( int row = 0; row <= dy; row++ )
-        {
-            // Generate a clip rectangle for the whole row
-
-            SGBucket  b_clip      = b_min.sibling(0, row);
-            double    clip_bottom = b_clip.get_center_lat() - SG_HALF_BUCKET_SPAN;
-            double    clip_top    = b_clip.get_center_lat() + SG_HALF_BUCKET_SPAN;
-            tgPolygon clip_row, clipped;
+        ClipRows( subject, b_min, 0, dy, type );
+    }
+}
 
-            SG_LOG( SG_GENERAL, SG_DEBUG, "   CLIPPED row " << row << " center lat is " << b_clip.get_center_lat() << " clip_botton is " << clip_bottom << " clip_top is " << clip_top );
+void tgChopper::Spill( bucket_polys_map& polys, unsigned int spill )
+{
+    std::vector<std::pair<long int, Chunk> > written;
+    bucket_polys_map_interator it;
+    char chunk_name[64];
 
-            clip_row.AddNode( 0, SGGeod::fromDeg(-180.0, clip_bottom) );
-            clip_row.AddNode( 0, SGGeod::fromDeg( 180.0, clip_bottom) );
-            clip_row.AddNode( 0, SGGeod::fromDeg( 180.0, clip_top)    );
-            clip_row.AddNode( 0, SGGeod::fromDeg(-180.0, clip_top)    );
+    for (it=polys.begin(); it != polys.end(); it++) {
+        tgpolygon_list const& list = (*it).second;
+        Chunk c;
 
-            clipped = tgPolygon::Intersect( subject, clip_row );
-            if ( clipped.TotalNodes() > 0 ) {
+        // one file per bucket and spill - no one else ever writes to it
+        sprintf( chunk_name, "/%ld.%u", (*it).first, spill );
+        c.file  = spill_path + chunk_name;
+        c.count = list.size();
+        c.spill = spill;
 
-                if ( subject.GetPreserve3D() ) {
-                    clipped.InheritElevations( subject );
-                    clipped.SetPreserve3D( true );
-                }
-                clipped.SetTexParams( subject.GetTexParams() );
-                if ( subject.GetTexMethod() == TG_TEX_BY_GEODE ) {
-                    // need to set center latitude for geodetic texturing
-                    clipped.SetTexMethod( TG_TEX_BY_GEODE, b_clip.get_center_lat() );
-                }
-                clipped.SetFlag(type);
+        gzFile fp = gzopen( c.file.c_str(), "wb1" );
+        if ( fp == NULL ) {
+            throw sg_exception( "tgChopper: can't open spill file " + c.file );
+        }
 
-                ClipRow( clipped, b_clip.get_center_lat(), type );
-            }
+        sgWriteUInt( fp, c.count );
+        for ( unsigned int i=0; i<list.size(); i++ ) {
+            list[i].SaveToGzFile( fp );
+        }
+        if ( gzclose( fp ) != Z_OK ) {
+            throw sg_exception( "tgChopper: error writing spill file " + c.file );
         }
+
+        written.push_back( std::make_pair( (*it).first, c ) );
+    }
+    polys.clear();
+
+    SGGuard<SGMutex> g( lock );
+    for ( unsigned int i=0; i<written.size(); i++ ) {
+        chunks[written[i].first].push_back( written[i].second );
     }
 }
 
-long int tgChopper::GenerateIndex( std::string path )
+// create the next free <tile>.<pid>-<n> poly file in path.  The file is created
+// exclusively, so concurrent choppers never need to agree on an index.
+gzFile tgChopper::CreateBucketFile( const std::string& path, const std::string& tile_name )
 {
-    std::string index_file = path + "/chop.idx";
-    long int index = 0;
-
-    //Open or create the named mutex
-    boost::interprocess::named_mutex mutex(boost::interprocess::open_or_create, "tgChopper_index2");
-    {
-        boost::interprocess::scoped_lock<boost::interprocess::named_mutex> lock(mutex);
-
-        /* first try to read the file */
-        FILE *fp = fopen( index_file.c_str(), "r+" );
-        if ( fp == NULL ) {
-            /* doesn't exist - create it */
-            fp = fopen( index_file.c_str(), "w" );
+    char poly_ext[32];
+
+    for (;;) {
+        file_index_lock.lock();
+        long int index = next_file_index++;
+        file_index_lock.unlock();
+
+        sprintf( poly_ext, ".%d-%ld", (int)getpid(), index );
+        std::string polyfile = path + "/" + tile_name + poly_ext;
+
+#ifdef _MSC_VER
+        int fd = _open( polyfile.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+        int fd = open( polyfile.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 );
+#endif
+        if ( fd >= 0 ) {
+            gzFile fp = gzdopen( fd, "wb9" );
             if ( fp == NULL ) {
-                SG_LOG(SG_GENERAL, SG_ALERT, "Error cannot open Index file " << index_file << " for writing");
-                boost::interprocess::named_mutex::remove("tgChopper_index2");
-                exit( 0 );
-            }
-        } else {
-            fread( (void*)&index, sizeof(long int), 1, fp );
-            if (ferror(fp))
-            {
-                perror ("The following error occurred");
-                SG_LOG(SG_GENERAL, SG_ALERT, "Error reading Index file " << index_file << " abort");
-                boost::interprocess::named_mutex::remove("tgChopper_index2");
-                exit(0);
+                SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << polyfile << " for writing!" );
             }
+            return fp;
         }
 
-        index++;
-
-        rewind( fp );
-        fwrite( (void*)&index, sizeof(long int), 1, fp );
-        fclose( fp );
+        if ( errno != EEXIST ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: creating " << polyfile << " : " << strerror(errno) );
+            return NULL;
+        }
     }
-
-    boost::interprocess::named_mutex::remove("tgChopper_index2");
-
-    return index;
 }
 
-void tgChopper::Save( bool DebugShapefiles )
+bool tgChopper::Save( bool DebugShapefiles )
 {
-    // traverse the bucket list
-    bucket_polys_map_interator it;
-    char tile_name[16];
-    char poly_ext[16];
+    bool ok = true;
+
+    // every bucket with polys in memory, or in a spilled chunk
+    std::set<long int> buckets;
+    for (bucket_polys_map_interator it=bp_map.begin(); it != bp_map.end(); it++) {
+        buckets.insert( (*it).first );
+    }
+    for (bucket_chunks_map::iterator it=chunks.begin(); it != chunks.end(); it++) {
+        buckets.insert( (*it).first );
+    }
 
+    char tile_name[16];
     char layer[32];
     char ds_name[64];
 
-    for (it=bp_map.begin(); it != bp_map.end(); it++) {
-        SGBucket b( (*it).first );
-        tgpolygon_list const& polys = (*it).second;
+    for (std::set<long int>::iterator bit=buckets.begin(); bit != buckets.end(); bit++) {
+        SGBucket b( *bit );
+        tgpolygon_list const& polys  = bp_map[*bit];
+        std::vector<Chunk>&   spills = chunks[*bit];
+
+        // concurrent spills may have finished out of order
+        std::sort( spills.begin(), spills.end() );
 
         sprintf(ds_name, "./bucket_%s", b.gen_index_str().c_str() );
 
         std::string path = root_path + "/" + b.gen_base_path();
         sprintf( tile_name, "%ld", b.gen_index() );
 
-        std::string polyfile = path + "/" + tile_name;
-
-        SGPath sgp( polyfile );
+        SGPath sgp( path + "/" + tile_name );
         sgp.create_dir( 0755 );
 
-        long int poly_index = GenerateIndex( path );
+        unsigned int count = polys.size();
+        for ( unsigned int c=0; c<spills.size(); c++ ) {
+            count += spills[c].count;
+        }
+
+        gzFile fp = CreateBucketFile( path, tile_name );
+        if ( fp == NULL ) {
+            // skip this bucket, but keep saving the others
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: skipping bucket " << tile_name << " - " << count << " polys lost" );
+            for ( unsigned int c=0; c<spills.size(); c++ ) {
+                ::remove( spills[c].file.c_str() );
+            }
+            spills.clear();
+            ok = false;
+            continue;
+        }
+
+        /* Write polys to the file - the spilled ones first, as they were added first */
+        sgWriteUInt( fp, count );
 
-        sprintf( poly_ext, "%ld", poly_index );
-        polyfile = polyfile + "." + poly_ext;
+        unsigned int written = 0;
+        for ( unsigned int c=0; c<spills.size(); c++ ) {
+            gzFile cfp = gzopen( spills[c].file.c_str(), "rb" );
+            if ( cfp == NULL ) {
+                throw sg_exception( "tgChopper: can't open spill file " + spills[c].file );
+            }
 
-        gzFile fp;
-        if ( (fp = gzopen( polyfile.c_str(), "wb9" )) == NULL ) {
-            SG_LOG( SG_GENERAL, SG_INFO, "ERROR: opening " << polyfile.c_str() << " for writing!" );
-            return;
+            unsigned int chunk_count;
+            sgReadUInt( cfp, &chunk_count );
+
+            tgPolygon poly;
+            for ( unsigned int i=0; i<chunk_count; i++ ) {
+                poly.LoadFromGzFile( cfp );
+                poly.SaveToGzFile( fp );
+
+                if ( DebugShapefiles )
+                {
+                    sprintf(layer, "poly_%s-%d", b.gen_index_str().c_str(), written );
+                    tgShapefile::FromPolygon( poly, true, false, ds_name, layer, "poly" );
+                }
+                written++;
+            }
+
+            gzclose( cfp );
+            ::remove( spills[c].file.c_str() );
         }
+        spills.clear();
 
-        /* Write polys to the file */
-        sgWriteUInt( fp, polys.size() );
         for ( unsigned int i=0; i<polys.size(); i++ ) {
             polys[i].SaveToGzFile( fp );
 
             if ( DebugShapefiles )
             {
-                sprintf(layer, "poly_%s-%d", b.gen_index_str().c_str(), i );
+                sprintf(layer, "poly_%s-%d", b.gen_index_str().c_str(), written );
                 tgShapefile::FromPolygon( polys[i], true, false, ds_name, layer, "poly" );
             }
+            written++;
+        }
+
+        if ( gzclose( fp ) != Z_OK ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: writing bucket " << tile_name << " to " << path );
+            ok = false;
         }
+    }
 
-        gzclose( fp );
+    chunks.clear();
+    if ( !spill_path.empty() ) {
+        simgear::Dir( spill_path ).remove();
+        spill_path.clear();
     }
+
+    return ok;
 }
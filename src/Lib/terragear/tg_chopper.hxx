@@ -1,4 +1,6 @@
 #include <map>
+#include <vector>
+#include <zlib.h>
 
 #include "tg_polygon.hxx"
 
@@ -6,23 +8,62 @@
 typedef std::map<long int, tgpolygon_list> bucket_polys_map;
 typedef bucket_polys_map::iterator bucket_polys_map_interator;
 
+// Clipped polys are kept in memory until Save.  With a memory ceiling set,
+// a thread that pushes the total over it takes the whole map, and appends
+// each bucket to a chunk file of its own, so the other threads keep adding
+// while it writes.  Save merges the chunks into the final bucket files.
 class tgChopper
 {
 public:
     tgChopper( const std::string& path ) {
         root_path = path;
+        max_bytes = 0;
+        cur_bytes = 0;
+        num_spills = 0;
+    }
+    ~tgChopper();
+
+    // 0 (the default) keeps everything in memory
+    void SetMaxBytes( size_t bytes ) {
+        max_bytes = bytes;
     }
 
     void Add( const tgPolygon& poly, const std::string& type );
-    void Save( bool DebugShapes );
+
+    // false if any bucket couldn't be written - the others are still saved
+    bool Save( bool DebugShapes );
 
 private:
-    long int GenerateIndex( std::string path );
+    // a spilled chunk of one bucket's polys
+    struct Chunk {
+        std::string     file;
+        unsigned int    count;
+        unsigned int    spill;      // spills can finish out of order
+
+        bool operator<( const Chunk& other ) const {
+            return spill < other.spill;
+        }
+    };
+    typedef std::map<long int, std::vector<Chunk> > bucket_chunks_map;
+
+    static size_t EstimateSize( const tgPolygon& poly );
+    static gzFile CreateBucketFile( const std::string& path, const std::string& tile_name );
+
+    void ClipRows( const tgPolygon& subject, const SGBucket& b_min, int lo, int hi, const std::string& type );
     void ClipRow( const tgPolygon& subject, const double& center_lat, const std::string& type );
+    void ClipColumns( const tgPolygon& subject, const SGBucket& start, int lo, int hi, const std::string& type );
     tgPolygon Clip( const tgPolygon& subject, const std::string& type, SGBucket& b );
     void Chop( const tgPolygon& subject, const std::string& type );
+    void Spill( bucket_polys_map& polys, unsigned int spill );
+
+    std::string       root_path;
+    std::string       spill_path;
+    bucket_polys_map  bp_map;
+    bucket_chunks_map chunks;
+
+    size_t            max_bytes;
+    size_t            cur_bytes;
+    unsigned int      num_spills;
 
-    std::string      root_path;
-    bucket_polys_map bp_map;
-    SGMutex          lock;
+    SGMutex           lock;
 };
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <simgear/math/sg_geodesy.hxx>
 #include <simgear/io/lowlevel.hxx>
 #include <simgear/debug/logstream.hxx>
@@ -5,7 +7,9 @@
 #include "tg_misc.hxx"
 #include "tg_accumulator.hxx"
 #include "tg_contour.hxx"
+#include "tg_node_index.hxx"
 #include "tg_polygon.hxx"
+#include "tg_triangle_locator.hxx"
 #include "tg_unique_tgnode.hxx"
 #include "tg_shapefile.hxx"
 
@@ -655,16 +659,37 @@ bool IsNodeCollinear( const SGGeod& start, const SGGeod& end, const SGGeod& node
     return found_node;    
 }
                              
+// Get the candidates for the segment from the index.  Any node on the
+// segment is inside its bounding box, give or take the epsilons.  The
+// preserve3d version moves nodes onto the segments, by no more than
+// errEpsilon, so the index may be that far out of date.
+static void GetIntermediateCandidates( const SGGeod& start, const SGGeod& end,
+                                       const tgNodeIndex& index, std::vector<unsigned int>& candidates,
+                                       double bbEpsilon, double errEpsilon )
+{
+    double margin = bbEpsilon + 2 * errEpsilon;
+
+    SGGeod min = SGGeod::fromDeg( SGMiscd::min( start.getLongitudeDeg(), end.getLongitudeDeg() ) - margin,
+                                  SGMiscd::min( start.getLatitudeDeg(),  end.getLatitudeDeg() )  - margin );
+    SGGeod max = SGGeod::fromDeg( SGMiscd::max( start.getLongitudeDeg(), end.getLongitudeDeg() ) + margin,
+                                  SGMiscd::max( start.getLatitudeDeg(),  end.getLatitudeDeg() )  + margin );
+
+    index.Query( min, max, candidates );
+}
+
 static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
-                                  const std::vector<SGGeod>& nodes, SGGeod& result,
-                                  double bbEpsilon, double errEpsilon )
+                                  const std::vector<SGGeod>& nodes, const tgNodeIndex& index,
+                                  SGGeod& result, double bbEpsilon, double errEpsilon )
 {
     bool found_node = false;
     double m, m1, b, b1, y_err, x_err, y_err_min, x_err_min;
+    std::vector<unsigned int> candidates;
 
     SGGeod p0 = start;
     SGGeod p1 = end;
 
+    GetIntermediateCandidates( p0, p1, index, candidates, bbEpsilon, errEpsilon );
+
     double xdist = fabs(p0.getLongitudeDeg() - p1.getLongitudeDeg());
     double ydist = fabs(p0.getLatitudeDeg()  - p1.getLatitudeDeg());
 
@@ -685,9 +710,8 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
         m = (p_min.getLatitudeDeg() - p_max.getLatitudeDeg()) / (p_min.getLongitudeDeg() - p_max.getLongitudeDeg());
         b = p_max.getLatitudeDeg() - m * p_max.getLongitudeDeg();
 
-        for ( int i = 0; i < (int)nodes.size(); ++i ) {
-            // cout << i << endl;
-            SGGeod current = nodes[i];
+        for ( unsigned int c = 0; c < candidates.size(); ++c ) {
+            SGGeod current = nodes[candidates[c]];
 
             if ( (current.getLongitudeDeg() > (p_min.getLongitudeDeg() + (bbEpsilon))) && (current.getLongitudeDeg() < (p_max.getLongitudeDeg() - (bbEpsilon))) ) {
                 y_err = fabs(current.getLatitudeDeg() - (m * current.getLongitudeDeg() + b));
@@ -715,8 +739,8 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
         m1 = (p_min.getLongitudeDeg() - p_max.getLongitudeDeg()) / (p_min.getLatitudeDeg() - p_max.getLatitudeDeg());
         b1 = p_max.getLongitudeDeg() - m1 * p_max.getLatitudeDeg();
 
-        for ( int i = 0; i < (int)nodes.size(); ++i ) {
-            SGGeod current = nodes[i];
+        for ( unsigned int c = 0; c < candidates.size(); ++c ) {
+            SGGeod current = nodes[candidates[c]];
 
             if ( (current.getLatitudeDeg() > (p_min.getLatitudeDeg() + (bbEpsilon))) && (current.getLatitudeDeg() < (p_max.getLatitudeDeg() - (bbEpsilon))) ) {
 
@@ -737,14 +761,17 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
 }
 
 static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
-                                  const std::vector<TGNode*>& nodes, TGNode*& result,
-                                  double bbEpsilon, double errEpsilon )
+                                  const std::vector<TGNode*>& nodes, const tgNodeIndex& index,
+                                  TGNode*& result, double bbEpsilon, double errEpsilon )
 {
     bool found_node = false;
     double m, m1, b, b1, y_err, x_err, y_err_min, x_err_min;
+    std::vector<unsigned int> candidates;
     
     SGGeod p0 = start;
     SGGeod p1 = end;
+
+    GetIntermediateCandidates( p0, p1, index, candidates, bbEpsilon, errEpsilon );
     
     double xdist = fabs(p0.getLongitudeDeg() - p1.getLongitudeDeg());
     double ydist = fabs(p0.getLatitudeDeg()  - p1.getLatitudeDeg());
@@ -766,8 +793,8 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
         m = (p_min.getLatitudeDeg() - p_max.getLatitudeDeg()) / (p_min.getLongitudeDeg() - p_max.getLongitudeDeg());
         b = p_max.getLatitudeDeg() - m * p_max.getLongitudeDeg();
         
-        for ( int i = 0; i < (int)nodes.size(); ++i ) {
-            // cout << i << endl;
+        for ( unsigned int c = 0; c < candidates.size(); ++c ) {
+            unsigned int i = candidates[c];
             SGGeod current = nodes[i]->GetPosition();
             
             if ( (current.getLongitudeDeg() > (p_min.getLongitudeDeg() + (bbEpsilon))) && (current.getLongitudeDeg() < (p_max.getLongitudeDeg() - (bbEpsilon))) ) {
@@ -796,7 +823,8 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
         m1 = (p_min.getLongitudeDeg() - p_max.getLongitudeDeg()) / (p_min.getLatitudeDeg() - p_max.getLatitudeDeg());
         b1 = p_max.getLongitudeDeg() - m1 * p_max.getLatitudeDeg();
         
-        for ( int i = 0; i < (int)nodes.size(); ++i ) {
+        for ( unsigned int c = 0; c < candidates.size(); ++c ) {
+            unsigned int i = candidates[c];
             SGGeod current = nodes[i]->GetPosition();
             
             if ( (current.getLatitudeDeg() > (p_min.getLatitudeDeg() + (bbEpsilon))) && (current.getLatitudeDeg() < (p_max.getLatitudeDeg() - (bbEpsilon))) ) {
@@ -817,34 +845,34 @@ static bool FindIntermediateNode( const SGGeod& start, const SGGeod& end,
     return found_node;
 }
 
-static void AddIntermediateNodes( const SGGeod& p0, const SGGeod& p1, std::vector<SGGeod>& nodes, tgContour& result, double bbEpsilon, double errEpsilon )
+static void AddIntermediateNodes( const SGGeod& p0, const SGGeod& p1, const std::vector<SGGeod>& nodes, const tgNodeIndex& index, tgContour& result, double bbEpsilon, double errEpsilon )
 {
     SGGeod new_pt;
 
     SG_LOG(SG_GENERAL, SG_BULK, "   " << p0 << " <==> " << p1 );
 
-    bool found_extra = FindIntermediateNode( p0, p1, nodes, new_pt, bbEpsilon, errEpsilon );
+    bool found_extra = FindIntermediateNode( p0, p1, nodes, index, new_pt, bbEpsilon, errEpsilon );
 
     if ( found_extra ) {
-        AddIntermediateNodes( p0, new_pt, nodes, result, bbEpsilon, errEpsilon  );
+        AddIntermediateNodes( p0, new_pt, nodes, index, result, bbEpsilon, errEpsilon  );
 
         result.AddNode( new_pt );
         SG_LOG(SG_GENERAL, SG_BULK, "    adding = " << new_pt);
 
-        AddIntermediateNodes( new_pt, p1, nodes, result, bbEpsilon, errEpsilon  );
+        AddIntermediateNodes( new_pt, p1, nodes, index, result, bbEpsilon, errEpsilon  );
     }
 }
 
 extern SGGeod InterpolateElevation( const SGGeod& dst_node, const SGGeod& start, const SGGeod& end );
 
-static void AddIntermediateNodes( const SGGeod& p0, const SGGeod& p1, bool preserve3d, std::vector<TGNode*>& nodes, tgContour& result, double bbEpsilon, double errEpsilon )
+static void AddIntermediateNodes( const SGGeod& p0, const SGGeod& p1, bool preserve3d, std::vector<TGNode*>& nodes, const tgNodeIndex& index, tgContour& result, double bbEpsilon, double errEpsilon )
 {
     TGNode* new_pt = NULL;
     SGGeod  new_geode;
     
     SG_LOG(SG_GENERAL, SG_BULK, "   " << p0 << " <==> " << p1 );
     
-    bool found_extra = FindIntermediateNode( p0, p1, nodes, new_pt, bbEpsilon, errEpsilon );
+    bool found_extra = FindIntermediateNode( p0, p1, nodes, index, new_pt, bbEpsilon, errEpsilon );
     
     if ( found_extra && new_pt ) {
         if ( preserve3d ) {
@@ -863,48 +891,28 @@ static void AddIntermediateNodes( const SGGeod& p0, const SGGeod& p1, bool prese
             new_pt->SetType( TG_NODE_FIXED_ELEVATION );
         }
 
-        AddIntermediateNodes( p0, new_pt->GetPosition(), preserve3d, nodes, result, bbEpsilon, errEpsilon  );
+        AddIntermediateNodes( p0, new_pt->GetPosition(), preserve3d, nodes, index, result, bbEpsilon, errEpsilon  );
         
         result.AddNode( new_pt->GetPosition() );
         SG_LOG(SG_GENERAL, SG_BULK, "    adding = " << new_pt->GetPosition() );
         
-        AddIntermediateNodes( new_pt->GetPosition(), p1, preserve3d, nodes, result, bbEpsilon, errEpsilon  );
+        AddIntermediateNodes( new_pt->GetPosition(), p1, preserve3d, nodes, index, result, bbEpsilon, errEpsilon  );
     }
 }
 
 tgContour tgContour::AddColinearNodes( const tgContour& subject, UniqueSGGeodSet& nodes )
 {
-    SGGeod p0, p1;
-    tgContour result;
-    std::vector<SGGeod>& tmp_nodes = nodes.get_list();
-
-    for ( unsigned int n = 0; n < subject.GetSize()-1; n++ ) {
-        p0 = subject.GetNode( n );
-        p1 = subject.GetNode( n+1 );
-
-        // add start of segment
-        result.AddNode( p0 );
-
-        // add intermediate points
-        AddIntermediateNodes( p0, p1, tmp_nodes, result, SG_EPSILON*10, SG_EPSILON*4 );
-    }
-
-    p0 = subject.GetNode( subject.GetSize() - 1 );
-    p1 = subject.GetNode( 0 );
-
-    // add start of segment
-    result.AddNode( p0 );
-
-    // add intermediate points
-    AddIntermediateNodes( p0, p1, tmp_nodes, result, SG_EPSILON*10, SG_EPSILON*4 );
+    return AddColinearNodes( subject, nodes.get_list() );
+}
 
-    // maintain original hole flag setting
-    result.SetHole( subject.GetHole() );
+tgContour tgContour::AddColinearNodes( const tgContour& subject, std::vector<SGGeod>& nodes )
+{
+    tgNodeIndex index( nodes );
 
-    return result;
+    return AddColinearNodes( subject, nodes, index );
 }
 
-tgContour tgContour::AddColinearNodes( const tgContour& subject, std::vector<SGGeod>& nodes )
+tgContour tgContour::AddColinearNodes( const tgContour& subject, const std::vector<SGGeod>& nodes, const tgNodeIndex& index )
 {
     SGGeod p0, p1;
     tgContour result;
@@ -917,7 +925,7 @@ tgContour tgContour::AddColinearNodes( const tgContour& subject, std::vector<SGG
         result.AddNode( p0 );
 
         // add intermediate points
-        AddIntermediateNodes( p0, p1, nodes, result, SG_EPSILON*10, SG_EPSILON*4 );
+        AddIntermediateNodes( p0, p1, nodes, index, result, SG_EPSILON*10, SG_EPSILON*4 );
     }
 
     p0 = subject.GetNode( subject.GetSize() - 1 );
@@ -927,7 +935,7 @@ tgContour tgContour::AddColinearNodes( const tgContour& subject, std::vector<SGG
     result.AddNode( p0 );
 
     // add intermediate points
-    AddIntermediateNodes( p0, p1, nodes, result, SG_EPSILON*10, SG_EPSILON*4 );
+    AddIntermediateNodes( p0, p1, nodes, index, result, SG_EPSILON*10, SG_EPSILON*4 );
 
     // maintain original hole flag setting
     result.SetHole( subject.GetHole() );
@@ -936,6 +944,19 @@ tgContour tgContour::AddColinearNodes( const tgContour& subject, std::vector<SGG
 }
 
 tgContour tgContour::AddColinearNodes( const tgContour& subject, bool preserve3d, std::vector<TGNode*>& nodes )
+{
+    std::vector<SGGeod> positions;
+
+    positions.reserve( nodes.size() );
+    for ( unsigned int i = 0; i < nodes.size(); i++ ) {
+        positions.push_back( nodes[i]->GetPosition() );
+    }
+    tgNodeIndex index( positions );
+
+    return AddColinearNodes( subject, preserve3d, nodes, index );
+}
+
+tgContour tgContour::AddColinearNodes( const tgContour& subject, bool preserve3d, std::vector<TGNode*>& nodes, const tgNodeIndex& index )
 {
     SGGeod p0, p1;
     tgContour result;
@@ -958,7 +979,7 @@ tgContour tgContour::AddColinearNodes( const tgContour& subject, bool preserve3d
         result.AddNode( p0 );
         
         // add intermediate points
-        AddIntermediateNodes( p0, p1, preserve3d, nodes, result, SG_EPSILON*20, SG_EPSILON*15 );
+        AddIntermediateNodes( p0, p1, preserve3d, nodes, index, result, SG_EPSILON*20, SG_EPSILON*15 );
     }
     
     p0 = subject.GetNode( subject.GetSize() - 1 );
@@ -968,7 +989,7 @@ tgContour tgContour::AddColinearNodes( const tgContour& subject, bool preserve3d
     result.AddNode( p0 );
     
     // add intermediate points
-    AddIntermediateNodes( p0, p1, preserve3d, nodes, result, SG_EPSILON*20, SG_EPSILON*15 );
+    AddIntermediateNodes( p0, p1, preserve3d, nodes, index, result, SG_EPSILON*20, SG_EPSILON*15 );
     
     // maintain original hole flag setting
     result.SetHole( subject.GetHole() );
@@ -1065,6 +1086,50 @@ tgContour tgContour::AddIntersectingNodes( const tgContour& subject, const tgtri
     return result;
 }
 
+tgContour tgContour::AddIntersectingNodes( const tgContour& subject, const tgtriangle_list& mesh, const tgTriangleLocator& locator )
+{
+    std::vector<unsigned int> candidates, edge_candidates;
+    tgContour result;
+
+    // copy the contour
+    for ( unsigned int n=0; n<subject.GetSize(); n++ )
+    {
+        result.AddNode( subject.GetNode(n) );
+    }
+
+    // only the triangles near one of the edges can intersect it.  The nodes
+    // we add are rounded, so allow a bit of slop around each edge.
+    for ( unsigned int n=0; n<subject.GetSize(); n++ )
+    {
+        SGGeod p0 = subject.GetNode( n );
+        SGGeod p1 = subject.GetNode( (n+1) % subject.GetSize() );
+
+        SGGeod min = SGGeod::fromDeg( SGMiscd::min( p0.getLongitudeDeg(), p1.getLongitudeDeg() ) - SG_EPSILON,
+                                      SGMiscd::min( p0.getLatitudeDeg(),  p1.getLatitudeDeg() )  - SG_EPSILON );
+        SGGeod max = SGGeod::fromDeg( SGMiscd::max( p0.getLongitudeDeg(), p1.getLongitudeDeg() ) + SG_EPSILON,
+                                      SGMiscd::max( p0.getLatitudeDeg(),  p1.getLatitudeDeg() )  + SG_EPSILON );
+        tgRectangle ebb( min, max );
+
+        locator.GetCandidates( ebb, edge_candidates );
+        for ( unsigned int c=0; c < edge_candidates.size(); c++ ) {
+            if ( ebb.intersects( mesh[edge_candidates[c]].GetBoundingBox() ) ) {
+                candidates.push_back( edge_candidates[c] );
+            }
+        }
+    }
+
+    // visit them in mesh order, like the linear search
+    std::sort( candidates.begin(), candidates.end() );
+    candidates.erase( std::unique( candidates.begin(), candidates.end() ), candidates.end() );
+
+    for ( unsigned int c=0; c < candidates.size(); c++ ) {
+        // look for line intersections
+        result = AddIntersectingNodes( result, mesh[candidates[c]] );
+    }
+
+    return result;
+}
+
 
 tgContour tgContour::Expand( const tgContour& subject, double offset )
 {
@@ -1086,7 +1151,7 @@ tgContour tgContour::Expand( const tgContour& subject, double offset )
         result = poly.GetContour( 0 );
     } else {
         SG_LOG(SG_GENERAL, SG_INFO, "Expanding contour resulted in more than 1 contour ! ");
-        exit(0);
+        exit(1);
     }
 
     return result;
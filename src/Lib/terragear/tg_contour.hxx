@@ -5,6 +5,8 @@
 # error This library requires C++
 #endif
 
+#include <algorithm>
+
 #include <simgear/compiler.h>
 #include <simgear/math/sg_types.hxx>
 #include <boost/concept_check.hpp>
@@ -18,6 +20,8 @@
 
 /* forward declarations */
 class TGNode;
+class tgNodeIndex;
+class tgTriangleLocator;
 
 class tgPolygon;
 typedef std::vector <tgPolygon>  tgpolygon_list;
@@ -38,6 +42,12 @@ public:
         node_list.clear();
     }
 
+    // exchange contents without copying any nodes
+    void swap( tgContour& other ) {
+        node_list.swap( other.node_list );
+        std::swap( hole, other.hole );
+    }
+
     void SetHole( bool h ) {
         hole = h;
     }
@@ -122,8 +132,12 @@ public:
     static tgContour AddColinearNodes( const tgContour& subject, UniqueSGGeodSet& nodes );
     static tgContour AddColinearNodes( const tgContour& subject, std::vector<SGGeod>& nodes );
     static tgContour AddColinearNodes( const tgContour& subject, bool preserve3d, std::vector<TGNode*>& nodes );
+    // with an index over the node positions, for callers doing many contours against the same nodes
+    static tgContour AddColinearNodes( const tgContour& subject, const std::vector<SGGeod>& nodes, const tgNodeIndex& index );
+    static tgContour AddColinearNodes( const tgContour& subject, bool preserve3d, std::vector<TGNode*>& nodes, const tgNodeIndex& index );
     static bool      FindColinearLine( const tgContour& subject, const SGGeod& node, SGGeod& start, SGGeod& end );
     static tgContour AddIntersectingNodes( const tgContour& subject, const tgtriangle_list& mesh );
+    static tgContour AddIntersectingNodes( const tgContour& subject, const tgtriangle_list& mesh, const tgTriangleLocator& locator );
     static tgContour AddIntersectingNodes( const tgContour& subject, const tgTriangle& tri );
     
     // conversions
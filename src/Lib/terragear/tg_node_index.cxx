@@ -0,0 +1,129 @@
+// tg_node_index.cxx -- uniform grid over a list of node positions
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#include "tg_node_index.hxx"
+
+tgNodeIndex::tgNodeIndex( const std::vector<SGGeod>& positions ) :
+        num_nodes( positions.size() ),
+        min_lon(0.0),
+        min_lat(0.0),
+        cell_w(1.0),
+        cell_h(1.0),
+        nx(0),
+        ny(0)
+{
+    if ( num_nodes < TG_NODE_INDEX_MIN_NODES ) {
+        return;
+    }
+
+    double max_lon, max_lat;
+    min_lon = max_lon = positions[0].getLongitudeDeg();
+    min_lat = max_lat = positions[0].getLatitudeDeg();
+
+    for ( unsigned int i = 1; i < num_nodes; i++ ) {
+        min_lon = std::min( min_lon, positions[i].getLongitudeDeg() );
+        max_lon = std::max( max_lon, positions[i].getLongitudeDeg() );
+        min_lat = std::min( min_lat, positions[i].getLatitudeDeg() );
+        max_lat = std::max( max_lat, positions[i].getLatitudeDeg() );
+    }
+
+    // square-ish cells, sized for a few nodes each
+    double width  = max_lon - min_lon;
+    double height = max_lat - min_lat;
+    double num_cells = (double)num_nodes / TG_NODE_INDEX_PER_CELL;
+
+    if ( width > 0.0 && height > 0.0 ) {
+        double cell = sqrt( width * height / num_cells );
+        nx = (int)ceil( width  / cell );
+        ny = (int)ceil( height / cell );
+    } else if ( width > 0.0 ) {
+        nx = (int)num_cells;
+        ny = 1;
+    } else if ( height > 0.0 ) {
+        nx = 1;
+        ny = (int)num_cells;
+    } else {
+        nx = ny = 1;
+    }
+
+    nx = std::max( 1, std::min( nx, (int)num_cells ) );
+    ny = std::max( 1, std::min( ny, (int)num_cells ) );
+
+    cell_w = ( width  > 0.0 ) ? width  / nx : 1.0;
+    cell_h = ( height > 0.0 ) ? height / ny : 1.0;
+
+    cells.resize( nx * ny );
+    for ( unsigned int i = 0; i < num_nodes; i++ ) {
+        int x = CellX( positions[i].getLongitudeDeg() );
+        int y = CellY( positions[i].getLatitudeDeg() );
+
+        cells[ y * nx + x ].push_back( i );
+    }
+}
+
+int tgNodeIndex::CellX( double lon ) const
+{
+    int x = (int)floor( ( lon - min_lon ) / cell_w );
+    return std::max( 0, std::min( x, nx - 1 ) );
+}
+
+int tgNodeIndex::CellY( double lat ) const
+{
+    int y = (int)floor( ( lat - min_lat ) / cell_h );
+    return std::max( 0, std::min( y, ny - 1 ) );
+}
+
+void tgNodeIndex::Query( const SGGeod& min, const SGGeod& max, std::vector<unsigned int>& result ) const
+{
+    result.clear();
+
+    if ( cells.empty() ) {
+        result.reserve( num_nodes );
+        for ( unsigned int i = 0; i < num_nodes; i++ ) {
+            result.push_back( i );
+        }
+        return;
+    }
+
+    // outside of the grid completely?
+    if ( max.getLongitudeDeg() < min_lon || min.getLongitudeDeg() > min_lon + nx * cell_w ||
+         max.getLatitudeDeg()  < min_lat || min.getLatitudeDeg()  > min_lat + ny * cell_h ) {
+        return;
+    }
+
+    int x0 = CellX( min.getLongitudeDeg() );
+    int x1 = CellX( max.getLongitudeDeg() );
+    int y0 = CellY( min.getLatitudeDeg() );
+    int y1 = CellY( max.getLatitudeDeg() );
+
+    for ( int y = y0; y <= y1; y++ ) {
+        for ( int x = x0; x <= x1; x++ ) {
+            std::vector<unsigned int> const& cell = cells[ y * nx + x ];
+            result.insert( result.end(), cell.begin(), cell.end() );
+        }
+    }
+
+    if ( x0 != x1 || y0 != y1 ) {
+        std::sort( result.begin(), result.end() );
+    }
+}
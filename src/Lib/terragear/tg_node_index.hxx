@@ -0,0 +1,70 @@
+// tg_node_index.hxx -- uniform grid over a list of node positions
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_NODE_INDEX_HXX
+#define _TG_NODE_INDEX_HXX
+
+#ifndef __cplusplus
+# error This library requires C++
+#endif
+
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/math/SGMath.hxx>
+
+// Finding the nodes that lie on an edge used to mean checking every
+// candidate node against every edge.  The index buckets the candidates
+// into a grid of about TG_NODE_INDEX_PER_CELL nodes per cell, so an edge
+// only looks at the cells its bounding box covers.
+//
+// The index holds positions only, and hands back indices into the list
+// it was built from.  Short lists aren't worth a grid, and just return
+// every index.
+#define TG_NODE_INDEX_MIN_NODES     (64)
+#define TG_NODE_INDEX_PER_CELL      (4)
+
+class tgNodeIndex
+{
+public:
+    tgNodeIndex( const std::vector<SGGeod>& positions );
+
+    // Indices of all nodes that may be inside the box, in ascending order,
+    // so callers see the nodes in the same order as a linear scan would
+    void Query( const SGGeod& min, const SGGeod& max, std::vector<unsigned int>& result ) const;
+
+    unsigned int size( void ) const {
+        return num_nodes;
+    }
+
+private:
+    int CellX( double lon ) const;
+    int CellY( double lat ) const;
+
+    unsigned int    num_nodes;
+
+    double          min_lon;
+    double          min_lat;
+    double          cell_w;
+    double          cell_h;
+    int             nx;
+    int             ny;
+
+    // empty when the list is too short to bother
+    std::vector< std::vector<unsigned int> > cells;
+};
+
+#endif // _TG_NODE_INDEX_HXX
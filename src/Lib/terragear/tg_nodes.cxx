@@ -2,6 +2,7 @@
 
 #include "tg_nodes.hxx"
 #include "tg_shapefile.hxx"
+#include "tg_triangle_locator.hxx"
 
 const double fgPoint3_Epsilon = 0.000001;
 
@@ -25,6 +26,14 @@ void TGNodes::init_spacial_query( void )
         tg_kd_tree.insert( pande );
     }
 
+    // the tree is built on the first query - do it now, so queries
+    // from more than one thread don't race each other building it
+    if ( tg_node_list.size() ) {
+        std::list<Point_and_Elevation> result;
+        tgn_Point pt( tg_node_list[0].GetPosition().getLongitudeDeg(), tg_node_list[0].GetPosition().getLatitudeDeg() );
+        tg_kd_tree.search( std::back_inserter( result ), Fuzzy_bb( pt, pt ) );
+    }
+
     kd_tree_valid = true;
 }
 
@@ -37,7 +46,7 @@ bool TGNodes::get_geod_inside( const SGGeod& min, const SGGeod& max, std::vector
     // Have we generated the k-d tree?
     if ( !kd_tree_valid ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "get_geod_inside called with invalid kdtree" );
-        exit(0);
+        exit(1);
         return false;
     }
 
@@ -67,7 +76,7 @@ bool TGNodes::get_nodes_inside( const SGGeod& min, const SGGeod& max, std::vecto
     // Have we generated the k-d tree?
     if ( !kd_tree_valid ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "get_nodes_inside called with invalid kdtree" );
-        exit(0);
+        exit(1);
         return false;
     }
     
@@ -113,7 +122,7 @@ bool TGNodes::get_geod_edge( const SGBucket& b, std::vector<SGGeod>& north, std:
     // Have we generated the k-d tree?
     if ( !kd_tree_valid ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "get_geod_edge called with invalid kdtree" );
-        exit(0);
+        exit(1);
         return false;
     }
 
@@ -191,6 +200,10 @@ void TGNodes::DeleteUnused( void ) {
     
     tg_kd_tree.clear();
     kd_tree_valid = false;
+
+    // indices are about to change
+    ClearFaces();
+    normals.clear();
     
     for(unsigned int i = 0; i < used_nodes.size(); i++) {
         tg_node_list.add(used_nodes[i]);
@@ -202,10 +215,20 @@ void TGNodes::DeleteUnused( void ) {
 }
 
 void TGNodes::CalcElevations( tgNodeType type ) {
-    for(unsigned int i = 0; i < tg_node_list.size(); i++) {
-        if ( tg_node_list[i].GetType() == type ) {
-            SGGeod pos = tg_node_list[i].GetPosition();
+    CalcElevations( type, 0, tg_node_list.size() );
+}
 
+// nodes are independent, so ranges can be calculated from different threads
+void TGNodes::CalcElevations( tgNodeType type, unsigned int begin, unsigned int end ) {
+    std::vector<unsigned int> interpolated;
+    std::vector<SGGeod> positions;
+
+    if ( end > tg_node_list.size() ) {
+        end = tg_node_list.size();
+    }
+
+    for(unsigned int i = begin; i < end; i++) {
+        if ( tg_node_list[i].GetType() == type ) {
             switch (type)
             {
                 case TG_NODE_FIXED_ELEVATION:
@@ -213,8 +236,9 @@ void TGNodes::CalcElevations( tgNodeType type ) {
                     break;
 
                 case TG_NODE_INTERPOLATED:
-                    // get elevation from array
-                    SetElevation( i, array->altitude_from_grid(pos.getLongitudeDeg() * 3600.0, pos.getLatitudeDeg() * 3600.0) );
+                    // get elevation from array - below, in one batch
+                    interpolated.push_back( i );
+                    positions.push_back( tg_node_list[i].GetPosition() );
                     break;
 
                 case TG_NODE_SMOOTHED:
@@ -229,6 +253,15 @@ void TGNodes::CalcElevations( tgNodeType type ) {
             SG_LOG(SG_GENERAL, SG_ALERT, "CalcElevations (interpolated) Ignore pos " << tg_node_list[i].GetPosition() << " with type " << tg_node_list[i].GetType() );
         }
     }
+
+    if ( !interpolated.empty() ) {
+        std::vector<double> elevs;
+        array->altitude_from_grid( positions, elevs );
+
+        for (unsigned int i = 0; i < interpolated.size(); i++) {
+            SetElevation( interpolated[i], elevs[i] );
+        }
+    }
 }
     
 void TGNodes::CalcElevations( tgNodeType type, const tgSurface& surf ) {
@@ -254,11 +287,18 @@ void TGNodes::CalcElevations( tgNodeType type, const tgSurface& surf ) {
 }
 
 void TGNodes::CalcElevations( tgNodeType type, const tgtriangle_list& mesh ) {
+    tgTriangleLocator locator( mesh );
+
+    CalcElevations( type, locator );
+}
+
+void TGNodes::CalcElevations( tgNodeType type, const tgTriangleLocator& locator ) {
+    std::vector<unsigned int> draped;
+    std::vector<SGGeod> positions;
+    std::vector<int> tris;
+
     for(unsigned int i = 0; i < tg_node_list.size(); i++) {
         if ( tg_node_list[i].GetType() == type ) {
-            SGGeod pos = tg_node_list[i].GetPosition();
-            bool foundElev = false;
-            
             switch (type)
             {
                 case TG_NODE_FIXED_ELEVATION:
@@ -268,32 +308,65 @@ void TGNodes::CalcElevations( tgNodeType type, const tgtriangle_list& mesh ) {
                     
                 case TG_NODE_DRAPED:
                     // we need to find the triangle this node is within
-                    for ( unsigned int tri=0; tri<mesh.size() && !foundElev; tri++ ) {
-                        foundElev = mesh[tri].InterpolateHeight( pos );
-                        if ( foundElev )
-                        {
-                            tg_node_list[i].SetElevation( pos.getElevationM() + 0.01f );
-                        }
-                    }
-                    
-                    if (!foundElev) {
-                        SG_LOG(SG_GENERAL, SG_ALERT, "CalcElevations Could not drape point " << pos );
-                    }
+                    draped.push_back( i );
+                    positions.push_back( tg_node_list[i].GetPosition() );
                     break;
             }
         }  else {
             SG_LOG(SG_GENERAL, SG_ALERT, "CalcElevations draped Ignore pos " << tg_node_list[i].GetPosition() << " with type " << tg_node_list[i].GetType() );
         }
     }
+
+    locator.InterpolateHeights( positions, tris );
+
+    for ( unsigned int d = 0; d < draped.size(); d++ ) {
+        if ( tris[d] >= 0 ) {
+            tg_node_list[ draped[d] ].SetElevation( positions[d].getElevationM() + 0.01f );
+        } else {
+            SG_LOG(SG_GENERAL, SG_ALERT, "CalcElevations Could not drape point " << positions[d] );
+        }
+    }
 }
 
-void TGNodes::get_normals( std::vector<SGVec3f>& normals ) const {
-    normals.clear();
+void TGNodes::get_normals( std::vector<SGVec3f>& points ) const {
+    points.clear();
+    points.reserve( tg_node_list.size() );
     for ( unsigned int i = 0; i < tg_node_list.size(); i++ ) {
-        normals.push_back( tg_node_list[i].GetNormal() );
+        points.push_back( GetNormal( i ) );
     }
 }
 
+// counting sort of the added faces by node - one pass to size each row,
+// and one to fill them in
+void TGNodes::BuildFaceLists( void ) {
+    unsigned int num_nodes = tg_node_list.size();
+    std::vector<unsigned int> next( num_nodes + 1, 0 );
+
+    for ( unsigned int f = 0; f < face_node.size(); f++ ) {
+        next[ face_node[f] + 1 ]++;
+    }
+    for ( unsigned int i = 0; i < num_nodes; i++ ) {
+        next[i+1] += next[i];
+    }
+    face_start = next;
+
+    face_list.resize( face_pending.size() );
+    for ( unsigned int f = 0; f < face_node.size(); f++ ) {
+        face_list[ next[ face_node[f] ]++ ] = face_pending[f];
+    }
+
+    // release the pending lists
+    std::vector<unsigned int>().swap( face_node );
+    std::vector<TGFaceLookup>().swap( face_pending );
+}
+
+void TGNodes::ClearFaces( void ) {
+    std::vector<unsigned int>().swap( face_start );
+    std::vector<TGFaceLookup>().swap( face_list );
+    std::vector<unsigned int>().swap( face_node );
+    std::vector<TGFaceLookup>().swap( face_pending );
+}
+
 void TGNodes::Dump( void ) {
     for (unsigned int i=0; i<tg_node_list.size(); i++) {
         TGNode const& node = tg_node_list[ i ];
@@ -326,7 +399,7 @@ void TGNodes::ToShapefile( const std::string& datasource )
                 interpolated_nodes.push_back( tg_node_list[ i ].GetPosition() );
                 if ( interpolated_nodes.size() == 1633 ) {
                     tgShapefile::FromGeod( tg_node_list[ i ].GetPosition(), "./", "node1633", "interpolated" );
-                    SG_LOG(SG_GENERAL, SG_ALERT, "interpolated node 1633 has " << tg_node_list[i].GetFaces().size() );
+                    SG_LOG(SG_GENERAL, SG_ALERT, "interpolated node 1633 has " << GetNumFaces( i ) );
                 }
                 break;
 
@@ -354,4 +427,50 @@ void TGNodes::SaveToGzFile( gzFile& fp )
 void TGNodes::LoadFromGzFile( gzFile& fp )
 {
     tg_node_list.LoadFromGzFile( fp );
-}
\ No newline at end of file
+}
+// binary intermediate record - same content as SaveToGzFile
+struct tgBinNode {
+    tgBinGeod   pos;
+    int32_t     type;
+    int32_t     pad;
+};
+
+void TGNodes::SaveToBinFile( tgBinFileWriter& wr ) const
+{
+    std::vector<tgBinNode> records( tg_node_list.size() );
+
+    for (unsigned int i=0; i<tg_node_list.size(); i++) {
+        records[i].pos  = tgBinGeod::fromGeod( tg_node_list[i].GetPosition() );
+        records[i].type = (int32_t)tg_node_list[i].GetType();
+        records[i].pad  = 0;
+    }
+
+    wr.WriteArray( records );
+}
+
+void TGNodes::LoadFromBinFile( tgBinFileReader& rd )
+{
+    std::vector<tgBinNode> records;
+
+    if ( rd.ReadArray( records ) ) {
+        for (unsigned int i=0; i<records.size(); i++) {
+            unique_add( records[i].pos.toGeod(), (tgNodeType)records[i].type );
+        }
+    }
+}
+
+void TGNodes::SaveToList( std::vector<TGNode>& list )
+{
+    list.clear();
+    list.swap( tg_node_list.get_list() );
+    clear();
+}
+
+void TGNodes::LoadFromList( const std::vector<TGNode>& list )
+{
+    // just position and type - faces, normals and the used flag are
+    // regenerated by the next stage, exactly as after LoadFromGzFile
+    for (unsigned int i=0; i<list.size(); i++) {
+        unique_add( list[i].GetPosition(), list[i].GetType() );
+    }
+}
@@ -23,6 +23,7 @@
 #include "tg_unique_tgnode.hxx"
 #include "tg_surface.hxx"
 #include "tg_array.hxx"
+#include "tg_binfile.hxx"
 
 typedef CGAL::Simple_cartesian<double> Kernel;
 typedef Kernel::Point_2 tgn_Point;
@@ -35,6 +36,7 @@ typedef CGAL::Fuzzy_iso_box<Traits> Fuzzy_bb;
 typedef CGAL::Kd_tree<Traits> Tree;
 
 class tgSurface;
+class tgTriangleLocator;
 
 #define FG_PROXIMITY_EPSILON 0.000001
 #define FG_COURSE_EPSILON 0.0001
@@ -62,6 +64,8 @@ public:
         tg_node_list.clear();
         tg_kd_tree.clear();
         kd_tree_valid = false;
+        ClearFaces();
+        normals.clear();
     }
 
     // Add a point to the point list if it doesn't already exist.
@@ -89,7 +93,7 @@ public:
     
     void init_spacial_query( void );
 
-    void SetArray( tgArray* a ) {
+    void SetArray( const tgArray* a ) {
         array = a;
     }
     void SetTriangles( tgtriangle_list* t ) {
@@ -98,13 +102,23 @@ public:
 
     void SetElevation( int idx, double z )  { tg_node_list[idx].SetElevation( z ); }
     void CalcElevations( tgNodeType type );
+    void CalcElevations( tgNodeType type, unsigned int begin, unsigned int end );
     void CalcElevations( tgNodeType type, const tgSurface& surf );
     void CalcElevations( tgNodeType type, const tgtriangle_list& mesh );
+    void CalcElevations( tgNodeType type, const tgTriangleLocator& locator );
 
     void DeleteUnused( void );
     
-    SGVec3f GetNormal( int idx ) const      { return tg_node_list[idx].GetNormal(); }
-    void SetNormal( int idx, SGVec3f n )    { tg_node_list[idx].SetNormal( n ); }
+    // normals are kept in their own array, sized on the first SetNormal
+    SGVec3f GetNormal( int idx ) const {
+        return ( idx < (int)normals.size() ) ? normals[idx] : SGVec3f( 0.0, 0.0, 0.0 );
+    }
+    void SetNormal( int idx, SGVec3f n ) {
+        if ( normals.size() != tg_node_list.size() ) {
+            normals.resize( tg_node_list.size(), SGVec3f( 0.0, 0.0, 0.0 ) );
+        }
+        normals[idx] = n;
+    }
 
     // return a point list of geodetic nodes
     void get_geod_nodes( std::vector<SGGeod>& points ) const;
@@ -135,9 +149,28 @@ public:
         return tg_node_list[index];
     }
 
+    // Faces each node is a member of.  They are collected with AddFace,
+    // then BuildFaceLists lays them out in compressed sparse row form :
+    // the faces of node i are face_list[face_start[i]] to
+    // face_list[face_start[i+1]-1], in the order they were added.
     inline void AddFace( int i, unsigned int area, unsigned int poly, unsigned int tri )
     {
-        tg_node_list[i].AddFace( area, poly, tri );
+        TGFaceLookup    face;
+        face.area   = area;
+        face.poly   = poly;
+        face.tri    = tri;
+
+        face_node.push_back( i );
+        face_pending.push_back( face );
+    }
+    void BuildFaceLists( void );
+    void ClearFaces( void );
+
+    inline unsigned int GetNumFaces( int i ) const {
+        return ( (unsigned int)i + 1 < face_start.size() ) ? face_start[i+1] - face_start[i] : 0;
+    }
+    inline TGFaceLookup const& GetFace( int i, unsigned int f ) const {
+        return face_list[ face_start[i] + f ];
     }
 
     // return the size of the node list
@@ -149,14 +182,29 @@ public:
     void SaveToGzFile( gzFile& fp );
     void LoadFromGzFile( gzFile& fp );
 
+    void SaveToBinFile( tgBinFileWriter& wr ) const;
+    void LoadFromBinFile( tgBinFileReader& rd );
+
+    // in memory equivalents of the above - the node list is handed off
+    // without a copy, but only what SaveToGzFile keeps survives the trip
+    void SaveToList( std::vector<TGNode>& list );
+    void LoadFromList( const std::vector<TGNode>& list );
+
 private:
     UniqueTGNodeSet tg_node_list;
     Tree            tg_kd_tree;
     bool            kd_tree_valid;
     double          tex_v;
 
+    std::vector<SGVec3f>        normals;
+
+    std::vector<unsigned int>   face_start;     // CSR offsets, size() + 1 of them
+    std::vector<TGFaceLookup>   face_list;
+    std::vector<unsigned int>   face_node;      // faces added since the last build
+    std::vector<TGFaceLookup>   face_pending;
+
     // temp pointers - not serialized
-    tgArray*            array;      // for interpolated elevation
+    const tgArray*      array;      // for interpolated elevation
     tgtriangle_list*    tris;       // for draped elevation
 };
 
@@ -33,6 +33,7 @@
 #include <simgear/bucket/newbucket.hxx>
 
 #include "tg_misc.hxx"
+#include "tg_node_index.hxx"
 #include "tg_polygon.hxx"
 
 tgRectangle tgTriangle::GetBoundingBox( void ) const
@@ -161,9 +162,13 @@ tgPolygon tgPolygon::AddColinearNodes( const tgPolygon& subject, std::vector<SGG
     result.va_flt_mask = subject.va_flt_mask;
     result.int_vas = subject.int_vas;
     result.flt_vas = subject.flt_vas;
+
+    // index the nodes once for all contours
+    tgNodeIndex index( nodes );
     
     for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
-        result.AddContour( tgContour::AddColinearNodes( subject.GetContour(c), nodes ) );
+        tgContour contour = tgContour::AddColinearNodes( subject.GetContour(c), nodes, index );
+        result.TakeContour( contour );
     }
 
     return result;
@@ -182,9 +187,18 @@ tgPolygon tgPolygon::AddColinearNodes( const tgPolygon& subject, std::vector<TGN
     result.SetTexParams( subject.GetTexParams() );
     result.SetId( subject.GetId() );
     result.SetPreserve3D( subject.GetPreserve3D() );
+
+    // index the node positions once for all contours
+    std::vector<SGGeod> positions;
+    positions.reserve( nodes.size() );
+    for ( unsigned int i = 0; i < nodes.size(); i++ ) {
+        positions.push_back( nodes[i]->GetPosition() );
+    }
+    tgNodeIndex index( positions );
     
     for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
-        result.AddContour( tgContour::AddColinearNodes( subject.GetContour(c), subject.GetPreserve3D(), nodes ) );
+        tgContour contour = tgContour::AddColinearNodes( subject.GetContour(c), subject.GetPreserve3D(), nodes, index );
+        result.TakeContour( contour );
     }
     
     return result;
@@ -217,12 +231,34 @@ tgPolygon tgPolygon::AddIntersectingNodes( const tgPolygon& subject, const tgtri
     result.flt_vas = subject.flt_vas;
     
     for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
-        result.AddContour( tgContour::AddIntersectingNodes( subject.GetContour(c), mesh ) );
+        tgContour contour = tgContour::AddIntersectingNodes( subject.GetContour(c), mesh );
+        result.TakeContour( contour );
     }
     
     return result;
 }
 
+tgPolygon tgPolygon::AddIntersectingNodes( const tgPolygon& subject, const tgtriangle_list& mesh, const tgTriangleLocator& locator )
+{
+    tgPolygon result;
+
+    result.SetMaterial( subject.GetMaterial() );
+    result.SetTexParams( subject.GetTexParams() );
+    result.SetId( subject.GetId() );
+    result.SetPreserve3D( subject.GetPreserve3D() );
+    result.va_int_mask = subject.va_int_mask;
+    result.va_flt_mask = subject.va_flt_mask;
+    result.int_vas = subject.int_vas;
+    result.flt_vas = subject.flt_vas;
+
+    for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
+        tgContour contour = tgContour::AddIntersectingNodes( subject.GetContour(c), mesh, locator );
+        result.TakeContour( contour );
+    }
+
+    return result;
+}
+
 SGGeod InterpolateElevation( const SGGeod& dst_node, const SGGeod& start, const SGGeod& end )
 {
     double total_dist = SGGeodesy::distanceM( start, end );
@@ -861,6 +897,33 @@ void tgTriangle::SaveToGzFile( gzFile& fp ) const
     }
 }
 
+void tgPolygon::ClearUnsaved( void )
+{
+    for (unsigned int i = 0; i < triangles.size(); i++) {
+        triangles[i].ClearUnsaved();
+    }
+
+    tess_path = TG_TESS_NONE;
+    for ( unsigned int i=0; i<4; i++ ) {
+        int_vas[i].method = TG_VA_UNKNOWN;
+        flt_vas[i].method = TG_VA_UNKNOWN;
+    }
+    va_int_mask = 0;
+    va_flt_mask = 0;
+}
+
+void tgTriangle::ClearUnsaved( void )
+{
+    tgTriangle fresh;
+
+    // the parent stays - it's still the polygon we're in
+    fresh.parent = parent;
+    fresh.node_list.swap( node_list );
+    fresh.idx_list.swap( idx_list );
+
+    *this = fresh;
+}
+
 void tgTriangle::LoadFromGzFile( gzFile& fp )
 {
     // Load the nodelist
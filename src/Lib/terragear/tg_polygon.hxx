@@ -97,11 +97,20 @@ typedef std::vector <tgPolygon>  tgpolygon_list;
 typedef tgpolygon_list::iterator tgpolygon_list_iterator;
 typedef tgpolygon_list::const_iterator const_tgpolygon_list_iterator;
 
+// which triangulation Tesselate used : the fast inexact construction one,
+// or the exact one, when the constraints intersect
+enum tgTessPath {
+    TG_TESS_NONE = 0,
+    TG_TESS_FAST,
+    TG_TESS_EXACT
+};
+
 class tgPolygon
 {
 public:
     tgPolygon() {
         preserve3d = false;
+        tess_path = TG_TESS_NONE;
         tp.method = TG_TEX_UNKNOWN;
         for ( unsigned int i=0; i<4; i++ ) {
             int_vas[i].method = TG_VA_UNKNOWN;
@@ -123,6 +132,22 @@ public:
         triangles.clear();
     }
 
+    // exchange contents without copying any contours or triangles
+    void swap( tgPolygon& other ) {
+        contours.swap( other.contours );
+        triangles.swap( other.triangles );
+        material.swap( other.material );
+        flag.swap( other.flag );
+        std::swap( preserve3d, other.preserve3d );
+        std::swap( id, other.id );
+        std::swap( tp, other.tp );
+        std::swap( tess_path, other.tess_path );
+        std::swap( int_vas, other.int_vas );
+        std::swap( flt_vas, other.flt_vas );
+        std::swap( va_int_mask, other.va_int_mask );
+        std::swap( va_flt_mask, other.va_flt_mask );
+    }
+
     unsigned int Contours( void ) const {
         return contours.size();
     }
@@ -132,7 +157,12 @@ public:
     void AddContour( tgContour const& contour ) {
         contours.push_back(contour);
     }
-    tgContour GetContour( unsigned int c ) const {
+    // add the contour without copying it - contour is left empty
+    void TakeContour( tgContour& contour ) {
+        contours.push_back( tgContour() );
+        contours.back().swap( contour );
+    }
+    tgContour const& GetContour( unsigned int c ) const {
         return contours[c];
     }
     void DeleteContourAt( unsigned int idx ) {
@@ -342,6 +372,9 @@ public:
     // Tesselation
     void Tesselate( void );
     void Tesselate( const std::vector<SGGeod>& extra );
+    tgTessPath GetTessPath( void ) const {
+        return tess_path;
+    }
 
     // Straight Skeleton
     tgpolygon_list StraightSkeleton(void);
@@ -381,11 +414,15 @@ public:
     static tgPolygon AddColinearNodes( const tgPolygon& subject, std::vector<TGNode*>& nodes );
     static bool      FindColinearLine( const tgPolygon& subject, SGGeod& node, SGGeod& start, SGGeod& end );
     static tgPolygon AddIntersectingNodes( const tgPolygon& subject, const tgtriangle_list& mesh );
+    static tgPolygon AddIntersectingNodes( const tgPolygon& subject, const tgtriangle_list& mesh, const tgTriangleLocator& locator );
     
     // IO
     void SaveToGzFile( gzFile& fp ) const;
     void LoadFromGzFile( gzFile& fp );
 
+    // reset everything SaveToGzFile doesn't keep, as if just loaded
+    void ClearUnsaved( void );
+
     friend std::ostream& operator<< ( std::ostream&, const tgPolygon& );
 
 public:
@@ -404,6 +441,7 @@ private:
     bool            preserve3d;
     unsigned int    id;         // unique polygon id for debug
     tgTexParams     tp;
+    tgTessPath      tess_path;  // not saved - just for stats
 };
 
 #endif // _POLYGON_HXX
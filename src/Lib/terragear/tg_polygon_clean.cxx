@@ -16,7 +16,8 @@ tgPolygon tgPolygon::Snap( const tgPolygon& subject, double snap )
     result.flt_vas = subject.flt_vas;
     
     for (unsigned int c = 0; c < subject.Contours(); c++) {
-        result.AddContour( tgContour::Snap( subject.GetContour( c ), snap ) );
+        tgContour contour = tgContour::Snap( subject.GetContour( c ), snap );
+        result.TakeContour( contour );
     }
 
     return result;
@@ -36,7 +37,8 @@ tgPolygon tgPolygon::RemoveDups( const tgPolygon& subject )
     result.flt_vas = subject.flt_vas;
     
     for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
-        result.AddContour( tgContour::RemoveDups( subject.GetContour( c ) ) );
+        tgContour contour = tgContour::RemoveDups( subject.GetContour( c ) );
+        result.TakeContour( contour );
     }
 
     return result;
@@ -112,7 +114,8 @@ tgPolygon tgPolygon::SplitLongEdges( const tgPolygon& subject, double dist )
     
     for ( unsigned c = 0; c < subject.Contours(); c++ )
     {
-        result.AddContour( tgContour::SplitLongEdges( subject.GetContour(c), dist ) );
+        tgContour contour = tgContour::SplitLongEdges( subject.GetContour(c), dist );
+        result.TakeContour( contour );
     }
 
     return result;
@@ -251,7 +254,8 @@ tgPolygon tgPolygon::RemoveSpikes( const tgPolygon& subject )
     result.flt_vas = subject.flt_vas;
     
     for ( unsigned int c = 0; c < subject.Contours(); c++ ) {
-        result.AddContour( tgContour::RemoveSpikes( subject.GetContour(c) ) );
+        tgContour contour = tgContour::RemoveSpikes( subject.GetContour(c) );
+        result.TakeContour( contour );
     }
 
     return result;
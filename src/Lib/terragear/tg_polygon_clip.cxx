@@ -204,7 +204,8 @@ tgPolygon tgPolygon::FromClipper( const ClipperLib::Paths& subject )
     // for each polygon, we need to check the orientation, to set the hole flag...
     for ( unsigned int i=0; i<subject.size(); i++)
     {
-        result.AddContour( tgContour::FromClipper( subject[i] ) );
+        tgContour contour = tgContour::FromClipper( subject[i] );
+        result.TakeContour( contour );
     }
 
     return result;
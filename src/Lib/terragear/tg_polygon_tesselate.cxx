@@ -2,11 +2,10 @@
 #include <cassert>
 
 #include <CGAL/Exact_predicates_exact_constructions_kernel.h>
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
 #include <CGAL/Triangulation_face_base_with_info_2.h>
 #include <CGAL/Constrained_triangulation_plus_2.h>
-#include <CGAL/Polygon_2.h>
-#include <CGAL/Triangle_2.h>
 
 #include <simgear/debug/logstream.hxx>
 
@@ -24,6 +23,8 @@ struct FaceInfo2
   }
 };
 
+// The exact kernel, needed when constraints intersect, and the new
+// vertices have to be constructed
 typedef CGAL::Exact_predicates_exact_constructions_kernel         K;
 typedef CGAL::Triangulation_vertex_base_2<K>                      Vb;
 typedef CGAL::Triangulation_face_base_with_info_2<FaceInfo2,K>    Fbb;
@@ -32,27 +33,37 @@ typedef CGAL::Triangulation_data_structure_2<Vb,Fb>               TDS;
 typedef CGAL::Exact_intersections_tag                             Itag;
 typedef CGAL::Constrained_Delaunay_triangulation_2<K, TDS, Itag>  CDT;
 typedef CGAL::Constrained_triangulation_plus_2<CDT>               CDTPlus;
-typedef CDTPlus::Point                                            Point;
-typedef CGAL::Polygon_2<K>                                        Polygon_2;
-typedef CGAL::Triangle_2<K>                                       Triangle_2;
 
-static void tg_mark_domains(CDT& ct, CDT::Face_handle start, int index, std::list<CDT::Edge>& border )
+// The fast path : exact predicates, but no constructions, and no
+// constraint hierarchy.  The vertices are exactly the input points, so
+// this gives the same triangles as the exact kernel, as long as no
+// constraints cross.
+typedef CGAL::Exact_predicates_inexact_constructions_kernel         KFast;
+typedef CGAL::Triangulation_vertex_base_2<KFast>                    VbFast;
+typedef CGAL::Triangulation_face_base_with_info_2<FaceInfo2,KFast>  FbbFast;
+typedef CGAL::Constrained_triangulation_face_base_2<KFast,FbbFast>  FbFast;
+typedef CGAL::Triangulation_data_structure_2<VbFast,FbFast>         TDSFast;
+typedef CGAL::Exact_predicates_tag                                  ItagFast;
+typedef CGAL::Constrained_Delaunay_triangulation_2<KFast, TDSFast, ItagFast> CDTFast;
+
+template <class T>
+static void tg_mark_domains(T& ct, typename T::Face_handle start, int index, std::list<typename T::Edge>& border )
 {
     if(start->info().nesting_level != -1) {
         return;
     }
 
-    std::list<CDTPlus::Face_handle> queue;
+    std::list<typename T::Face_handle> queue;
     queue.push_back(start);
 
     while( !queue.empty() ){
-        CDTPlus::Face_handle fh = queue.front();
+        typename T::Face_handle fh = queue.front();
         queue.pop_front();
         if(fh->info().nesting_level == -1) {
             fh->info().nesting_level = index;
             for(int i = 0; i < 3; i++) {
-                CDTPlus::Edge e(fh,i);
-                CDTPlus::Face_handle n = fh->neighbor(i);
+                typename T::Edge e(fh,i);
+                typename T::Face_handle n = fh->neighbor(i);
                 if(n->info().nesting_level == -1) {
                     if(ct.is_constrained(e)) border.push_back(e);
                     else queue.push_back(n);
@@ -68,145 +79,132 @@ static void tg_mark_domains(CDT& ct, CDT::Face_handle start, int index, std::lis
 //level of 0. Then we recursively consider the non-explored facets incident
 //to constrained edges bounding the former set and increase the nesting level by 1.
 //Facets in the domain are those with an odd nesting level.
-static void tg_mark_domains(CDTPlus& cdt)
+template <class T>
+static void tg_mark_domains(T& cdt)
 {
-    for(CDTPlus::All_faces_iterator it = cdt.all_faces_begin(); it != cdt.all_faces_end(); ++it){
+    for(typename T::All_faces_iterator it = cdt.all_faces_begin(); it != cdt.all_faces_end(); ++it){
         it->info().nesting_level = -1;
     }
 
     int index = 0;
-    std::list<CDTPlus::Edge> border;
+    std::list<typename T::Edge> border;
     tg_mark_domains(cdt, cdt.infinite_face(), index++, border);
     while(! border.empty()) {
-        CDTPlus::Edge e = border.front();
+        typename T::Edge e = border.front();
         border.pop_front();
-        CDTPlus::Face_handle n = e.first->neighbor(e.second);
+        typename T::Face_handle n = e.first->neighbor(e.second);
         if(n->info().nesting_level == -1) {
             tg_mark_domains(cdt, n, e.first->info().nesting_level+1, border);
         }
     }
 }
 
-static void tg_insert_polygon(CDTPlus& cdt,const Polygon_2& polygon)
+template <class T>
+static void tg_insert_contour(T& cdt, const tgContour& contour)
 {
-    if ( polygon.is_empty() ) return;
-
-    CDTPlus::Vertex_handle v_prev=cdt.insert(*CGAL::cpp0x::prev(polygon.vertices_end()));
-    for (Polygon_2::Vertex_iterator vit=polygon.vertices_begin(); vit!=polygon.vertices_end();++vit) {
-        CDTPlus::Vertex_handle vh=cdt.insert(*vit);
-        cdt.insert_constraint(vh,v_prev);
+    typedef typename T::Point Point;
+
+    if ( contour.GetSize() == 0 ) return;
+
+    SGGeod last = contour.GetNode( contour.GetSize()-1 );
+    typename T::Vertex_handle v_prev=cdt.insert( Point( last.getLongitudeDeg(), last.getLatitudeDeg() ) );
+    for (unsigned int n = 0; n < contour.GetSize(); n++ ) {
+        SGGeod node = contour.GetNode(n);
+        typename T::Vertex_handle vh=cdt.insert( Point( node.getLongitudeDeg(), node.getLatitudeDeg() ) );
+        // repeated nodes (or a closing node) land on the same vertex - the
+        // plain constrained triangulation doesn't accept empty constraints
+        if ( vh != v_prev ) {
+            cdt.insert_constraint(vh,v_prev);
+        }
         v_prev=vh;
     }
 }
 
-void tgPolygon::Tesselate( const std::vector<SGGeod>& extra )
+// Triangulate the contours, with the extra points.  With check_crossing,
+// give up as soon as a constraint crossing adds a vertex that wasn't in
+// the input - that needs the exact kernel.
+template <class T>
+static bool tg_tesselate( const tgcontour_list& contours, const std::vector<SGGeod>& extra, bool check_crossing, tgPolygon& result )
 {
-    CDTPlus cdt;
-
-    SG_LOG( SG_GENERAL, SG_DEBUG, "Tess with extra" );
-
-    // Bail right away if polygon is empty
-    if ( contours.size() != 0 ) {
-        // First, convert the extra points to cgal Points
-        std::vector<Point> points;
-        points.reserve(extra.size());
-        for (unsigned int n = 0; n < extra.size(); n++) {
-            points.push_back( Point(extra[n].getLongitudeDeg(), extra[n].getLatitudeDeg() ) );
+    typedef typename T::Point Point;
+    T cdt;
+
+    // First, convert the extra points to cgal Points
+    std::vector<Point> points;
+    points.reserve(extra.size());
+    for (unsigned int n = 0; n < extra.size(); n++) {
+        points.push_back( Point(extra[n].getLongitudeDeg(), extra[n].getLatitudeDeg() ) );
+    }
+    cdt.insert(points.begin(), points.end());
+
+    // and the contour points, so we know how many vertices there should be
+    for ( unsigned int c = 0; c < contours.size(); c++ ) {
+        for (unsigned int n = 0; n < contours[c].GetSize(); n++ ) {
+            SGGeod node = contours[c].GetNode(n);
+            SG_LOG( SG_GENERAL, SG_BULK, "Tess : Adding GEOD " << node);
+            cdt.insert( Point( node.getLongitudeDeg(), node.getLatitudeDeg() ) );
         }
+    }
+    unsigned int num_input = cdt.number_of_vertices();
 
-        cdt.insert(points.begin(), points.end());
-
-        // then insert each polygon as a constraint into the triangulation
-        for ( unsigned int c = 0; c < contours.size(); c++ ) {
-            tgContour contour = contours[c];
-            Polygon_2 poly;
-
-            for (unsigned int n = 0; n < contour.GetSize(); n++ ) {
-                SGGeod node = contour.GetNode(n);
-                poly.push_back( Point( node.getLongitudeDeg(), node.getLatitudeDeg() ) );
-            }
+    // then insert each contour as a constraint into the triangulation
+    for ( unsigned int c = 0; c < contours.size(); c++ ) {
+        tg_insert_contour( cdt, contours[c] );
 
-            tg_insert_polygon(cdt, poly);
+        if ( check_crossing && cdt.number_of_vertices() != num_input ) {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Tess : constraints intersect - need exact constructions" );
+            return false;
         }
+    }
 
-        /* make conforming - still has an issue, and can't be compiled with exact_construction kernel */
-        // CGAL::make_conforming_Delaunay_2( cdt );
+    /* make conforming - still has an issue, and can't be compiled with exact_construction kernel */
+    // CGAL::make_conforming_Delaunay_2( cdt );
 
-        tg_mark_domains( cdt );
+    tg_mark_domains( cdt );
 
-        int count=0;
-        for (CDTPlus::Finite_faces_iterator fit=cdt.finite_faces_begin(); fit!=cdt.finite_faces_end(); ++fit) {
-            if ( fit->info().in_domain() ) {
-                Triangle_2 tri = cdt.triangle(fit);
+    for (typename T::Finite_faces_iterator fit=cdt.finite_faces_begin(); fit!=cdt.finite_faces_end(); ++fit) {
+        if ( fit->info().in_domain() ) {
+            Point v0 = fit->vertex(0)->point();
+            Point v1 = fit->vertex(1)->point();
+            Point v2 = fit->vertex(2)->point();
 
-                SGGeod p0 = SGGeod::fromDeg( to_double(tri.vertex(0).x()), to_double(tri.vertex(0).y()) );
-                SGGeod p1 = SGGeod::fromDeg( to_double(tri.vertex(1).x()), to_double(tri.vertex(1).y()) );
-                SGGeod p2 = SGGeod::fromDeg( to_double(tri.vertex(2).x()), to_double(tri.vertex(2).y()) );
+            SGGeod p0 = SGGeod::fromDeg( CGAL::to_double(v0.x()), CGAL::to_double(v0.y()) );
+            SGGeod p1 = SGGeod::fromDeg( CGAL::to_double(v1.x()), CGAL::to_double(v1.y()) );
+            SGGeod p2 = SGGeod::fromDeg( CGAL::to_double(v2.x()), CGAL::to_double(v2.y()) );
 
-                /* Check for Zero Area before inserting */
-                if ( !SGGeod_isEqual2D( p0, p1 ) && !SGGeod_isEqual2D( p1, p2 ) && !SGGeod_isEqual2D( p0, p2 ) ) {
-                    AddTriangle( p0, p1, p2 );
-                } else {
-                    SG_LOG( SG_GENERAL, SG_BULK, "tesselation dropping ZAT" );
-                }
-                
-                ++count;
+            /* Check for Zero Area before inserting */
+            if ( !SGGeod_isEqual2D( p0, p1 ) && !SGGeod_isEqual2D( p1, p2 ) && !SGGeod_isEqual2D( p0, p2 ) ) {
+                result.AddTriangle( p0, p1, p2 );
+            } else {
+                SG_LOG( SG_GENERAL, SG_BULK, "tesselation dropping ZAT" );
             }
         }
     }
+
+    return true;
 }
 
-void tgPolygon::Tesselate()
+void tgPolygon::Tesselate( const std::vector<SGGeod>& extra )
 {
-    CDTPlus cdt;
-
-    SG_LOG( SG_GENERAL, SG_DEBUG, "Tess" );
+    SG_LOG( SG_GENERAL, SG_DEBUG, "Tess with extra" );
 
     // Bail right away if polygon is empty
     if ( contours.size() != 0 ) {
-        // insert each polygon as a constraint into the triangulation
-        for ( unsigned int c = 0; c < contours.size(); c++ ) {
-            tgContour contour = contours[c];
-            Polygon_2 poly;
-
-            for (unsigned int n = 0; n < contour.GetSize(); n++ ) {
-                SGGeod node = contour.GetNode(n);
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Tess : Adding GEOD " << node);
-                poly.push_back( Point( node.getLongitudeDeg(), node.getLatitudeDeg() ) );
-            }
-
-            tg_insert_polygon(cdt, poly);
-        }
-
-        assert(cdt.is_valid());
-        tg_mark_domains( cdt );
-
-        int count=0;
-        for (CDTPlus::Finite_faces_iterator fit=cdt.finite_faces_begin(); fit!=cdt.finite_faces_end(); ++fit) {
-            if ( fit->info().in_domain() ) {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Tess : face   in domain");
-
-                Triangle_2 tri = cdt.triangle(fit);
-
-                SGGeod p0 = SGGeod::fromDeg( to_double(tri.vertex(0).x()), to_double(tri.vertex(0).y()) );
-                SGGeod p1 = SGGeod::fromDeg( to_double(tri.vertex(1).x()), to_double(tri.vertex(1).y()) );
-                SGGeod p2 = SGGeod::fromDeg( to_double(tri.vertex(2).x()), to_double(tri.vertex(2).y()) );
-
-                /* Check for Zero Area before inserting */
-                if ( !SGGeod_isEqual2D( p0, p1 ) && !SGGeod_isEqual2D( p1, p2 ) && !SGGeod_isEqual2D( p0, p2 ) ) {
-                    AddTriangle( p0, p1, p2 );
-                } else {
-                    SG_LOG( SG_GENERAL, SG_BULK, "tesselation dropping ZAT" );
-                }
-
-                ++count;
-            } else {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Tess : face not in domain");
-            }
+        // most polys are simple - try without exact constructions first
+        if ( tg_tesselate<CDTFast>( contours, extra, true, *this ) ) {
+            tess_path = TG_TESS_FAST;
+        } else {
+            tg_tesselate<CDTPlus>( contours, extra, false, *this );
+            tess_path = TG_TESS_EXACT;
         }
-    }
-    else
-    {
+    } else {
         SG_LOG( SG_GENERAL, SG_DEBUG, "Tess : no contours" );
     }
-}
\ No newline at end of file
+}
+
+void tgPolygon::Tesselate()
+{
+    std::vector<SGGeod> no_extra;
+
+    Tesselate( no_extra );
+}
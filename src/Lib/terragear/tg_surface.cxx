@@ -29,7 +29,7 @@
 #include <simgear/math/SGMath.hxx>
 #include <simgear/debug/logstream.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_array_cache.hxx>
 
 #include "TNT/jama_qr.h"
 #include "tg_surface.hxx"
@@ -94,7 +94,7 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
 {
     bool done = false;
     int i, j;
-    tgArray array;
+    string_list dirs;
 
     // just bail if no work to do
     if ( Pts.rows() == 0 || Pts.cols() == 0 ) {
@@ -110,6 +110,10 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
         }
     }
 
+    for ( i = 0; i < (int)elev_src.size(); ++i ) {
+        dirs.push_back( root + "/" + elev_src[i] );
+    }
+
     while ( !done ) {
         // find first node with -9999 elevation
         SGGeod first = SGGeod();
@@ -126,50 +130,40 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
 
         if ( found_one ) {
             SGBucket b( first );
-            std::string base = b.gen_base_path();
 
             // try the various elevation sources
-            j = 0;
-            bool found_file = false;
-            while ( !found_file && j < (int)elev_src.size() ) {
-                std::string array_path = root + "/" + elev_src[j] + "/" + base + "/" + b.gen_index_str();
-
-                if ( array.open(array_path) ) {
-                    found_file = true;
-                    SG_LOG( SG_GENERAL, SG_DEBUG, "Using array_path = " << array_path );
-                }
-                j++;
-            }
-
-            // this will fill in a zero structure if no array data
-            // found/opened
-            array.parse( b );
-
-            // this will do a hasty job of removing voids by inserting
-            // data from the nearest neighbor (sort of)
-            array.remove_voids();
+            tgArrayRef array = tgArrayCache::instance().Get( dirs, b );
 
             // update all the non-updated elevations that are inside
             // this array file
-            double elev;
+            std::vector<SGGeod> pending;
+            std::vector<double> elevs;
             done = true;
             for ( j = 0; j < Pts.rows(); ++j ) {
                 for ( i = 0; i < Pts.cols(); ++i ) {
                     SGGeod p = Pts.element(i,j);
                     if ( p.getElevationM() < -9000.0 ) {
                         done = false;
-                        elev = array.altitude_from_grid( p.getLongitudeDeg() * 3600.0,
-                                                         p.getLatitudeDeg() * 3600.0 );
-                        if ( elev > -9000 ) {
-                            p.setElevationM( elev );
-                            Pts.set(i, j, p);
-                        }
+                        pending.push_back( p );
                     }
                 }
             }
 
-            array.close();
+            array->altitude_from_grid( pending, elevs );
 
+            unsigned int k = 0;
+            for ( j = 0; j < Pts.rows(); ++j ) {
+                for ( i = 0; i < Pts.cols(); ++i ) {
+                    SGGeod p = Pts.element(i,j);
+                    if ( p.getElevationM() < -9000.0 ) {
+                        if ( elevs[k] > -9000 ) {
+                            p.setElevationM( elevs[k] );
+                            Pts.set(i, j, p);
+                        }
+                        k++;
+                    }
+                }
+            }
         } else {
             done = true;
         }
@@ -262,6 +262,9 @@ public:
     void SaveToGzFile( gzFile& fp ) const;
     void LoadFromGzFile( gzFile& fp );
 
+    // reset everything SaveToGzFile doesn't keep, as if just loaded
+    void ClearUnsaved( void );
+
     // Friend for output
     friend std::ostream& operator<< ( std::ostream&, const tgTriangle& );
 
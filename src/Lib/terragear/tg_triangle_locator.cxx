@@ -0,0 +1,200 @@
+// tg_triangle_locator.cxx -- find the triangles of a mesh containing a point
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#include "tg_triangle_locator.hxx"
+
+tgTriangleLocator::tgTriangleLocator( const tgtriangle_list& m ) :
+        mesh(m),
+        min_lon(0.0),
+        min_lat(0.0),
+        max_lon(0.0),
+        max_lat(0.0),
+        cell_w(1.0),
+        cell_h(1.0),
+        nx(1),
+        ny(1)
+{
+    unsigned int num_tris = mesh.size();
+    std::vector<tgRectangle> boxes;
+    double sum_w = 0.0, sum_h = 0.0;
+
+    boxes.reserve( num_tris );
+    for ( unsigned int t = 0; t < num_tris; t++ ) {
+        boxes.push_back( mesh[t].GetBoundingBox() );
+
+        const tgRectangle& bb = boxes.back();
+        if ( t == 0 ) {
+            min_lon = bb.getMin().getLongitudeDeg();
+            min_lat = bb.getMin().getLatitudeDeg();
+            max_lon = bb.getMax().getLongitudeDeg();
+            max_lat = bb.getMax().getLatitudeDeg();
+        } else {
+            min_lon = std::min( min_lon, bb.getMin().getLongitudeDeg() );
+            min_lat = std::min( min_lat, bb.getMin().getLatitudeDeg() );
+            max_lon = std::max( max_lon, bb.getMax().getLongitudeDeg() );
+            max_lat = std::max( max_lat, bb.getMax().getLatitudeDeg() );
+        }
+
+        sum_w += bb.getMax().getLongitudeDeg() - bb.getMin().getLongitudeDeg();
+        sum_h += bb.getMax().getLatitudeDeg()  - bb.getMin().getLatitudeDeg();
+    }
+
+    // about one triangle per cell, but no smaller than the average
+    // triangle, or each triangle ends up in lots of cells
+    if ( num_tris ) {
+        double width  = max_lon - min_lon;
+        double height = max_lat - min_lat;
+        double cell   = sqrt( width * height / num_tris );
+
+        if ( width > 0.0 ) {
+            double w = std::max( cell, sum_w / num_tris );
+            nx = std::max( 1, std::min( (int)ceil( width / w ), TG_TRI_LOCATOR_MAX_CELLS ) );
+            cell_w = width / nx;
+        }
+        if ( height > 0.0 ) {
+            double h = std::max( cell, sum_h / num_tris );
+            ny = std::max( 1, std::min( (int)ceil( height / h ), TG_TRI_LOCATOR_MAX_CELLS ) );
+            cell_h = height / ny;
+        }
+    }
+
+    // count the triangles in each cell, then fill them in mesh order
+    std::vector<unsigned int> count( nx * ny + 1, 0 );
+    int x0, y0, x1, y1;
+
+    for ( unsigned int t = 0; t < num_tris; t++ ) {
+        GetCellRange( boxes[t].getMin().getLongitudeDeg(), boxes[t].getMin().getLatitudeDeg(),
+                      boxes[t].getMax().getLongitudeDeg(), boxes[t].getMax().getLatitudeDeg(),
+                      x0, y0, x1, y1 );
+
+        for ( int y = y0; y <= y1; y++ ) {
+            for ( int x = x0; x <= x1; x++ ) {
+                count[ y * nx + x ]++;
+            }
+        }
+    }
+
+    cell_start.resize( nx * ny + 1 );
+    cell_start[0] = 0;
+    for ( int c = 0; c < nx * ny; c++ ) {
+        cell_start[c+1] = cell_start[c] + count[c];
+        count[c] = cell_start[c];
+    }
+    cell_tris.resize( cell_start[nx * ny] );
+
+    for ( unsigned int t = 0; t < num_tris; t++ ) {
+        GetCellRange( boxes[t].getMin().getLongitudeDeg(), boxes[t].getMin().getLatitudeDeg(),
+                      boxes[t].getMax().getLongitudeDeg(), boxes[t].getMax().getLatitudeDeg(),
+                      x0, y0, x1, y1 );
+
+        for ( int y = y0; y <= y1; y++ ) {
+            for ( int x = x0; x <= x1; x++ ) {
+                cell_tris[ count[ y * nx + x ]++ ] = t;
+            }
+        }
+    }
+}
+
+int tgTriangleLocator::CellX( double lon ) const
+{
+    int x = (int)floor( ( lon - min_lon ) / cell_w );
+    return std::max( 0, std::min( x, nx - 1 ) );
+}
+
+int tgTriangleLocator::CellY( double lat ) const
+{
+    int y = (int)floor( ( lat - min_lat ) / cell_h );
+    return std::max( 0, std::min( y, ny - 1 ) );
+}
+
+void tgTriangleLocator::GetCellRange( double min_x, double min_y, double max_x, double max_y,
+                                      int& x0, int& y0, int& x1, int& y1 ) const
+{
+    x0 = CellX( min_x );
+    y0 = CellY( min_y );
+    x1 = CellX( max_x );
+    y1 = CellY( max_y );
+}
+
+int tgTriangleLocator::InterpolateHeight( SGGeod& pt ) const
+{
+    if ( mesh.empty() ||
+         pt.getLongitudeDeg() < min_lon || pt.getLongitudeDeg() > max_lon ||
+         pt.getLatitudeDeg()  < min_lat || pt.getLatitudeDeg()  > max_lat ) {
+        return -1;
+    }
+
+    int cell = CellY( pt.getLatitudeDeg() ) * nx + CellX( pt.getLongitudeDeg() );
+
+    for ( unsigned int i = cell_start[cell]; i < cell_start[cell+1]; i++ ) {
+        if ( mesh[ cell_tris[i] ].InterpolateHeight( pt ) ) {
+            return cell_tris[i];
+        }
+    }
+
+    return -1;
+}
+
+unsigned int tgTriangleLocator::InterpolateHeights( std::vector<SGGeod>& pts, std::vector<int>& tris ) const
+{
+    unsigned int num_found = 0;
+
+    tris.resize( pts.size() );
+    for ( unsigned int i = 0; i < pts.size(); i++ ) {
+        tris[i] = InterpolateHeight( pts[i] );
+        if ( tris[i] >= 0 ) {
+            num_found++;
+        }
+    }
+
+    return num_found;
+}
+
+void tgTriangleLocator::GetCandidates( const tgRectangle& rect, std::vector<unsigned int>& result ) const
+{
+    result.clear();
+
+    if ( mesh.empty() ||
+         rect.getMax().getLongitudeDeg() < min_lon || rect.getMin().getLongitudeDeg() > max_lon ||
+         rect.getMax().getLatitudeDeg()  < min_lat || rect.getMin().getLatitudeDeg()  > max_lat ) {
+        return;
+    }
+
+    int x0, y0, x1, y1;
+    GetCellRange( rect.getMin().getLongitudeDeg(), rect.getMin().getLatitudeDeg(),
+                  rect.getMax().getLongitudeDeg(), rect.getMax().getLatitudeDeg(),
+                  x0, y0, x1, y1 );
+
+    for ( int y = y0; y <= y1; y++ ) {
+        for ( int x = x0; x <= x1; x++ ) {
+            int cell = y * nx + x;
+            result.insert( result.end(), cell_tris.begin() + cell_start[cell], cell_tris.begin() + cell_start[cell+1] );
+        }
+    }
+
+    // big triangles are in more than one cell
+    if ( x0 != x1 || y0 != y1 ) {
+        std::sort( result.begin(), result.end() );
+        result.erase( std::unique( result.begin(), result.end() ), result.end() );
+    }
+}
@@ -0,0 +1,83 @@
+// tg_triangle_locator.hxx -- find the triangles of a mesh containing a point
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+
+#ifndef _TG_TRIANGLE_LOCATOR_HXX
+#define _TG_TRIANGLE_LOCATOR_HXX
+
+#ifndef __cplusplus
+# error This library requires C++
+#endif
+
+#include <vector>
+
+#include <simgear/compiler.h>
+
+#include "tg_rectangle.hxx"
+#include "tg_triangle.hxx"
+
+// Draping a point onto a mesh used to mean trying every triangle in turn.
+// The locator buckets each triangle into the cells of a uniform grid its
+// bounding box covers, so a point only has to be tested against the
+// triangles of the one cell it's in.
+//
+// Each cell lists its triangles in mesh order, so when a point is on an
+// edge shared by more than one triangle, the locator picks the same one
+// as a linear search would.
+//
+// The locator keeps a reference to the mesh - the mesh must outlive it,
+// and must not be changed while it's in use.
+#define TG_TRI_LOCATOR_MAX_CELLS    (1024)
+
+class tgTriangleLocator
+{
+public:
+    tgTriangleLocator( const tgtriangle_list& mesh );
+
+    // index of the first triangle containing pt, or -1.  On success, the
+    // elevation of pt is interpolated from the triangle.
+    int InterpolateHeight( SGGeod& pt ) const;
+
+    // the same for a list of points.  tris gets the triangle index (or -1)
+    // for each point - returns the number of points found
+    unsigned int InterpolateHeights( std::vector<SGGeod>& pts, std::vector<int>& tris ) const;
+
+    // indices of all triangles whose bounding box may overlap the rectangle,
+    // in mesh order
+    void GetCandidates( const tgRectangle& rect, std::vector<unsigned int>& result ) const;
+
+private:
+    void GetCellRange( double min_x, double min_y, double max_x, double max_y,
+                       int& x0, int& y0, int& x1, int& y1 ) const;
+    int CellX( double lon ) const;
+    int CellY( double lat ) const;
+
+    const tgtriangle_list&  mesh;
+
+    double  min_lon;
+    double  min_lat;
+    double  max_lon;
+    double  max_lat;
+    double  cell_w;
+    double  cell_h;
+    int     nx;
+    int     ny;
+
+    // the triangles of cell i are cell_tris[cell_start[i]] to cell_tris[cell_start[i+1]-1]
+    std::vector<unsigned int> cell_start;
+    std::vector<unsigned int> cell_tris;
+};
+
+#endif // _TG_TRIANGLE_LOCATOR_HXX
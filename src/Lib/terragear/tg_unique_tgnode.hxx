@@ -4,13 +4,8 @@
 //#include <boost/unordered_set.hpp>
 //#include <boost/concept_check.hpp>
 
-// kd-tree for verticies ( with data for the vertex handle in arrangement
-#include <CGAL/Simple_cartesian.h>
-#include <CGAL/Kd_tree.h>
-#include <CGAL/algorithm.h>
-#include <CGAL/Fuzzy_sphere.h>
-#include <CGAL/Search_traits_2.h>
-#include <CGAL/Search_traits_adapter.h>
+#include <cmath>
+#include <boost/unordered_map.hpp>
 
 
 #include <simgear/debug/logstream.hxx>
@@ -323,14 +318,13 @@ struct TGFaceLookup {
 typedef std::vector < TGFaceLookup > TGFaceList;
 
 
-typedef INEXACTKernel::Point_2                  CartPoint;
+// Nodes closer than this are merged - approx 1 cm
+#define TG_NODE_MERGE_RADIUS    (0.0000001)
 
-typedef boost::tuple<CartPoint,unsigned int>    PointAndIndex;
-typedef CGAL::Search_traits_2<INEXACTKernel>    TraitsBase;
-typedef CGAL::Search_traits_adapter<PointAndIndex, CGAL::Nth_of_tuple_property_map<0, PointAndIndex>,TraitsBase>  SearchTraits;
-
-typedef CGAL::Fuzzy_sphere<SearchTraits>        FuzzyCir;
-typedef CGAL::Kd_tree<SearchTraits>             CartTree;
+// The set is hashed on a grid of cells bigger than the merge radius, so
+// a search only has to look in the cell of the node, and its neighbor
+// if the node is within the radius of the cell border.
+#define TG_NODE_CELL_SIZE       (0.000001)
 
 class TGNode {
 public:
@@ -345,7 +339,6 @@ public:
         CalcWgs84();
 
         type = t;
-        faces.clear();
         used = false;
     }
 
@@ -365,17 +358,6 @@ public:
         wgs84 = SGVec3d::fromGeod(position);
     }
 
-    inline void AddFace( unsigned int area, unsigned int poly, unsigned int tri )
-    {
-        TGFaceLookup    face;
-        face.area   = area;
-        face.poly   = poly;
-        face.tri    = tri;
-
-        faces.push_back( face );
-    }
-
-    inline TGFaceList const& GetFaces( void ) const { return faces; }
     inline bool IsFixedElevation( void ) const      { return (type == TG_NODE_FIXED_ELEVATION); }
     inline SGVec3d const& GetWgs84( void ) const    { return wgs84; }
 
@@ -407,8 +389,6 @@ public:
     }
     
     inline SGGeod const&  GetPosition( void ) const        { return position; }
-    inline void    SetNormal( const SGVec3f& n )    { normal = n; }
-    inline SGVec3f GetNormal( void ) const          { return normal; }
 
     void SaveToGzFile( gzFile& fp ) {
         sgWriteGeod( fp, position );
@@ -432,13 +412,11 @@ public:
     friend std::ostream& operator<< ( std::ostream&, const TGNode& );
  
 private:
+    // normals and face lists are kept by TGNodes, in arrays of their own
     SGGeod      position;
-    SGVec3f     normal;
     SGVec3d     wgs84;
     tgNodeType  type;
     bool        used;
-    
-    TGFaceList  faces;
 };
 
 class UniqueTGNodeSet {
@@ -450,57 +428,71 @@ public:
     }
 
     unsigned int add( const TGNode& n ) {
-        std::list<PointAndIndex> query_result;
-        int index;
-        
-        // first - create a search node
-        CartPoint pt( n.GetPosition().getLongitudeDeg(), n.GetPosition().getLatitudeDeg() );
-        FuzzyCir query_circle( pt, 0.0000001 );  // approx 1 cm
-
-        // perform the query
-        query_result.clear();
-        tree.search(std::back_inserter( query_result ), query_circle);
-
-        // we should always have at least one result
-        if ( query_result.empty() ) 
-        {
+        int index = find( n );
+
+        if ( index < 0 ) {
             index = node_list.size();
-            PointAndIndex pti(pt, index);
-            
-            tree.insert(pti);
+
+            // link the new node at the head of its cell
+            CellEntry entry;
+            entry.lon  = n.GetPosition().getLongitudeDeg();
+            entry.lat  = n.GetPosition().getLatitudeDeg();
+            entry.next = -1;
+
+            long long key = CellKey( CellIndex( entry.lon ), CellIndex( entry.lat ) );
+            boost::unordered_map<long long, unsigned int>::iterator it = cells.find( key );
+
+            if ( it == cells.end() ) {
+                cells[key] = index;
+            } else {
+                entry.next = it->second;
+                it->second = index;
+            }
+            entries.push_back( entry );
+
             node_list.push_back(n);
-        } else {
-            std::list<PointAndIndex>::const_iterator it = query_result.begin();
-            index = boost::get<1>(*it);
         }
 
         return index;
     }
 
+    // lowest index of the nodes within TG_NODE_MERGE_RADIUS, or -1
     int find( const TGNode& n ) const {
-        std::list<PointAndIndex> query_result;
+        double lon = n.GetPosition().getLongitudeDeg();
+        double lat = n.GetPosition().getLatitudeDeg();
         int index = -1;
-        
-        // first - create a search node
-        CartPoint pt( n.GetPosition().getLongitudeDeg(), n.GetPosition().getLatitudeDeg() );
-        FuzzyCir query_circle( pt, 0.0000001 );  // approx 1 cm
-
-        // perform the query
-        query_result.clear();
-        tree.search(std::back_inserter( query_result ), query_circle);
-
-        // we should always have at least one result
-        if ( !query_result.empty() ) 
-        {
-            std::list<PointAndIndex>::const_iterator it = query_result.begin();
-            index = boost::get<1>(*it);
+
+        int x0 = CellIndex( lon - TG_NODE_MERGE_RADIUS );
+        int x1 = CellIndex( lon + TG_NODE_MERGE_RADIUS );
+        int y0 = CellIndex( lat - TG_NODE_MERGE_RADIUS );
+        int y1 = CellIndex( lat + TG_NODE_MERGE_RADIUS );
+
+        for ( int x = x0; x <= x1; x++ ) {
+            for ( int y = y0; y <= y1; y++ ) {
+                boost::unordered_map<long long, unsigned int>::const_iterator it = cells.find( CellKey( x, y ) );
+                if ( it == cells.end() ) {
+                    continue;
+                }
+
+                for ( int i = it->second; i >= 0; i = entries[i].next ) {
+                    double dlon = entries[i].lon - lon;
+                    double dlat = entries[i].lat - lat;
+
+                    if ( dlon*dlon + dlat*dlat <= TG_NODE_MERGE_RADIUS*TG_NODE_MERGE_RADIUS ) {
+                        if ( index < 0 || i < index ) {
+                            index = i;
+                        }
+                    }
+                }
+            }
         }
 
         return index;
     }
 
     void clear( void ) {
-        tree.clear();
+        cells.clear();
+        entries.clear();
         node_list.clear();
     }
 
@@ -537,11 +529,29 @@ public:
     }
 
 private:
-    CartTree            tree;
+    static int CellIndex( double deg ) {
+        return (int)floor( deg / TG_NODE_CELL_SIZE );
+    }
+    static long long CellKey( int x, int y ) {
+        return ( (long long)x << 32 ) | (unsigned int)y;
+    }
+
+    // position of each node when it was added, and the next node in
+    // the same cell
+    struct CellEntry {
+        double  lon;
+        double  lat;
+        int     next;
+    };
+
+    // head of the chain of nodes in each cell
+    boost::unordered_map<long long, unsigned int>   cells;
+    std::vector<CellEntry>                          entries;
+
     std::vector<TGNode> node_list;
 };
 
 
 #endif
 
-#endif /* _TG_UNIQUE_TGNODE_HXX */
\ No newline at end of file
+#endif /* _TG_UNIQUE_TGNODE_HXX */
@@ -38,6 +38,7 @@
 #include <HGT/hgt.hxx>
 
 #include <stdlib.h>
+#include <string.h>
 
 using std::cout;
 using std::endl;
@@ -48,18 +49,30 @@ int main(int argc, char **argv) {
     sglog().setLogLevels( SG_ALL, SG_WARN );
     SG_LOG( SG_GENERAL, SG_ALERT, "hgtchop version " << getTGVersion() << "\n" );
 
-    if ( argc != 4 ) {
-	cout << "Usage " << argv[0] << " <resolution> <hgt_file> <work_dir>"
+    int compression = TG_ARRAY_DEFAULT_COMPRESSION;
+    int arg = 1;
+
+    if ( argc > 2 && !strcmp( argv[1], "--compression" ) ) {
+        compression = atoi( argv[2] );
+        arg += 2;
+    }
+
+    if ( argc - arg != 3 ) {
+	cout << "Usage " << argv[0] << " [--compression <0-9>] <resolution> <hgt_file> <work_dir>"
              << endl;
         cout << endl;
  	cout << "\tresolution must be either 1 or 3 for 1arcsec or 3arcsec"
              << endl;       
+ 	cout << "\tcompression is the gzip level of the .arr.gz files, or 0 for"
+             << endl;
+ 	cout << "\tuncompressed .arr files (default " << TG_ARRAY_DEFAULT_COMPRESSION << ")"
+             << endl;
 	exit(-1);
     }
 
-    int resolution = atoi( argv[1] );
-    string hgt_name = argv[2];
-    string work_dir = argv[3];
+    int resolution = atoi( argv[arg] );
+    string hgt_name = argv[arg + 1];
+    string work_dir = argv[arg + 2];
 
     // determine if file is 1arcsec or 3arcsec variety
     if ( resolution != 1 && resolution != 3 ) {
@@ -72,6 +85,7 @@ int main(int argc, char **argv) {
     workDir.create(0755);
 
     TGHgt hgt(resolution, hgt_name);
+    hgt.set_compression( compression );
     hgt.load();
     hgt.close();
 
@@ -32,6 +32,7 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <cstring>
 
 #ifdef _MSC_VER
 #  include <direct.h>
@@ -331,21 +332,34 @@ bool TGSrtmTiff::close() {
 int main(int argc, char **argv) {
     sglog().setLogLevels( SG_ALL, SG_WARN );
 
-    if ( argc != 3 ) {
-        cout << "Usage " << argv[0] << " <hgt_file> <work_dir>"
+    int compression = TG_ARRAY_DEFAULT_COMPRESSION;
+    int arg = 1;
+
+    if ( argc > 2 && !strcmp( argv[1], "--compression" ) ) {
+        compression = atoi( argv[2] );
+        arg += 2;
+    }
+
+    if ( argc - arg != 2 ) {
+        cout << "Usage " << argv[0] << " [--compression <0-9>] <hgt_file> <work_dir>"
              << endl;
         cout << endl;
+        cout << "\tcompression is the gzip level of the .arr.gz files, or 0 for"
+             << endl;
+        cout << "\tuncompressed .arr files (default " << TG_ARRAY_DEFAULT_COMPRESSION << ")"
+             << endl;
         exit(-1);
     }
 
-    string hgt_name = argv[1];
-    string work_dir = argv[2];
+    string hgt_name = argv[arg];
+    string work_dir = argv[arg + 1];
 
     SGPath sgp( work_dir );
     simgear::Dir workDir(sgp);
     workDir.create( 0755 );
 
     TGSrtmTiff hgt( hgt_name );
+    hgt.set_compression( compression );
     hgt.load();
     hgt.close();
 
@@ -26,13 +26,17 @@
 #  include <config.h>
 #endif
 
+#include <vector>
+
 #include <simgear/compiler.h>
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/debug/logstream.hxx>
-#include <simgear/io/lowlevel.hxx>
 #include <simgear/misc/sg_path.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include <Lib/terragear/tg_rectangle.hxx>
+#include <Lib/terragear/tg_array.hxx>
 
 #include <gdal.h>
 #include <gdal_priv.h>
@@ -40,6 +44,7 @@
 #include <ogr_spatialref.h>
 
 #include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
 
 /*
  * A simple benchmark using a 5x5 degree package
@@ -105,7 +110,8 @@ int SimpleRasterTransformer(void *pTransformerArg,
 
 class ImageInfo {
 public:
-    ImageInfo(GDALDataset *dataset);
+    ImageInfo(GDALDataset *dataset, GDALResampleAlg resample = GRA_NearestNeighbour);
+    ~ImageInfo();
 
     void GetBounds(double &n, double &s, double &e, double &w) const {
         n = north;
@@ -139,9 +145,23 @@ public:
                       int srcband = 1, int nodata = -32768);
 
 protected:
+    void InitWarp(int srcband, int nodata);
+
     /* The dataset */
     GDALDataset *dataset;
 
+    /*
+     * The transformer and warp options only depend on the image, so they
+     * are set up on the first chunk and reused for every bucket.  Only the
+     * placement of the chunk in xformData changes between calls, so each
+     * chunk gets a warp operation of its own.
+     */
+    GDALResampleAlg resampleAlg;
+    SimpleRasterTransformerInfo xformData;
+    GDALWarpOptions *warpOptions;
+    int warpBand;
+    double srcNodataReal, srcNodataImag;
+
     /* Source spatial reference system */
     OGRSpatialReference srs;
 
@@ -161,8 +181,13 @@ protected:
     double pxSizeX, pxSizeY;
 };
 
-ImageInfo::ImageInfo(GDALDataset *dataset) :
+ImageInfo::ImageInfo(GDALDataset *dataset, GDALResampleAlg resample) :
     dataset(dataset),
+    resampleAlg(resample),
+    warpOptions(NULL),
+    warpBand(0),
+    srcNodataReal(0.0),
+    srcNodataImag(0.0),
     srs(dataset->GetProjectionRef())
 {
     OGRSpatialReference wgs84SRS;
@@ -227,11 +252,18 @@ ImageInfo::ImageInfo(GDALDataset *dataset) :
            " e=" << east << " w=" << west);
 }
 
-void ImageInfo::GetDataChunk(int *buffer,
-                             double x, double y,
-                             double colstep, double rowstep,
-                             int w, int h,
-                             int srcband, int nodata)
+ImageInfo::~ImageInfo()
+{
+    if (warpOptions) {
+        GDALDestroyGenImgProjTransformer( xformData.pTransformerArg );
+        GDALDestroyWarpOptions( warpOptions );
+    }
+
+    OCTDestroyCoordinateTransformation( wgs84xform );
+    GDALClose( dataset );
+}
+
+void ImageInfo::InitWarp(int srcband, int nodata)
 {
     OGRSpatialReference wgs84SRS;
 
@@ -241,15 +273,75 @@ void ImageInfo::GetDataChunk(int *buffer,
     wgs84SRS.exportToWkt(&wgs84WKT);
 
     /* Setup a raster transformation from WGS84 to raster coordinates of the array files */
-    SimpleRasterTransformerInfo xformData;
     xformData.pTransformerArg = GDALCreateGenImgProjTransformer(
         dataset, NULL,
         NULL, wgs84WKT,
         FALSE,
         0.0,
         1);
-
     xformData.pfnTransformer = GDALGenImgProjTransform;
+
+    CPLFree( wgs84WKT );
+
+    /* establish the full source to target transformation */
+    warpOptions = GDALCreateWarpOptions();
+    warpBand = srcband;
+
+    int srcHasNodataValue;
+
+    srcNodataReal = dataset->GetRasterBand(srcband)->GetNoDataValue(&srcHasNodataValue);
+    srcNodataImag = 0.0;
+
+    /*
+     * Anything but nearest neighbour blends neighbouring pixels, so void
+     * pixels must be masked out, or they get smeared into valid heights
+     * along the edges.  Assume our own void value when the band has none.
+     */
+    if (!srcHasNodataValue && resampleAlg != GRA_NearestNeighbour) {
+        SG_LOG(SG_GENERAL, SG_INFO,
+               "Dataset '" << GetDescription() << "' has no nodata value, using " << nodata);
+        srcNodataReal = nodata;
+        srcHasNodataValue = TRUE;
+    }
+
+    warpOptions->hSrcDS = dataset;
+    warpOptions->hDstDS = NULL;
+    warpOptions->nBandCount = 1;
+    warpOptions->panSrcBands = (int *)CPLMalloc(sizeof(int));
+    warpOptions->panSrcBands[0] = srcband;
+    warpOptions->panDstBands = (int *)CPLMalloc(sizeof(int));
+    warpOptions->panDstBands[0] = 1;
+    warpOptions->nSrcAlphaBand = 0;
+    warpOptions->nDstAlphaBand = 0;
+    if (srcHasNodataValue) {
+        warpOptions->padfSrcNoDataReal = (double *)CPLMalloc(sizeof(double));
+        warpOptions->padfSrcNoDataReal[0] = srcNodataReal;
+        warpOptions->padfSrcNoDataImag = (double *)CPLMalloc(sizeof(double));
+        warpOptions->padfSrcNoDataImag[0] = srcNodataImag;
+    }
+    warpOptions->padfDstNoDataReal = NULL;
+    warpOptions->eResampleAlg = resampleAlg;
+    warpOptions->eWorkingDataType = GDT_Int32;
+
+    warpOptions->pfnTransformer = SimpleRasterTransformer;
+    warpOptions->pTransformerArg = &xformData;
+}
+
+void ImageInfo::GetDataChunk(int *buffer,
+                             double x, double y,
+                             double colstep, double rowstep,
+                             int w, int h,
+                             int srcband, int nodata)
+{
+    if (!warpOptions) {
+        InitWarp(srcband, nodata);
+    } else if (srcband != warpBand) {
+        SG_LOG(SG_GENERAL, SG_ALERT,
+               "Dataset '" << GetDescription() << "' was set up for band " << warpBand << ", not " << srcband);
+        return;
+    }
+
+    /* place the chunk */
     xformData.x0 = x - pxSizeX * 0.5;
     xformData.y0 = y - pxSizeY * 0.5;
     xformData.col_step = colstep;
@@ -257,60 +349,28 @@ void ImageInfo::GetDataChunk(int *buffer,
 
     // TODO: check if this image can actually cover part of the chunk
 
-    /* establish the full source to target transformation */
-    GDALWarpOptions *psWarpOptions = GDALCreateWarpOptions();
-
-    int srcBandNumbers[] = { srcband };
-    int dstBandNumbers[] = { 1 };
-
-    double srcNodataReal;
-    double srcNodataImag   =  0.0;
-    int    srcHasNodataValue;
-
-    srcNodataReal = dataset->GetRasterBand(srcband)->GetNoDataValue(&srcHasNodataValue);
+    /* do the warp - the operation keeps its own copy of the options */
+    GDALWarpOperation warpOperation;
+    if (warpOperation.Initialize( warpOptions ) != CE_None) {
+        SG_LOG(SG_GENERAL, SG_ALERT,
+               "Could not set up warp for dataset '" << GetDescription() << "'"
+               ":" << CPLGetLastErrorMsg());
+        return;
+    }
 
-    psWarpOptions->hSrcDS = dataset;
-    psWarpOptions->hDstDS = NULL;
-    psWarpOptions->nBandCount = 1;
-    psWarpOptions->panSrcBands = srcBandNumbers;
-    psWarpOptions->panDstBands = dstBandNumbers;
-    psWarpOptions->nSrcAlphaBand = 0;
-    psWarpOptions->nDstAlphaBand = 0;
-    psWarpOptions->padfSrcNoDataReal = (srcHasNodataValue ? &srcNodataReal : NULL);
-    psWarpOptions->padfSrcNoDataImag = (srcHasNodataValue ? &srcNodataImag : NULL);
-    psWarpOptions->padfDstNoDataReal = NULL;
-    psWarpOptions->eResampleAlg = GRA_NearestNeighbour;
-    psWarpOptions->eWorkingDataType = GDT_Int32;
-
-    psWarpOptions->pfnTransformer = SimpleRasterTransformer;
-    psWarpOptions->pTransformerArg = &xformData;
-
-    GDALWarpOperation oOperation;
-    oOperation.Initialize( psWarpOptions );
-
-    /* do the warp */
-    if (oOperation.WarpRegionToBuffer(0, 0, w, h, buffer, GDT_Int32) != CE_None) {
+    if (warpOperation.WarpRegionToBuffer(0, 0, w, h, buffer, GDT_Int32) != CE_None) {
         SG_LOG(SG_GENERAL, SG_ALERT,
                "Could not warp to buffer on dataset '" << GetDescription() << "'"
                ":" << CPLGetLastErrorMsg());
     }
-
-    /* clean up */
-    psWarpOptions->panSrcBands = NULL;
-    psWarpOptions->panDstBands = NULL;
-    psWarpOptions->padfSrcNoDataReal = NULL;
-    psWarpOptions->padfSrcNoDataImag = NULL;
-    psWarpOptions->padfDstNoDataReal = NULL;
-
-    GDALDestroyGenImgProjTransformer( xformData.pTransformerArg );
-    GDALDestroyWarpOptions( psWarpOptions );
 }
 
 void write_bucket(const std::string& work_dir, SGBucket bucket,
                   int* buffer,
                   int min_x, int min_y,
                   int span_x, int span_y,
-                  int col_step, int row_step)
+                  int col_step, int row_step,
+                  int compression)
 {
     // generate output file name
     std::string base = bucket.gen_base_path();
@@ -319,31 +379,25 @@ void write_bucket(const std::string& work_dir, SGBucket bucket,
     sgp.append( "dummy" );
     sgp.create_dir( 0755 );
 
-    std::string array_file = path + "/" + bucket.gen_index_str() + ".arr.gz";
-
-    gzFile fp;
-    if ( (fp = gzopen(array_file.c_str(), "wb9")) == NULL ) {
-        SG_LOG(SG_GENERAL, SG_ALERT, "cannot open " << array_file << " for writing!");
-        exit(-1);
-    }
+    std::string array_file = path + "/" + bucket.gen_index_str();
 
-    int32_t header = 0x54474152; // 'TGAR'
-    sgWriteLong(fp, header);
-    sgWriteInt(fp, min_x); sgWriteInt(fp, min_y);
-    sgWriteInt(fp, span_x); sgWriteInt(fp, col_step);
-    sgWriteInt(fp, span_y); sgWriteInt(fp, row_step);
+    // the buffer is row major, array files are column major
+    tgArrayWriter writer(min_x, min_y, span_x, col_step, span_y, row_step);
 
     for ( int x = 0; x < span_x; ++x ) {
         for ( int y = 0; y < span_y; ++y ) {
-            sgWriteShort(fp, buffer[ y * span_x + x ]);
+            writer.set_elev(x, y, buffer[ y * span_x + x ]);
         }
     }
 
-    gzclose(fp);
+    if ( !writer.write(array_file, compression) ) {
+        exit(-1);
+    }
 }
 
 void process_bucket(const SGPath& work_dir, SGBucket bucket,
                     ImageInfo* images[], int imagecount,
+                    int compression,
                     bool forceWrite = false)
 {
     double bnorth, bsouth, beast, bwest;
@@ -418,17 +472,179 @@ void process_bucket(const SGPath& work_dir, SGBucket bucket,
                  buffer.get(),
                  min_x, min_y,
                  span_x, span_y,
-                 col_step, row_step);
+                 col_step, row_step,
+                 compression);
+}
+
+/*
+ * Buckets still to be chopped, shared by all worker threads
+ */
+class BucketQueue {
+public:
+    BucketQueue() : next(0) {}
+
+    void add(const SGBucket& b) {
+        buckets.push_back(b);
+    }
+
+    bool get(SGBucket& b) {
+        SGGuard<SGMutex> g(lock);
+
+        if (next >= buckets.size())
+            return false;
+
+        b = buckets[next++];
+        return true;
+    }
+
+    unsigned int size() const {
+        return buckets.size();
+    }
+
+private:
+    std::vector<SGBucket> buckets;
+    unsigned int next;
+    SGMutex lock;
+};
+
+/*
+ * GDAL datasets can't be shared between threads, so each worker opens its
+ * own handle on every dataset, and keeps the warp setup for all of its
+ * buckets.
+ */
+class BucketChopper : public SGThread
+{
+public:
+    BucketChopper(const SGPath& work, const char** names, int count,
+                  GDALResampleAlg resample, int comp, BucketQueue& q, bool force) :
+        work_dir(work),
+        datasetnames(names),
+        datasetcount(count),
+        resampleAlg(resample),
+        compression(comp),
+        queue(q),
+        forceWrite(force)
+    {
+    }
+
+private:
+    virtual void run();
+
+    SGPath work_dir;
+    const char** datasetnames;
+    int datasetcount;
+    GDALResampleAlg resampleAlg;
+    int compression;
+    BucketQueue& queue;
+    bool forceWrite;
+};
+
+void BucketChopper::run()
+{
+    boost::scoped_array<ImageInfo *> images( new ImageInfo *[datasetcount] );
+
+    for (int i = 0; i < datasetcount; i++) {
+        GDALDataset* dataset = (GDALDataset*)GDALOpen(datasetnames[i], GA_ReadOnly);
+
+        if (dataset == NULL) {
+            SG_LOG(SG_GENERAL, SG_ALERT,
+                   "Could not open dataset '" << datasetnames[i] << "'"
+                   ":" << CPLGetLastErrorMsg());
+            exit(1);
+        }
+
+        images[i] = new ImageInfo(dataset, resampleAlg);
+    }
+
+    SGBucket bucket;
+    while (queue.get(bucket)) {
+        process_bucket(work_dir, bucket, images.get(), datasetcount, compression, forceWrite);
+    }
+
+    for (int i = 0; i < datasetcount; i++) {
+        delete images[i];
+    }
+}
+
+static bool parse_resample(const char* name, GDALResampleAlg& alg)
+{
+    if (!strcmp(name, "nearest")) {
+        alg = GRA_NearestNeighbour;
+    } else if (!strcmp(name, "bilinear")) {
+        alg = GRA_Bilinear;
+    } else if (!strcmp(name, "cubic")) {
+        alg = GRA_Cubic;
+    } else if (!strcmp(name, "cubicspline")) {
+        alg = GRA_CubicSpline;
+    } else if (!strcmp(name, "lanczos")) {
+        alg = GRA_Lanczos;
+    } else if (!strcmp(name, "average")) {
+        alg = GRA_Average;
+    } else if (!strcmp(name, "mode")) {
+        alg = GRA_Mode;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void usage(const char* progname)
+{
+    SG_LOG(SG_GENERAL, SG_ALERT,
+           "Usage " << progname << " [options] <work_dir> <datasetname...> [-- <bucket-idx> ...]");
+    SG_LOG(SG_GENERAL, SG_ALERT, "Options:");
+    SG_LOG(SG_GENERAL, SG_ALERT, "--threads <n>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "        Chop n buckets at once (default 1)");
+    SG_LOG(SG_GENERAL, SG_ALERT, "--all-threads");
+    SG_LOG(SG_GENERAL, SG_ALERT, "        Chop as many buckets at once as there are cpu cores");
+    SG_LOG(SG_GENERAL, SG_ALERT, "--resample <nearest|bilinear|cubic|cubicspline|lanczos|average|mode>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "        Resampling kernel (default nearest)");
+    SG_LOG(SG_GENERAL, SG_ALERT, "--compression <0-9>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "        gzip level of the .arr.gz files, or 0 for uncompressed .arr files (default " << TG_ARRAY_DEFAULT_COMPRESSION << ")");
+    exit(-1);
 }
 
 int main(int argc, const char **argv)
 {
     sglog().setLogLevels( SG_ALL, SG_INFO );
 
+    const char* progname = argv[0];
+    int num_threads = 1;
+    GDALResampleAlg resampleAlg = GRA_NearestNeighbour;
+    int compression = TG_ARRAY_DEFAULT_COMPRESSION;
+
+    while (argc > 1 && !strncmp(argv[1], "--", 2) && strcmp(argv[1], "--")) {
+        if (!strcmp(argv[1], "--threads") && argc > 2) {
+            num_threads = atoi(argv[2]);
+            argv += 2;
+            argc -= 2;
+        } else if (!strcmp(argv[1], "--all-threads")) {
+            num_threads = boost::thread::hardware_concurrency();
+            argv += 1;
+            argc -= 1;
+        } else if (!strcmp(argv[1], "--compression") && argc > 2) {
+            compression = atoi(argv[2]);
+            argv += 2;
+            argc -= 2;
+        } else if (!strcmp(argv[1], "--resample") && argc > 2) {
+            if (!parse_resample(argv[2], resampleAlg)) {
+                SG_LOG(SG_GENERAL, SG_ALERT, "Unknown resampling kernel '" << argv[2] << "'");
+                usage(progname);
+            }
+            argv += 2;
+            argc -= 2;
+        } else {
+            usage(progname);
+        }
+    }
+
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
     if ( argc < 3 ) {
-        SG_LOG(SG_GENERAL, SG_ALERT,
-               "Usage " << argv[0] << " <work_dir> <datasetname...> [-- <bucket-idx> ...]");
-        exit(-1);
+        usage(progname);
     }
 
     SGPath work_dir(argv[1]);
@@ -497,6 +713,8 @@ int main(int argc, const char **argv)
      *         all of them. Warn if no sufficient coverage (non-null pixels) is
      *         available.
      */
+    BucketQueue queue;
+
     if (tilecount == 0) {
         /*
          * No tiles were specified, so we determine the common bounds of all
@@ -513,9 +731,7 @@ int main(int argc, const char **argv)
 
         for (int x = 0; x <= dx; x++) {
             for (int y = 0; y <= dy; y++) {
-                SGBucket bucket = start.sibling(x, y);
-
-                process_bucket(work_dir, bucket, images.get(), datasetcount);
+                queue.add(start.sibling(x, y));
             }
         }
     } else {
@@ -524,11 +740,36 @@ int main(int argc, const char **argv)
          * data is available, but write them in any case.
          */
         for (int i = 0; i < tilecount; i++) {
-            SGBucket bucket(atol(tilenames[i]));
-
-            process_bucket(work_dir, bucket, images.get(), datasetcount, true);
+            queue.add(SGBucket(atol(tilenames[i])));
         }
     }
 
+    /*
+     * Step 3: Chop the buckets - the datasets opened above were only needed
+     *         for the bounds, each worker opens its own.
+     */
+    for (int i = 0; i < datasetcount; i++) {
+        delete images[i];
+    }
+
+    if (num_threads > (int)queue.size()) {
+        num_threads = std::max(1, (int)queue.size());
+    }
+
+    SG_LOG(SG_GENERAL, SG_INFO, "Chopping " << queue.size() << " buckets with " << num_threads << " threads");
+
+    std::vector<BucketChopper *> choppers;
+    for (int i = 0; i < num_threads; i++) {
+        BucketChopper* chopper = new BucketChopper(work_dir, datasetnames, datasetcount,
+                                                   resampleAlg, compression, queue, tilecount != 0);
+        chopper->start();
+        choppers.push_back(chopper);
+    }
+
+    for (unsigned int i = 0; i < choppers.size(); i++) {
+        choppers[i]->join();
+        delete choppers[i];
+    }
+
     return 0;
 }
@@ -24,13 +24,14 @@
 
 #include <string>
 #include <map>
+#include <deque>
 
 #include <boost/thread.hpp>
 #include <ogrsf_frmts.h>
 
 #include <simgear/compiler.h>
 #include <simgear/threads/SGThread.hxx>
-#include <simgear/threads/SGQueue.hxx>
+#include <simgear/threads/SGGuard.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/math/sg_geodesy.hxx>
 #include <simgear/misc/sg_path.hxx>
@@ -63,12 +64,59 @@ string attribute_query;
 bool use_spatial_query=false;
 double spat_min_x, spat_min_y, spat_max_x, spat_max_y;
 int num_threads = 1;
+int max_queued = 1000;
+int max_memory_mb = 0;
 bool save_shapefiles=false;
 std::string ds_name=".";
 
 const double gSnap = 0.00000001;      // approx 1 mm
 
-SGLockedQueue<OGRFeature *> global_workQueue;
+// Features are handed from the reader to the decoders through a bounded
+// queue, so only a window of the layer is held in memory, and decoding
+// starts as soon as the first feature has been read.  A NULL feature
+// tells a decoder that the layer is finished.
+class FeatureQueue
+{
+public:
+    FeatureQueue() : max_size(1) {}
+
+    void set_max_size( unsigned int s ) {
+        max_size = s ? s : 1;
+    }
+
+    // blocks while the queue is full
+    void push( OGRFeature* f ) {
+        SGGuard<SGMutex> g( mutex );
+        while ( queue.size() >= max_size ) {
+            not_full.wait( mutex );
+        }
+        queue.push_back( f );
+        not_empty.signal();
+    }
+
+    // blocks while the queue is empty
+    OGRFeature* pop( void ) {
+        SGGuard<SGMutex> g( mutex );
+        while ( queue.empty() ) {
+            not_empty.wait( mutex );
+        }
+        OGRFeature* f = queue.front();
+        queue.pop_front();
+        not_full.signal();
+
+        return f;
+    }
+
+private:
+    std::deque<OGRFeature*> queue;
+    unsigned int            max_size;
+
+    SGMutex                 mutex;
+    SGWaitCondition         not_empty;
+    SGWaitCondition         not_full;
+};
+
+FeatureQueue global_workQueue;
 
 /* very GDAL specific here... */
 inline static bool is_ocean_area( const std::string &area ) {
@@ -215,139 +263,145 @@ void Decoder::processPolygon(OGRPolygon* poGeometry, const string& area_type )
 void Decoder::run()
 {
     // as long as we have geometry to parse, do so
-    while (!global_workQueue.empty()) {
+    for (;;) {
         OGRFeature *poFeature = global_workQueue.pop();
-        // SG_LOG( SG_GENERAL, SG_INFO, " remaining features is " << global_workQueue.size() );
-
-        if ( poFeature ) {
-            OGRGeometry *poGeometry = poFeature->GetGeometryRef();
-
-            if (poGeometry==NULL) {
-                SG_LOG( SG_GENERAL, SG_INFO, "Found feature without geometry!" );
-                if (!continue_on_errors) {
-                    SG_LOG( SG_GENERAL, SG_ALERT, "Aborting!" );
-                    exit( 1 );
-                } else {
-                    continue;
-                }
-            }
+        if ( !poFeature ) {
+            // end of the layer
+            break;
+        }
 
-            OGRwkbGeometryType geoType=wkbFlatten(poGeometry->getGeometryType());
-            if (geoType!=wkbPoint && geoType!=wkbMultiPoint &&
-                geoType!=wkbLineString && geoType!=wkbMultiLineString &&
-                geoType!=wkbPolygon && geoType!=wkbMultiPolygon) {
-                    SG_LOG( SG_GENERAL, SG_INFO, "Unknown feature" );
-                    continue;
-            }
+        OGRGeometry *poGeometry = poFeature->GetGeometryRef();
 
-            string area_type_name=area_type;
-            if (area_type_field!=-1) {
-                area_type_name=poFeature->GetFieldAsString(area_type_field);
+        if (poGeometry==NULL) {
+            SG_LOG( SG_GENERAL, SG_INFO, "Found feature without geometry!" );
+            if (!continue_on_errors) {
+                SG_LOG( SG_GENERAL, SG_ALERT, "Aborting!" );
+                exit( 1 );
+            } else {
+                OGRFeature::DestroyFeature( poFeature );
+                continue;
             }
+        }
 
-            if ( is_ocean_area(area_type_name) ) {
-                // interior of polygon is ocean, holes are islands
+        OGRwkbGeometryType geoType=wkbFlatten(poGeometry->getGeometryType());
+        if (geoType!=wkbPoint && geoType!=wkbMultiPoint &&
+            geoType!=wkbLineString && geoType!=wkbMultiLineString &&
+            geoType!=wkbPolygon && geoType!=wkbMultiPolygon) {
+                SG_LOG( SG_GENERAL, SG_INFO, "Unknown feature" );
+                OGRFeature::DestroyFeature( poFeature );
+                continue;
+        }
 
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Ocean area ... SKIPPING!" );
+        string area_type_name=area_type;
+        if (area_type_field!=-1) {
+            area_type_name=poFeature->GetFieldAsString(area_type_field);
+        }
 
-                // Ocean data now comes from GSHHS so we want to ignore
-                // all other ocean data
-                continue;
-            } else if ( is_void_area(area_type_name) ) {
-                // interior is ????
+        if ( is_ocean_area(area_type_name) ) {
+            // interior of polygon is ocean, holes are islands
 
-                // skip for now
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Void area ... SKIPPING!" );
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Ocean area ... SKIPPING!" );
 
-                continue;
-            } else if ( is_null_area(area_type_name) ) {
-                // interior is ????
+            // Ocean data now comes from GSHHS so we want to ignore
+            // all other ocean data
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        } else if ( is_void_area(area_type_name) ) {
+            // interior is ????
 
-                // skip for now
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Null area ... SKIPPING!" );
+            // skip for now
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Void area ... SKIPPING!" );
 
-                continue;
-            }
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        } else if ( is_null_area(area_type_name) ) {
+            // interior is ????
 
-            poGeometry->transform( poCT );
-
-            switch (geoType) {
-            case wkbPoint: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Point feature" );
-                int width=point_width;
-                if (point_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(point_width_field);
-                    if (width == 0) {
-                        width=point_width;
-                    }
+            // skip for now
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Null area ... SKIPPING!" );
+
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        }
+
+        poGeometry->transform( poCT );
+
+        switch (geoType) {
+        case wkbPoint: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Point feature" );
+            int width=point_width;
+            if (point_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(point_width_field);
+                if (width == 0) {
+                    width=point_width;
                 }
-                processPoint((OGRPoint*)poGeometry, area_type_name, width);
-                break;
             }
-            case wkbMultiPoint: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPoint feature" );
-                int width=point_width;
-                if (point_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(point_width_field);
-                    if (width == 0) {
-                        width=point_width;
-                    }
-                }
-                OGRMultiPoint* multipt=(OGRMultiPoint*)poGeometry;
-                for (int i=0;i<multipt->getNumGeometries();i++) {
-                    processPoint((OGRPoint*)(multipt->getGeometryRef(i)), area_type_name, width);
+            processPoint((OGRPoint*)poGeometry, area_type_name, width);
+            break;
+        }
+        case wkbMultiPoint: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPoint feature" );
+            int width=point_width;
+            if (point_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(point_width_field);
+                if (width == 0) {
+                    width=point_width;
                 }
-                break;
             }
-            case wkbLineString: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "LineString feature" );
-                int width=line_width;
-                if (line_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(line_width_field);
-                    if (width == 0) {
-                        width=line_width;
-                    }
-                }
-
-                processLineString((OGRLineString*)poGeometry, area_type_name, width, texture_lines);
-                break;
+            OGRMultiPoint* multipt=(OGRMultiPoint*)poGeometry;
+            for (int i=0;i<multipt->getNumGeometries();i++) {
+                processPoint((OGRPoint*)(multipt->getGeometryRef(i)), area_type_name, width);
             }
-            case wkbMultiLineString: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiLineString feature" );
-                int width=line_width;
-                if (line_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(line_width_field);
-                    if (width == 0) {
-                        width=line_width;
-                    }
+            break;
+        }
+        case wkbLineString: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "LineString feature" );
+            int width=line_width;
+            if (line_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(line_width_field);
+                if (width == 0) {
+                    width=line_width;
                 }
+            }
 
-                OGRMultiLineString* multilines=(OGRMultiLineString*)poGeometry;
-                for (int i=0;i<multilines->getNumGeometries();i++) {
-                    processLineString((OGRLineString*)(multilines->getGeometryRef(i)), area_type_name, width, texture_lines);
+            processLineString((OGRLineString*)poGeometry, area_type_name, width, texture_lines);
+            break;
+        }
+        case wkbMultiLineString: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiLineString feature" );
+            int width=line_width;
+            if (line_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(line_width_field);
+                if (width == 0) {
+                    width=line_width;
                 }
-                break;
-            }
-            case wkbPolygon: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Polygon feature" );
-                processPolygon((OGRPolygon*)poGeometry, area_type_name);
-                break;
             }
-            case wkbMultiPolygon: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPolygon feature" );
-                OGRMultiPolygon* multipoly=(OGRMultiPolygon*)poGeometry;
-                for (int i=0;i<multipoly->getNumGeometries();i++) {
-                    processPolygon((OGRPolygon*)(multipoly->getGeometryRef(i)), area_type_name);
-                }
-                break;
+
+            OGRMultiLineString* multilines=(OGRMultiLineString*)poGeometry;
+            for (int i=0;i<multilines->getNumGeometries();i++) {
+                processLineString((OGRLineString*)(multilines->getGeometryRef(i)), area_type_name, width, texture_lines);
             }
-            default:
-                /* Ignore unhandled objects */
-                break;
+            break;
+        }
+        case wkbPolygon: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Polygon feature" );
+            processPolygon((OGRPolygon*)poGeometry, area_type_name);
+            break;
+        }
+        case wkbMultiPolygon: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPolygon feature" );
+            OGRMultiPolygon* multipoly=(OGRMultiPolygon*)poGeometry;
+            for (int i=0;i<multipoly->getNumGeometries();i++) {
+                processPolygon((OGRPolygon*)(multipoly->getGeometryRef(i)), area_type_name);
             }
-
-            OGRFeature::DestroyFeature( poFeature );
+            break;
+        }
+        default:
+            /* Ignore unhandled objects */
+            break;
         }
+
+        OGRFeature::DestroyFeature( poFeature );
     }
 }
 
@@ -437,7 +491,18 @@ void processLayer(OGRLayer* poLayer, tgChopper& results )
         }
     }
 
-    // Generate the work queue for this layer
+    // Start the decoders first - they generate the tgPolygons while
+    // this thread is still reading the layer
+    global_workQueue.set_max_size( max_queued );
+
+    std::vector<Decoder *> decoders;
+    for (int i=0; i<num_threads; i++) {
+        Decoder* decoder = new Decoder( poCT, area_type_field, point_width_field, line_width_field, results );
+        decoder->start();
+        decoders.push_back( decoder );
+    }
+
+    // Stream the features of this layer to the decoders
     OGRFeature *poFeature;
     poLayer->SetNextByIndex(start_record);
     while ( ( poFeature = poLayer->GetNextFeature()) != NULL )
@@ -445,18 +510,15 @@ void processLayer(OGRLayer* poLayer, tgChopper& results )
         global_workQueue.push( poFeature );
     }
 
-    // Now process the workqueue with threads
-    // this just generates all the tgPolygons
-    std::vector<Decoder *> decoders;
-    for (int i=0; i<num_threads; i++) {
-        Decoder* decoder = new Decoder( poCT, area_type_field, point_width_field, line_width_field, results );
-        decoder->start();
-        decoders.push_back( decoder );
+    // one end marker for each decoder
+    for (unsigned int i=0; i<decoders.size(); i++) {
+        global_workQueue.push( NULL );
     }
 
     // Then wait until they are finished
     for (unsigned int i=0; i<decoders.size(); i++) {
         decoders[i]->join();
+        delete decoders[i];
     }
 
     OCTDestroyCoordinateTransformation ( poCT );
@@ -497,6 +559,10 @@ void usage(char* progname) {
     SG_LOG( SG_GENERAL, SG_ALERT, "        Enable multithreading with user specified number of threads" );
     SG_LOG( SG_GENERAL, SG_ALERT, "--all-threads" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        Enable multithreading with all available cpu cores" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--max-queued count" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Maximum number of features read ahead of the decoders (default 1000)" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--max-memory megabytes" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Write clipped polygons to temporary chunk files above this size (default unlimited)" );
     SG_LOG( SG_GENERAL, SG_ALERT, "" );
     SG_LOG( SG_GENERAL, SG_ALERT, "<work_dir>" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        Directory to put the polygon files in" );
@@ -613,6 +679,20 @@ int main( int argc, char **argv ) {
             num_threads=boost::thread::hardware_concurrency(); 
             argv+=1;
             argc-=1;
+        } else if (!strcmp(argv[1],"--max-queued")) {
+            if (argc<3) {
+                usage(progname);
+            }
+            max_queued=atoi(argv[2]);
+            argv+=2;
+            argc-=2;
+        } else if (!strcmp(argv[1],"--max-memory")) {
+            if (argc<3) {
+                usage(progname);
+            }
+            max_memory_mb=atoi(argv[2]);
+            argv+=2;
+            argc-=2;
         } else if (!strcmp(argv[1],"--debug")) {
             argv++;
             argc--;
@@ -637,6 +717,7 @@ int main( int argc, char **argv ) {
     sgp.create_dir( 0755 );
 
     tgChopper results( work_dir );
+    results.SetMaxBytes( (size_t)max_memory_mb * 1024 * 1024 );
 
     // initialize persistant polygon counter
     //string counter_file = work_dir + "/poly_counter";
@@ -685,7 +766,10 @@ int main( int argc, char **argv ) {
     OGRDataSource::DestroyDataSource( poDS );
 
     SG_LOG(SG_GENERAL, SG_ALERT, "Saving to buckets");
-    results.Save( save_shapefiles );
+    if ( !results.Save( save_shapefiles ) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Some buckets could not be saved");
+        return 1;
+    }
 
     return 0;
 }
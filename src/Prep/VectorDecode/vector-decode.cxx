@@ -446,9 +446,14 @@ int main( int argc, char **argv ) {
     
     smooth_contours.Execute(true);
     
-    results.Save(false);
+    bool saved = results.Save(false);
     
     OGRDataSource::DestroyDataSource( poDS );
 
+    if ( !saved ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Some buckets could not be saved");
+        return 1;
+    }
+
     return 0;
 }